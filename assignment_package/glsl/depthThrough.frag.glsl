@@ -1,8 +0,0 @@
-#version 150
-
-out float fragmentdepth;
-
-void main()
-{
-    fragmentdepth = gl_FragCoord.z;
-}
@@ -0,0 +1,18 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// Refer to the lambert shader files for useful comments
+
+in vec4 fs_Nor;
+in vec4 fs_Col;
+
+out vec4 out_Col;
+
+const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0)); // Matches lambert.vert.glsl
+
+void main()
+{
+    float diffuseTerm = clamp(dot(normalize(fs_Nor), lightDir), 0, 1);
+    float ambientTerm = 0.3;
+    out_Col = vec4(fs_Col.rgb * (diffuseTerm + ambientTerm), fs_Col.a);
+}
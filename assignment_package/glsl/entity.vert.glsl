@@ -0,0 +1,45 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// Draws every mob and dropped item as one instanced unit cube. Each
+// instance reads two texels of u_Instances, written by
+// EntityWorld::fillInstances: its center and kind (0 for a mob, 1 for an
+// item), then its half size and, for items, block type.
+
+// Per-frame state shared by every program. Must match FrameData in frameuniforms.h.
+layout(std140) uniform FrameData {
+    mat4 u_ViewProj;    // The camera's view-projection matrix
+    mat4 u_InvViewProj; // Its inverse, taking screen space back to world space
+    mat4 u_View;        // The camera's view matrix
+    vec3 u_Eye;         // Camera pos
+    int u_Time;         // A time value that changes once every tick
+    ivec2 u_Dimensions; // Screen dimensions in pixels
+};
+
+uniform samplerBuffer u_Instances;
+
+in vec4 vs_Pos; // A corner of the unit cube, from (0, 0, 0) to (1, 1, 1)
+in vec4 vs_Nor;
+
+out vec4 fs_Nor;
+out vec4 fs_Col;
+
+// Item colors by BlockType: EMPTY, GRASS, DIRT, STONE, SNOW, LAVA, WATER,
+// ICE, SPIRE, SPIRE_TOP
+const vec3 blockColors[10] = vec3[](
+    vec3(1, 0, 1), vec3(0.37, 0.62, 0.21), vec3(0.47, 0.33, 0.23), vec3(0.5, 0.5, 0.5),
+    vec3(0.95, 0.97, 1), vec3(0.9, 0.35, 0.05), vec3(0.2, 0.35, 0.8),
+    vec3(0.65, 0.8, 0.95), vec3(0.45, 0.3, 0.55), vec3(0.75, 0.6, 0.85));
+const vec3 mobColor = vec3(0.85, 0.55, 0.45);
+
+void main()
+{
+    vec4 center = texelFetch(u_Instances, 2 * gl_InstanceID);
+    vec4 halfSize = texelFetch(u_Instances, 2 * gl_InstanceID + 1);
+
+    fs_Nor = vs_Nor;
+    fs_Col = vec4(center.w < 0.5 ? mobColor : blockColors[clamp(int(halfSize.w), 0, 9)], 1);
+
+    vec3 p = center.xyz + (vs_Pos.xyz * 2 - 1) * halfSize.xyz;
+    gl_Position = u_ViewProj * vec4(p, 1);
+}
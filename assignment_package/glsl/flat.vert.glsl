@@ -4,7 +4,15 @@
 // Refer to the lambert shader files for useful comments
 
 uniform mat4 u_Model;
-uniform mat4 u_ViewProj;
+// Per-frame state shared by every program. Must match FrameData in frameuniforms.h.
+layout(std140) uniform FrameData {
+    mat4 u_ViewProj;    // The camera's view-projection matrix
+    mat4 u_InvViewProj; // Its inverse, taking screen space back to world space
+    mat4 u_View;        // The camera's view matrix
+    vec3 u_Eye;         // Camera pos
+    int u_Time;         // A time value that changes once every tick
+    ivec2 u_Dimensions; // Screen dimensions in pixels
+};
 
 in vec4 vs_Pos;
 in vec4 vs_Col;
@@ -12,21 +12,17 @@
 // position, light position, and vertex color.
 
 uniform vec4 u_Color; // The color with which to render this instance of geometry.
-uniform sampler2D u_Texture; // The texture to be read from by this shader
-
-uniform sampler2D u_ShadowMap; // Shadow map texture read from by labert shader
-
-uniform vec3 u_Eye; // Camera pos
-
-uniform int u_Time; // A time value that changes once every tick
-uniform mat4 u_View;
-
-uniform mat4 u_ViewProj;    // The matrix that defines the camera's transformation.
-// We've written a static matrix for you to use for HW2,
-// but in HW3 you'll have to generate one yourself
-uniform mat4 u_depthMVP;
-
-uniform ivec2 u_Dimensions; // screen u_Dimensions
+uniform sampler2DArray u_Texture; // The block atlas, one tile per layer
+
+// Per-frame state shared by every program. Must match FrameData in frameuniforms.h.
+layout(std140) uniform FrameData {
+    mat4 u_ViewProj;    // The camera's view-projection matrix
+    mat4 u_InvViewProj; // Its inverse, taking screen space back to world space
+    mat4 u_View;        // The camera's view matrix
+    vec3 u_Eye;         // Camera pos
+    int u_Time;         // A time value that changes once every tick
+    ivec2 u_Dimensions; // Screen dimensions in pixels
+};
 
 // These are the interpolated values out of the rasterizer, so you can't know
 // their specific values without knowing the vertices that contributed to them
@@ -34,14 +30,15 @@ in vec4 fs_Pos;
 in vec4 fs_Nor;
 in vec4 fs_LightVec;
 in vec4 fs_UV;
+in vec2 fs_Light;
+in float fs_AO;
 in vec4 gl_FragCoord;
-in vec4 fs_PosLight;
 
 out vec4 out_Col; // This is the final output color that you will see on your
 // screen for the pixel that is currently being processed.
 
-const float FOG_NEAR = 90.1f;
-const float FOG_FAR = 100.0f;
+uniform float u_FogNear; // View-space depth at which fog starts
+uniform float u_FogFar;  // View-space depth at which geometry is fully fogged
 
 float random1(vec3 p) {
     return fract(sin(dot(p,vec3(127.1, 311.7, 191.999)))
@@ -97,6 +94,11 @@ vec3 rotateX(vec3 p, float a) {
     return v.xyz;
 }
 
+// Each light level is a fifth dimmer than the one above it
+float lightBrightness(float level) {
+    return pow(0.8, 15.0 * (1.0 - level));
+}
+
 const vec4 dayCol = vec4(vec3(114.f, 200.f, 252.f) / 255.f, .25f);
 const vec4 nightCol = vec4(vec3(32.f, 24.f, 72.f) / 255.f, .25f);
 const vec4 pinkCol = vec4(vec3(255.f, 255.f, 233.f) / 255.f, .25f);
@@ -106,13 +108,17 @@ void main()
 {
     // Material base color (before shading)
     vec4 diffuseColor;
-    if (fs_UV.x >= 13.0 / 16.0) {
-        // If this block has UV coords that fall in the range of LAVA or WATER
-        // offset the UVs as a function of time
-        diffuseColor = texture(u_Texture, vec2(fs_UV.x + mod(u_Time / 1000.0, 2.0 / 16.0), fs_UV.y));
+    if (fs_UV.w > 0.5) {
+        // LAVA and WATER scroll sideways through the two tiles to their
+        // right as a function of time
+        float u = fs_UV.x + mod(u_Time / 1000.0 * 16.0, 2.0);
+        // Mip selection uses the unwrapped UVs so the seam between two
+        // layers does not sample the smallest mip
+        diffuseColor = textureGrad(u_Texture, vec3(fract(u), fs_UV.y, fs_UV.z + floor(u)),
+                                   dFdx(fs_UV.xy), dFdy(fs_UV.xy));
     } else {
         // Draw with static UV coords
-        diffuseColor = texture(u_Texture, vec2(fs_UV.x, fs_UV.y));
+        diffuseColor = texture(u_Texture, fs_UV.xyz);
     }
 
     // Calculate the diffuse term for Lambert shading
@@ -122,47 +128,30 @@ void main()
 
     float ambientTerm = 0.2;
 
-    float lightIntensity = diffuseTerm + ambientTerm;   //Add a small float value to the color multiplier
-    //to simulate ambient lighting. This ensures that faces that are not
-    //lit by our point light are not completely black.
+    // How high the sun is, which also sets the fog color below
+    float fogMix = normalize(rotateX(normalize(vec3(0, 0.1, 1.0)), u_Time * 0.01)).y;
+    float daylight = mix(0.3, 1.0, smoothstep(-0.1, 0.3, fogMix));
+
+    // Sunlight only reaches as far as the sky light does, so caves and
+    // overhangs fall dark; glowing blocks light their surroundings warmly
+    vec3 skyLight = vec3((diffuseTerm + ambientTerm) * daylight * lightBrightness(fs_Light.x));
+    vec3 blockLight = vec3(1.0, 0.85, 0.6) * lightBrightness(fs_Light.y) * step(0.01, fs_Light.y);
+    vec3 lightIntensity = min(skyLight + blockLight, vec3(1.2)) * fs_AO;
 
     // Compute final shaded color
     vec4 finCol = vec4(diffuseColor.rgb * lightIntensity, diffuseColor.a);
 
-
-    // SHADOW ----------------------------------------------------------------------------
-    // To NDC (Screen space) [-1,1]
-    vec3 shadowCoord = fs_PosLight.xyz / fs_PosLight.w;
-    // To [0,1] for sampling
-    shadowCoord = shadowCoord * 0.5 + 0.5;
-    // Get shadow mapped stored depth
-    float storedDepth = texture(u_ShadowMap, shadowCoord.xy).r;
-    float fragmentDepth = shadowCoord.z;
-    // Check if fragment is in shadow with bias
-    float dotNorEye = dot(fs_Nor.xyz, u_Eye);
-    float bias = max(0.05 * (1.0 - dotNorEye), 0.005);
-    bool isInShadow = storedDepth < fragmentDepth - bias;
-    if (isInShadow) {
-        finCol.r = clamp(finCol.r - 0.3, 0, 0.3);
-        finCol.g = clamp(finCol.g - 0.3, 0, 0.3);
-        finCol.b = clamp(finCol.b - 0.3, 0, 0.3);
-    }
-    out_Col = finCol;
-    // finCol = vec4(storedDepth, storedDepth, storedDepth, 1.0);
-
-    // FOG ----------------------------------------------------------------------------
     vec4 camPos = u_View * fs_Pos;
-
     float depth = -camPos.z;
 
+    // FOG ----------------------------------------------------------------------------
     // Calculations done to blend the fog color to match the sky color
-    float fogMix = normalize(rotateX(normalize(vec3(0, 0.1, 1.0)), u_Time * 0.01)).y;
     float modFogMix = smoothstep(.3f, .6f, (fogMix + 1.f) / 2.f);
 
     vec4 fogCol = mix(nightCol, yellowCol, modFogMix);
     vec4 secondCol = mix(pinkCol, dayCol, modFogMix);
     fogCol = mix(fogCol, secondCol, modFogMix);
-    float fogAmt = smoothstep(FOG_NEAR, FOG_FAR, depth);
+    float fogAmt = smoothstep(u_FogNear, u_FogFar, depth);
 
     vec4 col = mix(finCol, fogCol, fogAmt);
     out_Col = col;
@@ -0,0 +1,10 @@
+#version 150
+// Color writes are masked off while occlusion queries run,
+// so this output is never actually stored.
+
+out vec4 out_Col;
+
+void main()
+{
+    out_Col = vec4(1.0);
+}
@@ -0,0 +1,21 @@
+#version 150
+// Transforms the bounding boxes drawn for occlusion queries.
+// Nothing is shaded; only the depth test result matters.
+
+uniform mat4 u_Model;       // Places the unit cube over one Chunk's bounds
+// Per-frame state shared by every program. Must match FrameData in frameuniforms.h.
+layout(std140) uniform FrameData {
+    mat4 u_ViewProj;    // The camera's view-projection matrix
+    mat4 u_InvViewProj; // Its inverse, taking screen space back to world space
+    mat4 u_View;        // The camera's view matrix
+    vec3 u_Eye;         // Camera pos
+    int u_Time;         // A time value that changes once every tick
+    ivec2 u_Dimensions; // Screen dimensions in pixels
+};
+
+in vec4 vs_Pos;             // Unit cube corner
+
+void main()
+{
+    gl_Position = u_ViewProj * u_Model * vs_Pos;
+}
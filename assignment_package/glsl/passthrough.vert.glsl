@@ -1,15 +1,14 @@
 #version 150
 // passthrough.vert.glsl:
-// A vertex shader that simply passes along vertex data
-// to the fragment shader without operating on it in any way.
-
-in vec4 vs_Pos;
-in vec4 vs_UV;
+// Draws the fullscreen triangle of Quad. It has no vertex data; its
+// corners (-1,-1), (3,-1) and (-1,3) come from gl_VertexID, which puts
+// the screen's corners at UVs (0,0) through (1,1).
 
 out vec4 fs_UV;
 
 void main()
 {
-    fs_UV = vs_UV;
-    gl_Position = vs_Pos;
+    vec2 uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    fs_UV = vec4(uv, 0, 0);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.9999, 1);
 }
@@ -1,13 +1,13 @@
 #version 150
-uniform mat4 u_ViewProj;    // We're actually passing the inverse of the viewproj
-// from our CPU, but it's named u_ViewProj so we don't
-// have to bother rewriting our ShaderProgram class
-
-uniform ivec2 u_Dimensions; // Screen dimensions
-
-uniform vec3 u_Eye; // Camera pos
-
-uniform int u_Time;
+// Per-frame state shared by every program. Must match FrameData in frameuniforms.h.
+layout(std140) uniform FrameData {
+    mat4 u_ViewProj;    // The camera's view-projection matrix
+    mat4 u_InvViewProj; // Its inverse, taking screen space back to world space
+    mat4 u_View;        // The camera's view matrix
+    vec3 u_Eye;         // Camera pos
+    int u_Time;         // A time value that changes once every tick
+    ivec2 u_Dimensions; // Screen dimensions in pixels
+};
 
 out vec4 out_Col;
 
@@ -321,7 +321,7 @@ void main()
 
     vec4 p = vec4(ndc, 1, 1); // Pixel at the far clip plane
     p *= FAR_CLIP; //project the pixel to far clip plane
-    p = /*Inverse of*/ u_ViewProj * p; // Convert from unhomogenized screen to world
+    p = u_InvViewProj * p; // Convert from unhomogenized screen to world
 
     // To get direction of ray, we "draw" a line from player's eye to the recently
     // porjected point (taking the difference of positions gets us this)
@@ -1,14 +1,10 @@
 #version 150
 // ^ Change this to version 130 if you have compatibility issues
 
-// Refer to the lambert shader files for useful comments
-
-uniform mat4 u_Model;
-uniform mat4 u_ViewProj;
-
-in vec4 vs_Pos;
+// Draws the fullscreen triangle of Quad; see passthrough.vert.glsl
 
 void main()
 {
-    gl_Position = vs_Pos;
+    vec2 uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.9999, 1);
 }
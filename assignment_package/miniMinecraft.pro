@@ -9,7 +9,12 @@ win32 {
     LIBS += -lglu32
 }
 CONFIG += warn_on
-CONFIG += debug
+
+# Polling glGetError after GL calls stalls the driver, so release builds
+# leave it out. Debug or release comes from the build configuration, so
+# it is not forced here. Add no_gl_error_checks to CONFIG to do the same
+# in debug.
+CONFIG(release, debug|release)|no_gl_error_checks: DEFINES += NO_GL_ERROR_CHECKS
 
 INCLUDEPATH += include
 
@@ -0,0 +1,72 @@
+#include "frameuniforms.h"
+
+FrameUniforms::FrameUniforms(OpenGLContext *context)
+    : mp_context(context), m_buffer(0), m_created(false), m_data(), m_dirty(true)
+{
+    m_data.viewProj = glm::mat4(1.f);
+    m_data.invViewProj = glm::mat4(1.f);
+    m_data.view = glm::mat4(1.f);
+    m_data.eye = glm::vec3(0.f);
+    m_data.time = 0;
+    m_data.dimensions = glm::ivec2(1);
+    m_data.padding[0] = m_data.padding[1] = 0;
+}
+
+void FrameUniforms::create()
+{
+    mp_context->glGenBuffers(1, &m_buffer);
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    mp_context->glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+    // Stays bound to its binding point for the life of the context
+    mp_context->glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, m_buffer);
+    m_created = true;
+    m_dirty = true;
+    mp_context->printGLErrorLog();
+}
+
+void FrameUniforms::destroy()
+{
+    if (m_created) {
+        mp_context->glDeleteBuffers(1, &m_buffer);
+        m_created = false;
+    }
+}
+
+void FrameUniforms::setCamera(const glm::mat4 &viewProj, const glm::mat4 &view, glm::vec3 eye)
+{
+    m_data.viewProj = viewProj;
+    m_data.invViewProj = glm::inverse(viewProj);
+    m_data.view = view;
+    m_data.eye = eye;
+    m_dirty = true;
+}
+
+void FrameUniforms::setDimensions(glm::ivec2 dims)
+{
+    m_data.dimensions = dims;
+    m_dirty = true;
+}
+
+void FrameUniforms::setTime(int time)
+{
+    m_data.time = time;
+    m_dirty = true;
+}
+
+void FrameUniforms::upload()
+{
+    if (!m_created || !m_dirty) {
+        return;
+    }
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    mp_context->glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &m_data);
+    m_dirty = false;
+}
+
+void FrameUniforms::bindProgram(OpenGLContext *context, GLuint prog)
+{
+    GLuint block = context->glGetUniformBlockIndex(prog, FRAME_UNIFORM_BLOCK);
+    if (block != GL_INVALID_INDEX) {
+        context->glUniformBlockBinding(prog, block, FRAME_UNIFORM_BINDING);
+    }
+}
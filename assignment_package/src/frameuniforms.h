@@ -0,0 +1,51 @@
+#pragma once
+#include "openglcontext.h"
+#include "glm_includes.h"
+
+// Uniform buffer binding point the FrameData block of every program reads from
+#define FRAME_UNIFORM_BINDING 0
+// Name of the uniform block in the shaders
+#define FRAME_UNIFORM_BLOCK "FrameData"
+
+// CPU copy of the std140 FrameData block declared in the glsl/ shaders.
+// Members are ordered so std140 needs no padding between them; keep both
+// in the same order.
+struct FrameData {
+    glm::mat4 viewProj;    // u_ViewProj
+    glm::mat4 invViewProj; // u_InvViewProj
+    glm::mat4 view;        // u_View
+    glm::vec3 eye;         // u_Eye
+    int time;              // u_Time, packed into the vec3's last slot
+    glm::ivec2 dimensions; // u_Dimensions, in pixels
+    int padding[2];        // std140 rounds the block up to 16 bytes
+};
+static_assert(sizeof(FrameData) == 224, "FrameData must match the std140 layout of the shader block");
+
+// The state every program shares within a frame, kept in one uniform
+// buffer that all of them read. It is written at most once per frame,
+// however many programs draw with it.
+class FrameUniforms
+{
+private:
+    OpenGLContext *mp_context;
+    GLuint m_buffer;
+    bool m_created;
+    FrameData m_data;
+    bool m_dirty; // m_data changed since it was last uploaded
+
+public:
+    FrameUniforms(OpenGLContext *context);
+
+    void create();
+    void destroy();
+
+    void setCamera(const glm::mat4 &viewProj, const glm::mat4 &view, glm::vec3 eye);
+    void setDimensions(glm::ivec2 dims);
+    void setTime(int time);
+
+    // Uploads anything that changed; call once before drawing each frame
+    void upload();
+
+    // Points the given program's FrameData block, if it has one, at our buffer
+    static void bindProgram(OpenGLContext *context, GLuint prog);
+};
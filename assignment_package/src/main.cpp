@@ -1,4 +1,5 @@
 #include <mainwindow.h>
+#include "pregenerate.h"
 
 #include <QApplication>
 #include <QSurfaceFormat>
@@ -21,6 +22,11 @@ void debugFormatVersion()
 
 int main(int argc, char *argv[])
 {
+    // Generating the world ahead of time needs no window, or even a display
+    if (wantsPregeneration(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        return pregenerateWorld(app);
+    }
 
     QApplication a(argc, argv);
 
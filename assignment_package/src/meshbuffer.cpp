@@ -0,0 +1,287 @@
+#include "meshbuffer.h"
+#include <algorithm>
+
+MeshRange::MeshRange()
+    : baseVertex(0), vertexCount(0), indexCount(0), vertexCapacity(0)
+{}
+
+bool MeshRange::isEmpty() const
+{
+    return indexCount == 0;
+}
+
+bool MeshRange::isAllocated() const
+{
+    return vertexCapacity > 0;
+}
+
+QuadIndexBuffer::QuadIndexBuffer(OpenGLContext *context)
+    : mp_context(context), m_bufIndices(0), m_created(false), m_quadCapacity(0)
+{}
+
+void QuadIndexBuffer::generate(GLsizei quadCount)
+{
+    std::vector<GLuint> idx;
+    idx.reserve(quadCount * INDICES_PER_QUAD);
+    for (GLsizei q = 0; q < quadCount; ++q) {
+        GLuint v = q * VERTICES_PER_QUAD;
+        idx.push_back(v);
+        idx.push_back(v + 1);
+        idx.push_back(v + 2);
+        idx.push_back(v);
+        idx.push_back(v + 2);
+        idx.push_back(v + 3);
+    }
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIndices);
+    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(GLuint), idx.data(), GL_STATIC_DRAW);
+    m_quadCapacity = quadCount;
+}
+
+void QuadIndexBuffer::create(GLsizei quadCount)
+{
+    mp_context->glGenBuffers(1, &m_bufIndices);
+    m_created = true;
+    generate(quadCount);
+    mp_context->printGLErrorLog();
+}
+
+void QuadIndexBuffer::destroy()
+{
+    if (m_created) {
+        mp_context->glDeleteBuffers(1, &m_bufIndices);
+        m_created = false;
+        m_quadCapacity = 0;
+    }
+}
+
+void QuadIndexBuffer::reserve(GLsizei quadCount)
+{
+    if (m_created && quadCount > m_quadCapacity) {
+        generate(std::max(quadCount, m_quadCapacity * 2));
+    }
+}
+
+bool QuadIndexBuffer::bind()
+{
+    if (m_created) {
+        mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIndices);
+    }
+    return m_created;
+}
+
+GLsizei QuadIndexBuffer::quadCapacity() const
+{
+    return m_quadCapacity;
+}
+
+size_t QuadIndexBuffer::sizeBytes() const
+{
+    return m_quadCapacity * INDICES_PER_QUAD * sizeof(GLuint);
+}
+
+void MultiDrawCommands::clear()
+{
+    counts.clear();
+    offsets.clear();
+    baseVertices.clear();
+}
+
+void MultiDrawCommands::add(const MeshRange &range)
+{
+    if (range.isEmpty()) {
+        return;
+    }
+    counts.push_back(range.indexCount);
+    // Every mesh starts at the beginning of the shared quad pattern
+    offsets.push_back(nullptr);
+    baseVertices.push_back(range.baseVertex);
+}
+
+GLsizei MultiDrawCommands::size() const
+{
+    return static_cast<GLsizei>(counts.size());
+}
+
+// Leave ~12% headroom (rounded to 64 vertices) on every allocation so a
+// Chunk that gains a few faces when remeshed can be rewritten in place.
+static size_t withSlack(size_t count)
+{
+    return (count + count / 8 + 63) & ~static_cast<size_t>(63);
+}
+
+MeshBuffer::MeshBuffer(OpenGLContext *context, QuadIndexBuffer &quadIndices, GLsizei vertexStride)
+    : mp_context(context), m_quadIndices(quadIndices), m_bufVertices(0), m_created(false),
+      m_vertexStride(vertexStride), m_vertexSpace(), m_liveRanges()
+{}
+
+void MeshBuffer::create(size_t vertexCapacity)
+{
+    m_vertexSpace.reset(vertexCapacity);
+    m_liveRanges.clear();
+
+    mp_context->glGenBuffers(1, &m_bufVertices);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufVertices);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, vertexCapacity * m_vertexStride, nullptr, GL_STATIC_DRAW);
+
+    m_created = true;
+    mp_context->printGLErrorLog();
+}
+
+void MeshBuffer::destroy()
+{
+    if (m_created) {
+        mp_context->glDeleteBuffers(1, &m_bufVertices);
+        m_created = false;
+    }
+    // Anyone still holding a range now holds nothing
+    for (MeshRange *range : m_liveRanges) {
+        *range = MeshRange();
+    }
+    m_liveRanges.clear();
+    m_vertexSpace.reset(0);
+}
+
+bool MeshBuffer::isCreated() const
+{
+    return m_created;
+}
+
+void MeshBuffer::grow(size_t required)
+{
+    size_t oldCapacity = m_vertexSpace.capacity();
+    size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + required);
+
+    GLuint newBuffer;
+    mp_context->glGenBuffers(1, &newBuffer);
+    mp_context->glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    mp_context->glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * m_vertexStride, nullptr, GL_STATIC_DRAW);
+
+    // Move the meshes that are already resident over without a CPU round trip.
+    // Offsets are unchanged, so no MeshRange needs to be patched.
+    if (oldCapacity > 0) {
+        mp_context->glBindBuffer(GL_COPY_READ_BUFFER, m_bufVertices);
+        mp_context->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * m_vertexStride);
+    }
+    mp_context->glDeleteBuffers(1, &m_bufVertices);
+    m_bufVertices = newBuffer;
+    m_vertexSpace.grow(newCapacity);
+}
+
+size_t MeshBuffer::allocate(size_t size)
+{
+    size_t offset = m_vertexSpace.allocate(size);
+    if (offset == RangeAllocator::INVALID) {
+        grow(size);
+        offset = m_vertexSpace.allocate(size);
+    }
+    return offset;
+}
+
+void MeshBuffer::move(size_t from, size_t to, size_t count)
+{
+    // Source and destination never overlap; defragment() only moves a mesh
+    // into a hole that ends before the mesh begins.
+    mp_context->glBindBuffer(GL_COPY_READ_BUFFER, m_bufVertices);
+    mp_context->glBindBuffer(GL_COPY_WRITE_BUFFER, m_bufVertices);
+    mp_context->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                    from * m_vertexStride, to * m_vertexStride, count * m_vertexStride);
+}
+
+void MeshBuffer::upload(MeshRange &range, const std::vector<glm::vec4> &vertexData)
+{
+    size_t vertexCount = vertexData.size() * sizeof(glm::vec4) / m_vertexStride;
+    if (vertexCount == 0) {
+        release(range);
+        return;
+    }
+
+    bool fits = range.isAllocated() && vertexCount <= static_cast<size_t>(range.vertexCapacity);
+    if (!fits) {
+        release(range);
+        size_t vertexCapacity = withSlack(vertexCount);
+        range.baseVertex = static_cast<GLint>(allocate(vertexCapacity));
+        range.vertexCapacity = static_cast<GLsizei>(vertexCapacity);
+        m_liveRanges.insert(&range);
+    }
+    GLsizei quadCount = static_cast<GLsizei>(vertexCount / VERTICES_PER_QUAD);
+    range.vertexCount = static_cast<GLsizei>(vertexCount);
+    range.indexCount = quadCount * INDICES_PER_QUAD;
+    m_quadIndices.reserve(quadCount);
+
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufVertices);
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, range.baseVertex * m_vertexStride,
+                                vertexCount * m_vertexStride, vertexData.data());
+}
+
+void MeshBuffer::release(MeshRange &range)
+{
+    if (range.isAllocated()) {
+        m_vertexSpace.free(range.baseVertex, range.vertexCapacity);
+        m_liveRanges.erase(&range);
+    }
+    range = MeshRange();
+}
+
+size_t MeshBuffer::defragment(size_t budgetBytes)
+{
+    size_t moved = 0;
+    if (!m_created || m_liveRanges.empty() || m_vertexSpace.freeBlockCount() <= 1) {
+        return moved;
+    }
+
+    std::vector<MeshRange*> ranges(m_liveRanges.begin(), m_liveRanges.end());
+
+    // Relocate the meshes furthest back into the earliest hole that can hold
+    // them. Each move frees space at the tail, which coalesces with whatever
+    // hole is already there.
+    std::sort(ranges.begin(), ranges.end(), [](const MeshRange *a, const MeshRange *b) {
+        return a->baseVertex > b->baseVertex;
+    });
+    for (MeshRange *range : ranges) {
+        if (moved >= budgetBytes) {
+            break;
+        }
+        size_t to = m_vertexSpace.allocateBelow(range->vertexCapacity, range->baseVertex);
+        if (to == RangeAllocator::INVALID) {
+            continue;
+        }
+        move(range->baseVertex, to, range->vertexCount);
+        m_vertexSpace.free(range->baseVertex, range->vertexCapacity);
+        range->baseVertex = static_cast<GLint>(to);
+        moved += range->vertexCount * m_vertexStride;
+    }
+
+    if (moved > 0) {
+        mp_context->printGLErrorLog();
+    }
+    return moved;
+}
+
+MeshBufferStats MeshBuffer::vertexStats() const
+{
+    MeshBufferStats stats;
+    stats.capacityBytes = m_vertexSpace.capacity() * m_vertexStride;
+    stats.usedBytes = m_vertexSpace.used() * m_vertexStride;
+    stats.largestFreeBlockBytes = m_vertexSpace.largestFreeBlock() * m_vertexStride;
+    stats.freeBlockCount = m_vertexSpace.freeBlockCount();
+    stats.fragmentation = m_vertexSpace.fragmentation();
+    return stats;
+}
+
+bool MeshBuffer::bindVertices()
+{
+    if (m_created) {
+        mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufVertices);
+    }
+    return m_created;
+}
+
+bool MeshBuffer::bindIndices()
+{
+    return m_quadIndices.bind();
+}
+
+GLsizei MeshBuffer::vertexStride() const
+{
+    return m_vertexStride;
+}
@@ -0,0 +1,142 @@
+#ifndef MESHBUFFER_H
+#define MESHBUFFER_H
+
+#include <openglcontext.h>
+#include <glm_includes.h>
+#include "rangeallocator.h"
+#include <unordered_set>
+#include <vector>
+
+// Every mesh in a MeshBuffer is a list of quads, four vertices per quad,
+// drawn as two triangles each with the pattern in QuadIndexBuffer
+const static int VERTICES_PER_QUAD = 4;
+const static int INDICES_PER_QUAD = 6;
+
+// The region of a MeshBuffer that one mesh (e.g. one Chunk's opaque
+// geometry) was uploaded to. The offset is measured in vertices rather
+// than bytes so it can be handed straight to glMultiDrawElementsBaseVertex.
+struct MeshRange {
+    GLint baseVertex;     // First vertex of this mesh inside the vertex buffer
+    GLsizei vertexCount;  // Number of vertices this mesh occupies
+    GLsizei indexCount;   // Number of shared quad indices needed to draw it
+
+    // How many vertices are actually reserved for the mesh. Usually a
+    // little more than vertexCount so a remeshed Chunk can be rewritten
+    // in place without going back to the allocator.
+    GLsizei vertexCapacity;
+
+    MeshRange();
+    bool isEmpty() const;
+    bool isAllocated() const;
+};
+
+// A single element buffer holding 0,1,2, 0,2,3 repeated for quad 0, 1, 2...
+// Since every mesh is made of quads, all of them can share this one pattern
+// and draw starting at index 0 with their own base vertex, instead of each
+// storing a private copy of the same indices.
+class QuadIndexBuffer
+{
+private:
+    OpenGLContext *mp_context;
+    GLuint m_bufIndices;
+    bool m_created;
+    GLsizei m_quadCapacity;
+
+    void generate(GLsizei quadCount);
+
+public:
+    QuadIndexBuffer(OpenGLContext *context);
+
+    void create(GLsizei quadCount);
+    void destroy();
+    // Regenerate the pattern if it is too short to draw quadCount quads
+    void reserve(GLsizei quadCount);
+
+    bool bind();
+    GLsizei quadCapacity() const;
+    size_t sizeBytes() const;
+};
+
+// The list of sub-draws issued by a single glMultiDrawElementsBaseVertex call.
+// Kept as parallel arrays because that is the layout GL wants; reuse one
+// instance across frames so the vectors keep their capacity.
+struct MultiDrawCommands {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+
+    void clear();
+    void add(const MeshRange &range);
+    GLsizei size() const;
+};
+
+// Occupancy figures for a MeshBuffer's vertex storage
+struct MeshBufferStats {
+    size_t capacityBytes;
+    size_t usedBytes;
+    size_t largestFreeBlockBytes;
+    size_t freeBlockCount;
+    float fragmentation; // See RangeAllocator::fragmentation()
+};
+
+// One large vertex buffer that many meshes are packed into. Every mesh in
+// a MeshBuffer must share the same vertex layout, so a single set of
+// glVertexAttribPointer calls followed by one glMultiDrawElementsBaseVertex
+// can draw all of them at once; indices come from a shared QuadIndexBuffer.
+// Space is managed by a free-list RangeAllocator, so meshes can be
+// replaced and released without ever creating new GL buffer handles.
+class MeshBuffer
+{
+private:
+    OpenGLContext *mp_context;
+    QuadIndexBuffer &m_quadIndices;
+    GLuint m_bufVertices;
+    bool m_created;
+
+    GLsizei m_vertexStride;   // Size of one vertex in bytes
+
+    RangeAllocator m_vertexSpace;  // Measured in vertices
+
+    // Every range that currently owns space, so defragment() can
+    // move meshes around and patch their owners' offsets
+    std::unordered_set<MeshRange*> m_liveRanges;
+
+    // Reallocate the vertex buffer with room for at least required more
+    // vertices, copying the existing contents over on the GPU.
+    void grow(size_t required);
+    // Allocate vertex space, growing the GPU buffer if no hole fits
+    size_t allocate(size_t size);
+    // Copy count vertices inside the buffer from one offset to another
+    void move(size_t from, size_t to, size_t count);
+
+public:
+    MeshBuffer(OpenGLContext *context, QuadIndexBuffer &quadIndices, GLsizei vertexStride);
+
+    // Allocates the GPU vertex buffer. Capacity is in vertices.
+    void create(size_t vertexCapacity);
+    void destroy();
+    bool isCreated() const;
+
+    // Copies a mesh of quads into the buffer, reusing range's existing space
+    // if the new mesh still fits in it and reallocating otherwise.
+    // vertexData holds vertexStride bytes per vertex, packed as vec4s.
+    // range must stay at the same address until it is released, since
+    // defragment() updates it in place.
+    void upload(MeshRange &range, const std::vector<glm::vec4> &vertexData);
+    // Gives a previously uploaded range back to the buffer.
+    void release(MeshRange &range);
+
+    // Moves meshes toward the front of the buffer to merge free holes,
+    // copying at most budgetBytes of data. Returns the bytes moved.
+    size_t defragment(size_t budgetBytes);
+
+    MeshBufferStats vertexStats() const;
+
+    bool bindVertices();
+    // Binds the shared quad pattern
+    bool bindIndices();
+
+    GLsizei vertexStride() const;
+};
+
+#endif // MESHBUFFER_H
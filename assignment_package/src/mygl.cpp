@@ -1,21 +1,25 @@
 #include "mygl.h"
+#include "programbinarycache.h"
 #include <glm_includes.h>
 
 #include <iostream>
 #include <QApplication>
 #include <QKeyEvent>
-#include <QDateTime>
+#include <QDebug>
+
+// Texture slots 0 and 1 hold the block atlas and the frame buffer
+const static int ENTITY_INSTANCE_SLOT = 2;
 
 MyGL::MyGL(QWidget *parent)
     : OpenGLContext(parent),
       m_worldAxes(this),
       m_progLambert(this), m_progFlat(this), m_texture(this),
-      m_terrain(this), m_player(glm::vec3(48.f, 170.f, 48.f), m_terrain),
-      m_currTime(QDateTime::currentMSecsSinceEpoch()), m_timeSinceStart(0),
+      m_terrain(this), m_simulation(PLAYER_SPAWN, m_terrain),
       m_framebuffer(FrameBuffer(this, this->width(), this->height(), this->devicePixelRatio())),
-      m_progTint(this), m_progNoOp(this), m_progDepthThrough(this), m_progShandow(this), quad(Quad(this)),
-      m_depthFrameBuffer(DepthFrameBuffer(this, this->width(), this->height(), this->devicePixelRatio())),
-      m_progSky(this)
+      m_progTint(this), m_progNoOp(this),
+      m_progSky(this), m_progEntity(this), m_entityCubes(this, 2), quad(Quad(this)),
+      m_frameUniforms(this), m_frameTimer(), m_frameMsCulled(0.f), m_frameMsUnculled(0.f),
+      m_framesSinceReport(0), m_simMs(0.f), m_streamMs(0.f), m_renderMs(0.f), m_staleTicks(0)
 {
     // Connect the timer to a function so that when the timer ticks the function is executed
     connect(&m_timer, SIGNAL(timeout()), this, SLOT(tick()));
@@ -23,15 +27,29 @@ MyGL::MyGL(QWidget *parent)
     m_timer.start(16);
     setFocusPolicy(Qt::ClickFocus);
 
+    // Changed Chunks are saved every 10 seconds unless this says otherwise
+    bool ok = false;
+    int autosaveSeconds = qgetenv("MINIMC_AUTOSAVE_SECONDS").toInt(&ok);
+    if (ok && autosaveSeconds > 0) {
+        m_terrain.setAutosaveInterval(autosaveSeconds * 1000);
+    }
+
     setMouseTracking(true); // MyGL will track the mouse's movements even if a mouse button is not pressed
     setCursor(Qt::BlankCursor); // Make the cursor invisible
 }
 
 MyGL::~MyGL() {
+    // The simulation reads the Terrain, so it must stop before anything goes
+    m_simulation.stop();
+    // Keep whatever was generated or edited for the next run
+    m_terrain.saveAll();
     makeCurrent();
     glDeleteVertexArrays(1, &vao);
+    m_terrain.destroyBuffers();
+    m_entityCubes.destroy();
+    m_entityCubes.destroyInstances();
     m_framebuffer.destroy();
-    m_depthFrameBuffer.destroy();
+    m_frameUniforms.destroy();
 }
 
 
@@ -67,34 +85,52 @@ void MyGL::initializeGL()
     // Create render buffers
     m_framebuffer.create();
 
-    // Create a depth buffer
-    m_depthFrameBuffer.create();
+    // Create the uniform buffer every program reads the camera and time from
+    m_frameUniforms.create();
 
     //Create the instance of the world axes
     m_worldAxes.create();
 
+    // Create the shared buffers every Chunk uploads its geometry into
+    m_terrain.createBuffers();
+
+    // Time how long the shaders take to be ready, which on a warm start is
+    // mostly reading program binaries back from the cache
+    QElapsedTimer shaderTimer;
+    shaderTimer.start();
+
     // Create and set up the diffuse shader
     m_progLambert.create(":/glsl/lambert.vert.glsl", ":/glsl/lambert.frag.glsl");
     // Create and set up the flat lighting shader
     m_progFlat.create(":/glsl/flat.vert.glsl", ":/glsl/flat.frag.glsl");
-    // Create shader for depth map
-    m_progDepthThrough.create(":/glsl/depthThrough.vert.glsl", ":/glsl/depthThrough.frag.glsl");
 
     // Create post processing shader for tinting in water
     m_progTint.create(":/glsl/passthrough.vert.glsl", ":/glsl/screentint.frag.glsl");
     // Create post processing shader for no operation
     m_progNoOp.create(":/glsl/passthrough.vert.glsl", ":/glsl/noOp.frag.glsl");
-    m_progShandow.create(":/glsl/passthrough.vert.glsl", ":/glsl/shadowMap.frag.glsl");
 
     // Create and set up sky shader
     m_progSky.create(":/glsl/sky.vert.glsl", ":/glsl/sky.frag.glsl");
 
+    // Create the shader and cube mobs and dropped items are drawn with
+    m_progEntity.create(":/glsl/entity.vert.glsl", ":/glsl/entity.frag.glsl");
+
+    qDebug() << "Shaders ready in" << shaderTimer.elapsed() << "ms;"
+             << ProgramBinaryCache::hits() << "programs loaded from the binary cache,"
+             << ProgramBinaryCache::misses() << "compiled.";
+
     // Set a color with which to draw geometry.
     // This will ultimately not be used when you change
     // your program to render Chunks with vertex colors
     // and UV coordinates
     m_progLambert.setGeometryColor(glm::vec4(0,1,0,1));
 
+    // The far terrain carries the world out to the camera's far plane,
+    // so fog only needs to hide the very edge of it
+    m_progLambert.setFog(1024.f, 3072.f);
+
+    m_entityCubes.create();
+
     // Create and load the appropriate texture
     m_texture.create();
     m_texture.load(0);
@@ -113,87 +149,67 @@ void MyGL::initializeGL()
 
 //    m_progNoOp.setDimensions(glm::ivec2(this->width(), this->height()));
 //    m_progTint.setDimensions(glm::ivec2(this->width(), this->height()));
-    m_progShandow.setDimensions(glm::ivec2(this->width(), this->height()));
+
+    // Everything the Player needs is ready; start moving it
+    m_simulation.setViewport(static_cast<unsigned int>(width()), static_cast<unsigned int>(height()));
+    m_simulation.start();
 }
 
 void MyGL::resizeGL(int w, int h) {
+    // Qt may have used the context since we last did
+    invalidateStateCache();
     //This code sets the concatenated view and perspective projection matrices used for
     //our scene's camera view.
-    m_player.setCameraWidthHeight(static_cast<unsigned int>(w), static_cast<unsigned int>(h));
-    glm::mat4 viewproj = m_player.mcr_camera.getViewProj();
-
-    // Upload the view-projection matrix to our shaders (i.e. onto the graphics card)
-
-    m_progLambert.setViewProjMatrix(viewproj);
-    m_progLambert.setViewMatrix(glm::inverse(m_player.mcr_camera.getProj()) * viewproj);
-    m_progFlat.setViewProjMatrix(viewproj);
-    m_progDepthThrough.setViewProjMatrix(viewproj);
-    m_progSky.setViewProjMatrix(viewproj);
+    m_simulation.setViewport(static_cast<unsigned int>(w), static_cast<unsigned int>(h));
 
 //    m_progNoOp.setDimensions(glm::ivec2(w, h));
 //    m_progTint.setDimensions(glm::ivec2(w, h));
 
-    m_progShandow.setDimensions(glm::ivec2(w, h));
-    m_progDepthThrough.setDimensions(glm::ivec2(w, h));
-    m_progSky.useMe();
-    m_progSky.setDimensions(glm::ivec2(w * this->devicePixelRatio(), h * this->devicePixelRatio()));
+    m_frameUniforms.setDimensions(glm::ivec2(w * this->devicePixelRatio(), h * this->devicePixelRatio()));
 #ifdef MAC
-    m_progShandow.setDimensions(glm::ivec2(w * 2 ,h * 2));
-    m_progDepthThrough.setDimensions(glm::ivec2(w * 2, h * 2));
-    m_progSky.useMe();
-    m_progSky.setDimensions(glm::ivec2(w * 2, h * 2));
+    m_frameUniforms.setDimensions(glm::ivec2(w * 2, h * 2));
 #endif
 
-    glm::vec3 cam = m_player.mcr_camera.mcr_position;
-    m_progSky.useMe();
-    this->glUniform3f(m_progSky.unifEye, cam.x, cam.y, cam.z);
-    m_progLambert.useMe();
-    this->glUniform3f(m_progLambert.unifEye, cam.x, cam.y, cam.z);
-
     // resize frame buffer
     m_framebuffer.resize(w, h, this->devicePixelRatio());
     m_framebuffer.destroy();
     m_framebuffer.create();
 
-    // resize depth buffer
-    m_depthFrameBuffer.resize(w, h, this->devicePixelRatio());
-    m_depthFrameBuffer.destroy();
-    m_depthFrameBuffer.create();
-
     printGLErrorLog();
 }
 
 
 // MyGL's constructor links tick() to a timer that fires 60 times per second.
-// We're treating MyGL as our game engine class, so we're going to perform
-// all per-frame actions here, such as performing physics updates on all
-// entities in the scene.
+// The Player is simulated on its own thread (see Simulation); here we take
+// its newest snapshot and do the GL thread's share of the frame: streaming
+// terrain around the Player, uploading what finished meshing, and drawing.
 void MyGL::tick() {
-    // Calculate dT and pass relevant time values to tick and shader
-    float dT = (QDateTime::currentMSecsSinceEpoch() - m_currTime) / 1000.f;
-    float time = m_timeSinceStart;
-    m_progLambert.setTime(time);
-    m_progSky.setTime(time);
-    m_progDepthThrough.setTime(time);
-
-    m_player.tick(dT, m_inputs);
-
-    // Update time values
-    m_currTime = QDateTime::currentMSecsSinceEpoch();
-    m_timeSinceStart++;
+    // Qt may have used the context since we last did
+    invalidateStateCache();
+    if (!m_simulation.fetchSnapshot()) {
+        ++m_staleTicks;
+    }
+    const FrameSnapshot &frame = m_simulation.snapshot();
+    m_frameUniforms.setTime(frame.tick);
 
-    m_terrain.expandTerrainBasedOnPlayer(m_player.mcr_position);
+    QElapsedTimer streamTimer;
+    streamTimer.start();
+    m_terrain.expandTerrainBasedOnPlayer(frame.playerPos, frame.playerVel, frame.look);
+    float streamMs = streamTimer.nsecsElapsed() / 1000000.f;
+    m_streamMs = m_streamMs == 0.f ? streamMs : glm::mix(m_streamMs, streamMs, 0.05f);
+    m_simMs = m_simMs == 0.f ? frame.simMs : glm::mix(m_simMs, frame.simMs, 0.05f);
 
     update(); // Calls paintGL() as part of a larger QOpenGLWidget pipeline
     sendPlayerDataToGUI(); // Updates the info in the secondary window displaying player data
 }
 
 void MyGL::sendPlayerDataToGUI() const {
-    emit sig_sendPlayerPos(m_player.posAsQString());
-    emit sig_sendPlayerVel(m_player.velAsQString());
-    emit sig_sendPlayerAcc(m_player.accAsQString());
-    emit sig_sendPlayerLook(m_player.lookAsQString());
-    glm::vec2 pPos(m_player.mcr_position.x, m_player.mcr_position.z);
+    const FrameSnapshot &frame = m_simulation.snapshot();
+    emit sig_sendPlayerPos(frame.posText);
+    emit sig_sendPlayerVel(frame.velText);
+    emit sig_sendPlayerAcc(frame.accText);
+    emit sig_sendPlayerLook(frame.lookText);
+    glm::vec2 pPos(frame.playerPos.x, frame.playerPos.z);
     glm::ivec2 chunk(16 * glm::ivec2(glm::floor(pPos / 16.f)));
     glm::ivec2 zone(64 * glm::ivec2(glm::floor(pPos / 64.f)));
     emit sig_sendPlayerChunk(QString::fromStdString("( " + std::to_string(chunk.x) + ", " + std::to_string(chunk.y) + " )"));
@@ -204,75 +220,79 @@ void MyGL::sendPlayerDataToGUI() const {
 // MyGL's constructor links update() to a timer that fires 60 times per second,
 // so paintGL() called at a rate of 60 frames per second.
 void MyGL::paintGL() {
+    // Qt draws with the context between our frames, so none of the cached
+    // bindings can be trusted. Uniform values live in our own programs and
+    // stay cached; setters below only upload what changed since last frame.
+    invalidateStateCache();
+    QElapsedTimer renderTimer;
+    renderTimer.start();
+
+    // Written once here for every program that draws this frame
+    const FrameSnapshot &frame = m_simulation.snapshot();
+    m_frameUniforms.setCamera(frame.viewProj, frame.view, frame.eye);
+    m_frameUniforms.upload();
+
+    // Draw only the Chunks the camera could possibly see
+    glm::ivec4 bounds = terrainRenderBounds();
+    m_terrain.updateVisibleSections(bounds[0], bounds[1], bounds[2], bounds[3], frame.eye);
 
-    m_progFlat.setViewProjMatrix(m_player.mcr_camera.getViewProj());
-    m_progLambert.setViewProjMatrix(m_player.mcr_camera.getViewProj());
-    m_progSky.setViewProjMatrix(glm::inverse(m_player.mcr_camera.getViewProj()));
-
-    m_progLambert.setViewMatrix(glm::inverse(m_player.mcr_camera.getProj()) * m_player.mcr_camera.getViewProj());
-
-    m_progSky.useMe();
-    glm::vec3 cam = m_player.mcr_camera.mcr_position;
-    this->glUniform3f(m_progSky.unifEye, cam.x, cam.y, cam.z);
-    m_progLambert.useMe();
-    this->glUniform3f(m_progLambert.unifEye, cam.x, cam.y, cam.z);
-    m_progDepthThrough.useMe();
-    this->glUniform3f(m_progDepthThrough.unifEye, cam.x, cam.y, cam.z);
-
-//    m_progDepthThough.setDepthMVP(glm::normalize(glm::vec3(0.5f, 1.f, 0.75f)));
-//    glm::mat4 depthProjectionMatrix = glm::ortho<float>(-10.f, 10.f, -10.f, 10.f, 0.1f, 1000.f);
-    glm::mat4 lightPorj = glm::ortho<float>(-100.f, 100.f, -100.f, 100.f, 0.1f, 1000.f);
-    glm::vec3 lightPos = glm::vec3(40.f, 180.f, -20.f);
-    glm::vec3 lightDir = glm::normalize(glm::vec3(0.5f, -0.6f, 0.75f));
-    glm::mat4 lightView = glm::lookAt(lightPos, lightDir, glm::vec3(0, 1, 0));
-//    glm::mat4 cameraView = glm::lookAt(glm::vec3(41.0529, 172.854 ,-20.898),
-//                                       glm::normalize(glm::vec3(0.5f, 1.f, 0.75f)) + glm::vec3(41.0529, 172.854 ,-20.898),
-//                                       glm::vec3(0, 1 ,0));
-//    cameraView = m_player.mcr_camera.getView();
-
-    glm::mat4 lighViewProj = lightPorj * lightView;
-    // >>>>>> REFACTORING
-    m_progDepthThrough.setDepthMVP(lighViewProj);
-    // TODO == SEND SUN AND U_EYE
-    m_progDepthThrough.setLightProj(lightPorj);
-    m_progDepthThrough.useMe();
-    this->glUniform3f(m_progDepthThrough.unifEye, cam.x, cam.y, cam.z);
-
-    // >>>>>> REFACTORING
-    m_progLambert.setDepthMVP(lighViewProj);
-    m_progLambert.setLightProj(lightPorj);
-    m_progLambert.setViewMatrix(m_player.mcr_camera.getView());
-
-    preformLightPerspectivePass();
-    // SKY
-    quad.bufferVBOdata();
-    m_progSky.drawQuad(quad);
     preformPlayerPerspectivePass();
     performTerrainPostprocessRenderPass();
 
     glDisable(GL_DEPTH_TEST);
     m_progFlat.setModelMatrix(glm::mat4());
-    m_progFlat.setViewProjMatrix(m_player.mcr_camera.getViewProj());
     m_progFlat.drawOpaque(m_worldAxes);
     glEnable(GL_DEPTH_TEST);
+    // Draws leave their attributes enabled for the next draw to reuse;
+    // hand the vertex array back to Qt clean
+    enableVertexAttribs({});
+
+    // CPU time only; the GPU finishes the frame after we return
+    float renderMs = renderTimer.nsecsElapsed() / 1000000.f;
+    m_renderMs = m_renderMs == 0.f ? renderMs : glm::mix(m_renderMs, renderMs, 0.05f);
+    reportFrameStats();
 }
 
-void MyGL::preformLightPerspectivePass()
+void MyGL::reportFrameStats()
 {
-    // Bind depth frame buffer
-    m_depthFrameBuffer.bindFrameBuffer();
-    // Render on the whole framebuffer, complete from the lower left corner to the upper right
-    int viewW = this->width() * this->devicePixelRatio();
-    int viewH = this->height() * this->devicePixelRatio();
-#ifdef MAC
-    viewW = this->width() * 2;
-    viewH = this->height() * 2;
-#endif
-    glViewport(0,0, viewW, viewH);
-    // Clear the screen so that we only see newly drawn images
-    glClear(GL_DEPTH_BUFFER_BIT);
-    renderTerrain(&m_progDepthThrough);
-    glBindFramebuffer(GL_FRAMEBUFFER, this->defaultFramebufferObject());
+    if (!m_frameTimer.isValid()) {
+        m_frameTimer.start();
+        return;
+    }
+    // Paints are paced by the 16 ms timer, so this only shows a win
+    // once the frame no longer fits in that budget
+    float frameMs = m_frameTimer.restart();
+    OcclusionCuller &occlusion = m_terrain.occlusionCuller();
+    float &average = occlusion.isEnabled() ? m_frameMsCulled : m_frameMsUnculled;
+    average = average == 0.f ? frameMs : glm::mix(average, frameMs, 0.05f);
+
+    if (++m_framesSinceReport < 300) {
+        return;
+    }
+    m_framesSinceReport = 0;
+    qDebug() << "Occlusion culling" << (occlusion.isEnabled() ? "on:" : "off:")
+             << occlusion.culledCount() << "of" << occlusion.testedCount() << "chunks culled ("
+             << occlusion.culledFraction() * 100.f << "% )."
+             << "Frame ms with culling" << m_frameMsCulled << "without" << m_frameMsUnculled
+             << "." << m_terrain.potentiallyVisibleCount() << "chunks potentially visible.";
+    qDebug() << "Pipeline ms: simulate" << m_simMs << "stream terrain" << m_streamMs << "render" << m_renderMs
+             << "." << m_staleTicks << "frames reused the previous snapshot.";
+    qDebug() << m_terrain.regions().loadedCount() << "chunks loaded from disk at"
+             << m_terrain.regions().averageLoadMs() << "ms each; generating one takes"
+             << Terrain::averageGenerateMs() << "ms.";
+    StreamingStats streaming = m_terrain.streamingStats();
+    int needed = streaming.hits + streaming.misses;
+    qDebug() << "Streaming:" << streaming.misses << "of" << needed << "zones missed read-ahead ("
+             << (needed > 0 ? 100.f * streaming.misses / needed : 0.f) << "% ),"
+             << streaming.stallMs << "ms stalled on unfinished zones,"
+             << streaming.prefetchesInFlight << "zones in flight.";
+    const FluidSimulator &fluids = m_terrain.fluids();
+    qDebug() << "Fluids:" << fluids.activeCount() << "blocks active; the last tick updated"
+             << fluids.lastTickCells() << "in" << fluids.lastTickMs() << "ms.";
+    const FrameSnapshot &frame = m_simulation.snapshot();
+    qDebug() << "Entities:" << frame.entityCount << "simulated in" << frame.entityMs << "ms a tick,"
+             << frame.entityInstances.size() / 2 << "drawn;" << frame.itemsCollected << "items picked up.";
+    m_staleTicks = 0;
 }
 
 void MyGL::preformPlayerPerspectivePass()
@@ -281,28 +301,42 @@ void MyGL::preformPlayerPerspectivePass()
     m_framebuffer.bindFrameBuffer();
     prepareViewportForFBO();
     // Draw sky
-    quad.bufferVBOdata();
     m_progSky.drawQuad(quad);
     // Pass textures to GPU
     m_progLambert.setTextureSampler2D(0);
-    m_progLambert.setTextureSampler2DShadow(2);
     // Make each texture their active in their textSlot
     m_texture.bind(0);
-    m_depthFrameBuffer.bindToTextureSlot(2);
-    // Render with lambert
-    renderTerrain(&m_progLambert);
+    // Render with lambert, then test every Chunk's bounds against the
+    // finished depth buffer to decide what next frame can skip
+    renderTerrain(&m_progLambert, true);
+    const FrameSnapshot &frame = m_simulation.snapshot();
+    m_terrain.issueOcclusionQueries(frame.eye);
+    // Entities are left out of the depth the queries test against, since
+    // they move every tick and hide next to nothing
+    m_entityCubes.setInstances(frame.entityInstances);
+    m_progEntity.drawInstanced(m_entityCubes, ENTITY_INSTANCE_SLOT);
     glBindFramebuffer(GL_FRAMEBUFFER, this->defaultFramebufferObject());
 }
 
-void MyGL::renderTerrain(ShaderProgram *prog) {
-    int renderRadius = 1;
-    glm::vec2 pPos(m_player.mcr_position.x, m_player.mcr_position.z);
+glm::ivec4 MyGL::terrainRenderBounds() {
+    // Far zones are cheap to draw now that they use LOD meshes,
+    // so draw everything that has been generated
+    int renderRadius = TERRAIN_RADIUS;
+    glm::vec3 playerPos = m_simulation.snapshot().playerPos;
+    glm::vec2 pPos(playerPos.x, playerPos.z);
     glm::ivec2 centerTerrain = m_terrain.getTerrainAt(pPos[0], pPos[1]);
-    int xmin = centerTerrain[0] - BLOCK_LENGTH_IN_TERRAIN * renderRadius;// - BLOCK_LENGTH_IN_TERRAIN;
-    int xmax = centerTerrain[0] + BLOCK_LENGTH_IN_TERRAIN * renderRadius;// + BLOCK_LENGTH_IN_TERRAIN;
-    int zmin = centerTerrain[1] - BLOCK_LENGTH_IN_TERRAIN * renderRadius;// - BLOCK_LENGTH_IN_TERRAIN;
-    int zmax = centerTerrain[1] + BLOCK_LENGTH_IN_TERRAIN * renderRadius;// + BLOCK_LENGTH_IN_TERRAIN;
-    m_terrain.draw(xmin, xmax, zmin, zmax, prog);
+    // Bounds are Chunk origins, so the outermost zones need their last
+    // Chunks included too for the far terrain to meet them without a gap
+    int xmin = centerTerrain[0] - BLOCK_LENGTH_IN_TERRAIN * renderRadius;
+    int xmax = centerTerrain[0] + BLOCK_LENGTH_IN_TERRAIN * (renderRadius + 1) - BLOCK_LENGTH_IN_CHUNK;
+    int zmin = centerTerrain[1] - BLOCK_LENGTH_IN_TERRAIN * renderRadius;
+    int zmax = centerTerrain[1] + BLOCK_LENGTH_IN_TERRAIN * (renderRadius + 1) - BLOCK_LENGTH_IN_CHUNK;
+    return glm::ivec4(xmin, xmax, zmin, zmax);
+}
+
+void MyGL::renderTerrain(ShaderProgram *prog, bool occlusionCull) {
+    glm::ivec4 b = terrainRenderBounds();
+    m_terrain.draw(b[0], b[1], b[2], b[3], m_simulation.snapshot().eye, prog, occlusionCull);
 }
 
 void MyGL::performTerrainPostprocessRenderPass()
@@ -310,12 +344,6 @@ void MyGL::performTerrainPostprocessRenderPass()
     glBindFramebuffer(GL_FRAMEBUFFER, this->defaultFramebufferObject());
     prepareViewportForFBO();
 
-    quad.bufferVBOdata();
-
-    // Render depth map
-//    m_depthFrameBuffer.bindToTextureSlot(2);
-//    m_progShandow.draw(quad, 2);
-
      m_framebuffer.bindToTextureSlot(1);
      if (playerIsInLiquid() == 1) {
         m_progTint.draw(quad, 1);
@@ -339,8 +367,9 @@ void MyGL::prepareViewportForFBO()
 }
 
 int MyGL::playerIsInLiquid() {
-    if (m_terrain.hasChunkAt(m_player.mcr_camera.mcr_position.x, m_player.mcr_camera.mcr_position.z)) {
-        BlockType b = m_terrain.getBlockAt(m_player.mcr_camera.mcr_position.x, m_player.mcr_camera.mcr_position.y, m_player.mcr_camera.mcr_position.z);
+    glm::vec3 eye = m_simulation.snapshot().eye;
+    if (m_terrain.hasChunkAt(eye.x, eye.z)) {
+        BlockType b = m_terrain.getBlockAt(eye.x, eye.y, eye.z);
         if (b == WATER) {
             return 1;
         } else if (b == LAVA) {
@@ -368,14 +397,21 @@ void MyGL::keyPressEvent(QKeyEvent *e) {
     } else if (e->key() == Qt::Key_A) {
         m_inputs.aPressed = true;
     } else if (e->key() == Qt::Key_F) {
-       m_player.m_flightOn = !m_player.m_flightOn;
+        m_simulation.toggleFlight();
     } else if (e->key() == Qt::Key_Q) {
         m_inputs.qPressed = true;
     } else if (e->key() == Qt::Key_E) {
         m_inputs.ePressed = true;
     } else if (e->key() == Qt::Key_Space) {
-        m_player.m_spacePressed = true;
+        m_simulation.setSpacePressed(true);
+    } else if (e->key() == Qt::Key_O) {
+        OcclusionCuller &occlusion = m_terrain.occlusionCuller();
+        occlusion.setEnabled(!occlusion.isEnabled());
+    } else if (e->key() == Qt::Key_M) {
+        // Loads the EntityWorld up for profiling
+        m_simulation.spawnMobs(m_simulation.snapshot().playerPos, 1000);
     }
+    m_simulation.setInputs(m_inputs);
 }
 
 void MyGL::keyReleaseEvent(QKeyEvent *e) {
@@ -392,14 +428,16 @@ void MyGL::keyReleaseEvent(QKeyEvent *e) {
     } else if (e->key() == Qt::Key_E) {
         m_inputs.ePressed = false;
     } else if (e->key() == Qt::Key_Space) {
-        m_player.m_spacePressed = false;
+        m_simulation.setSpacePressed(false);
     }
+    m_simulation.setInputs(m_inputs);
 }
 
 void MyGL::mouseMoveEvent(QMouseEvent *e) {
     // Moves camera
-    m_inputs.mouseX = (m_inputs.prevMouseX - e->x()) / 2.f;
-    m_inputs.mouseY = (m_inputs.prevMouseY - e->y()) / 2.f;
+    // Added up until the simulation's next tick consumes them
+    m_simulation.addMouseMovement((m_inputs.prevMouseX - e->x()) / 2.f,
+                                  (m_inputs.prevMouseY - e->y()) / 2.f);
     moveMouseToCenter();
 }
 
@@ -407,22 +445,28 @@ void MyGL::mousePressEvent(QMouseEvent *e) {
     // Place or remove blocks
     glm::ivec3 hitBlock;
     float outLen = 0.f;
-    const glm::vec3 mid = m_player.mcr_camera.mcr_position;
-    glm::vec3 ray = glm::normalize(m_player.mcr_camera.getLookVec());
+    // Aim from where the Player was last drawn, which is what the user saw
+    const FrameSnapshot &frame = m_simulation.snapshot();
+    const glm::vec3 mid = frame.eye;
+    glm::vec3 ray = glm::normalize(frame.look);
     if (e->button() == Qt::LeftButton) {
         // Remove block
-        if (m_player.gridMarch(mid, ray * 3.f, m_terrain, &outLen, &hitBlock)) {
+        if (Player::gridMarch(mid, ray * 3.f, m_terrain, &outLen, &hitBlock)) {
+            BlockType broken = m_terrain.getBlockAt(hitBlock.x, hitBlock.y, hitBlock.z);
             m_terrain.setBlockAt(hitBlock.x, hitBlock.y, hitBlock.z, EMPTY);
+            if (broken != WATER && broken != LAVA) {
+                m_simulation.dropItem(glm::vec3(hitBlock) + 0.5f, broken);
+            }
         }
     } else if (e->button() == Qt::RightButton) {
-        if (m_player.gridMarch(mid, ray * 3.f, m_terrain, &outLen, &hitBlock)) {
+        if (Player::gridMarch(mid, ray * 3.f, m_terrain, &outLen, &hitBlock)) {
             // Determine where to place block based on ray direction
             // Find the middle of the block
             glm::vec3 blockMid = {hitBlock.x + .5f,
                                   hitBlock.y + .5f,
                                   hitBlock.z + .5f};
             // Find where the ray collides with the block
-            glm::vec3 rayHit = m_player.mcr_camera.mcr_position + ray * outLen;
+            glm::vec3 rayHit = mid + ray * outLen;
             // Find the difference between the two points and set the block
             // adjacent to the face that has the largest distance from the center
             glm::vec3 diff = rayHit - blockMid;
@@ -11,10 +11,12 @@
 #include "framebuffer.h"
 #include "postprocessingshader.h"
 #include "scene/quad.h"
-#include "depthframebuffer.h"
+#include "frameuniforms.h"
+#include "simulation.h"
 
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
+#include <QElapsedTimer>
 #include <smartpointerhelp.h>
 
 class MyGL : public OpenGLContext
@@ -30,29 +32,40 @@ private:
                 // Don't worry too much about this. Just know it is necessary in order to render geometry.
 
     Terrain m_terrain; // All of the Chunks that currently comprise the world.
-    Player m_player; // The entity controlled by the user. Contains a camera to display what it sees as well.
+    Simulation m_simulation; // Moves the Player on its own thread; we draw from its newest FrameSnapshot
     InputBundle m_inputs; // A collection of variables to be updated in keyPressEvent, mouseMoveEvent, mousePressEvent, etc.
+                          // Handed to m_simulation whenever a key changes.
 
     QTimer m_timer; // Timer linked to tick(). Fires approximately 60 times per second.
 
-    double m_currTime; // Current time used to compute dT for player movement
-    int m_timeSinceStart; // Time passed to UVs to warp LAVA and WATER UV coords
-
     FrameBuffer m_framebuffer; // Frame buffer for post processing
 
     PostProcessingShader m_progTint; // A post processing shader program that handels water and lava tinting
     PostProcessingShader m_progNoOp; // A post processing shader program that does nothing
 
-    DepthThroughShader m_progDepthThrough; // A post shader program to see depth values
-
-    PostProcessingShader m_progShandow; // A post processing shader program that does nothing
-
     ShaderProgram m_progSky; // A screen-space shader for creating the sky background
+    ShaderProgram m_progEntity; // Draws every mob and dropped item in one instanced call
+    InstancedCubes m_entityCubes; // The cube each entity is drawn as, and their per-instance data
     float time;
 
     Quad quad;
 
-    DepthFrameBuffer m_depthFrameBuffer;
+    FrameUniforms m_frameUniforms; // Camera, time and screen size, shared by every program
+
+    // Times whole frames so the effect of occlusion culling can be reported.
+    // Each average only updates while culling is in the matching state.
+    QElapsedTimer m_frameTimer;
+    float m_frameMsCulled;
+    float m_frameMsUnculled;
+    int m_framesSinceReport;
+    // Average time spent in each stage of the pipeline: simulating a tick on
+    // the simulation thread, then streaming terrain and drawing on ours
+    float m_simMs;
+    float m_streamMs;
+    float m_renderMs;
+    int m_staleTicks; // tick()s since the last report that found no new snapshot
+
+    void reportFrameStats();
 
     void moveMouseToCenter(); // Forces the mouse position to the screen's center. You should call this
                               // from within a mouse move event after reading the mouse movement so that
@@ -62,8 +75,6 @@ private:
 
     void performTerrainPostprocessRenderPass();
 
-    void preformLightPerspectivePass();
-
     void preformPlayerPerspectivePass();
 
     void prepareViewportForFBO();
@@ -85,9 +96,12 @@ public:
     // In the base code, update() is called from tick().
     void paintGL();
 
+    // Chunk origins bounding the area renderTerrain() draws,
+    // as (min X, max X, min Z, max Z)
+    glm::ivec4 terrainRenderBounds();
     // Called from paintGL().
     // Calls Terrain::draw().
-    void renderTerrain(ShaderProgram *prog);
+    void renderTerrain(ShaderProgram *prog, bool occlusionCull = false);
 
 protected:
     // Automatically invoked when the user
@@ -7,8 +7,15 @@
 #include <QDebug>
 
 
+// Marks a cached binding as unknown; no GL object ever gets this name
+const static GLuint STATE_UNKNOWN = ~0u;
+// Vertex attribute indices the enabled state is cached for
+const static GLuint CACHED_ATTRIBS = 32;
+
 OpenGLContext::OpenGLContext(QWidget *parent)
-    : QOpenGLWidget(parent)
+    : QOpenGLWidget(parent),
+      m_boundProgram(STATE_UNKNOWN), m_boundArrayBuffer(STATE_UNKNOWN), m_boundElementBuffer(STATE_UNKNOWN),
+      m_enabledAttribs(0), m_knownAttribs(0)
 {}
 
 OpenGLContext::~OpenGLContext()
@@ -69,6 +76,7 @@ void OpenGLContext::debugContextVersion()
     }
 }
 
+#ifndef NO_GL_ERROR_CHECKS
 void OpenGLContext::printGLErrorLog()
 {
     GLenum error = glGetError();
@@ -90,6 +98,7 @@ void OpenGLContext::printGLErrorLog()
 #endif
     }
 }
+#endif
 
 void OpenGLContext::printLinkInfoLog(int prog)
 {
@@ -142,3 +151,114 @@ void OpenGLContext::printShaderInfoLog(int shader)
     // Throwing here allows us to use the debugger to track down the error.
     throw;
 }
+
+void OpenGLContext::glUseProgram(GLuint program)
+{
+    if (program != m_boundProgram) {
+        QOpenGLFunctions_3_2_Core::glUseProgram(program);
+        m_boundProgram = program;
+    }
+}
+
+void OpenGLContext::glDeleteProgram(GLuint program)
+{
+    // GL only unbinds it once it stops being current, but the name may be
+    // handed out again before then
+    if (program == m_boundProgram) {
+        m_boundProgram = STATE_UNKNOWN;
+    }
+    QOpenGLFunctions_3_2_Core::glDeleteProgram(program);
+}
+
+void OpenGLContext::glBindBuffer(GLenum target, GLuint buffer)
+{
+    // Only the two targets drawing binds over and over are worth caching
+    GLuint *bound = target == GL_ARRAY_BUFFER ? &m_boundArrayBuffer :
+                    target == GL_ELEMENT_ARRAY_BUFFER ? &m_boundElementBuffer :
+                    nullptr;
+    if (bound == nullptr) {
+        QOpenGLFunctions_3_2_Core::glBindBuffer(target, buffer);
+    } else if (*bound != buffer) {
+        QOpenGLFunctions_3_2_Core::glBindBuffer(target, buffer);
+        *bound = buffer;
+    }
+}
+
+void OpenGLContext::glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+    // Deleting a bound buffer unbinds it, and its name can be reused
+    for (GLsizei i = 0; i < n; ++i) {
+        if (buffers[i] == m_boundArrayBuffer) {
+            m_boundArrayBuffer = 0;
+        }
+        if (buffers[i] == m_boundElementBuffer) {
+            m_boundElementBuffer = 0;
+        }
+    }
+    QOpenGLFunctions_3_2_Core::glDeleteBuffers(n, buffers);
+}
+
+void OpenGLContext::glBindVertexArray(GLuint array)
+{
+    QOpenGLFunctions_3_2_Core::glBindVertexArray(array);
+    // The index buffer and enabled attributes belong to the vertex array
+    m_boundElementBuffer = STATE_UNKNOWN;
+    m_knownAttribs = 0;
+}
+
+void OpenGLContext::glEnableVertexAttribArray(GLuint index)
+{
+    if (index >= CACHED_ATTRIBS) {
+        QOpenGLFunctions_3_2_Core::glEnableVertexAttribArray(index);
+        return;
+    }
+    unsigned int bit = 1u << index;
+    if (!(m_knownAttribs & bit) || !(m_enabledAttribs & bit)) {
+        QOpenGLFunctions_3_2_Core::glEnableVertexAttribArray(index);
+        m_enabledAttribs |= bit;
+        m_knownAttribs |= bit;
+    }
+}
+
+void OpenGLContext::glDisableVertexAttribArray(GLuint index)
+{
+    if (index >= CACHED_ATTRIBS) {
+        QOpenGLFunctions_3_2_Core::glDisableVertexAttribArray(index);
+        return;
+    }
+    unsigned int bit = 1u << index;
+    if (!(m_knownAttribs & bit) || (m_enabledAttribs & bit)) {
+        QOpenGLFunctions_3_2_Core::glDisableVertexAttribArray(index);
+        m_enabledAttribs &= ~bit;
+        m_knownAttribs |= bit;
+    }
+}
+
+void OpenGLContext::enableVertexAttribs(std::initializer_list<int> attrs)
+{
+    unsigned int wanted = 0;
+    for (int attr : attrs) {
+        if (attr >= 0 && static_cast<GLuint>(attr) < CACHED_ATTRIBS) {
+            wanted |= 1u << attr;
+        }
+    }
+    // Only attributes known to be enabled are turned off; indices past
+    // the driver's attribute count must never be passed to GL
+    unsigned int stale = m_enabledAttribs & m_knownAttribs & ~wanted;
+    for (GLuint i = 0; i < CACHED_ATTRIBS; ++i) {
+        unsigned int bit = 1u << i;
+        if (wanted & bit) {
+            glEnableVertexAttribArray(i);
+        } else if (stale & bit) {
+            glDisableVertexAttribArray(i);
+        }
+    }
+}
+
+void OpenGLContext::invalidateStateCache()
+{
+    m_boundProgram = STATE_UNKNOWN;
+    m_boundArrayBuffer = STATE_UNKNOWN;
+    m_boundElementBuffer = STATE_UNKNOWN;
+    m_knownAttribs = 0;
+}
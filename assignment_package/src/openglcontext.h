@@ -3,18 +3,54 @@
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions_3_2_Core>
 #include <QTimer>
+#include <initializer_list>
 
 
 class OpenGLContext
     : public QOpenGLWidget,
       public QOpenGLFunctions_3_2_Core
 {
+private:
+    // GL state as last set through this context, so that setting the same
+    // state again never reaches the driver. Values that are not known, e.g.
+    // after Qt has used the context, are marked with STATE_UNKNOWN.
+    GLuint m_boundProgram;
+    GLuint m_boundArrayBuffer;
+    GLuint m_boundElementBuffer;
+    unsigned int m_enabledAttribs; // One bit per vertex attribute index
+    unsigned int m_knownAttribs;   // Attributes whose bit above is up to date
+
 public:
     OpenGLContext(QWidget *parent);
     ~OpenGLContext();
 
     void debugContextVersion();
+#ifdef NO_GL_ERROR_CHECKS
+    // glGetError makes the driver finish its queued work, so release
+    // builds do not poll it at all
+    void printGLErrorLog() {}
+#else
     void printGLErrorLog();
+#endif
     void printLinkInfoLog(int prog);
     void printShaderInfoLog(int shader);
+
+    // These hide the QOpenGLFunctions_3_2_Core functions of the same name,
+    // so every call made through an OpenGLContext goes through the state
+    // cache and redundant binds are skipped
+    void glUseProgram(GLuint program);
+    void glDeleteProgram(GLuint program);
+    void glBindBuffer(GLenum target, GLuint buffer);
+    void glDeleteBuffers(GLsizei n, const GLuint *buffers);
+    void glBindVertexArray(GLuint array);
+    void glEnableVertexAttribArray(GLuint index);
+    void glDisableVertexAttribArray(GLuint index);
+
+    // Enables exactly the given vertex attributes and disables every other
+    // one, touching only those whose state changes. Handles of -1, meaning
+    // the program does not use that input, are skipped.
+    void enableVertexAttribs(std::initializer_list<int> attrs);
+    // Forgets all cached state. Call whenever code outside this class, such
+    // as Qt itself, may have used the context since we last did.
+    void invalidateStateCache();
 };
@@ -1,4 +1,5 @@
 #include "postprocessingshader.h"
+#include "programbinarycache.h"
 #include <QFile>
 #include <QStringBuilder>
 #include <QTextStream>
@@ -18,47 +19,53 @@ PostProcessingShader::~PostProcessingShader()
 
 void PostProcessingShader::create(const char *vertfile, const char *fragfile)
 {
-    // Allocate space on our GPU for a vertex shader and a fragment shader and a shader program to manage the two
-    vertShader = context->glCreateShader(GL_VERTEX_SHADER);
-    fragShader = context->glCreateShader(GL_FRAGMENT_SHADER);
     prog = context->glCreateProgram();
     // Get the body of text stored in our two .glsl files
-    QString qVertSource = qTextFileRead(vertfile);
-    QString qFragSource = qTextFileRead(fragfile);
-
-    char* vertSource = new char[qVertSource.size()+1];
-    strcpy(vertSource, qVertSource.toStdString().c_str());
-    char* fragSource = new char[qFragSource.size()+1];
-    strcpy(fragSource, qFragSource.toStdString().c_str());
-
-
-    // Send the shader text to OpenGL and store it in the shaders specified by the handles vertShader and fragShader
-    context->glShaderSource(vertShader, 1, &vertSource, 0);
-    context->glShaderSource(fragShader, 1, &fragSource, 0);
-    // Tell OpenGL to compile the shader text stored above
-    context->glCompileShader(vertShader);
-    context->glCompileShader(fragShader);
-    // Check if everything compiled OK
-    GLint compiled;
-    context->glGetShaderiv(vertShader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        printShaderInfoLog(vertShader);
-    }
-    context->glGetShaderiv(fragShader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        printShaderInfoLog(fragShader);
-    }
-
-    // Tell prog that it manages these particular vertex and fragment shaders
-    context->glAttachShader(prog, vertShader);
-    context->glAttachShader(prog, fragShader);
-    context->glLinkProgram(prog);
-
-    // Check for linking success
-    GLint linked;
-    context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
-    if (!linked) {
-        printLinkInfoLog(prog);
+    QByteArray vertSource = qTextFileRead(vertfile).toUtf8();
+    QByteArray fragSource = qTextFileRead(fragfile).toUtf8();
+
+    // Skip compiling altogether if an earlier launch left a binary of this program
+    if (ProgramBinaryCache::load(context, prog, vertSource, fragSource)) {
+        vertShader = 0;
+        fragShader = 0;
+    } else {
+        // Allocate space on our GPU for a vertex shader and a fragment shader
+        vertShader = context->glCreateShader(GL_VERTEX_SHADER);
+        fragShader = context->glCreateShader(GL_FRAGMENT_SHADER);
+        const char *vertText = vertSource.constData();
+        const char *fragText = fragSource.constData();
+
+        // Send the shader text to OpenGL and store it in the shaders specified by the handles vertShader and fragShader
+        context->glShaderSource(vertShader, 1, &vertText, 0);
+        context->glShaderSource(fragShader, 1, &fragText, 0);
+        // Tell OpenGL to compile the shader text stored above
+        context->glCompileShader(vertShader);
+        context->glCompileShader(fragShader);
+        // Check if everything compiled OK
+        GLint compiled;
+        context->glGetShaderiv(vertShader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            printShaderInfoLog(vertShader);
+        }
+        context->glGetShaderiv(fragShader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            printShaderInfoLog(fragShader);
+        }
+
+        // Tell prog that it manages these particular vertex and fragment shaders
+        context->glAttachShader(prog, vertShader);
+        context->glAttachShader(prog, fragShader);
+        ProgramBinaryCache::prepare(context, prog);
+        context->glLinkProgram(prog);
+
+        // Check for linking success
+        GLint linked;
+        context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            printLinkInfoLog(prog);
+        } else {
+            ProgramBinaryCache::store(context, prog, vertSource, fragSource);
+        }
     }
 
     attrPos = context->glGetAttribLocation(prog, "vs_Pos");
@@ -71,35 +78,14 @@ void PostProcessingShader::create(const char *vertfile, const char *fragfile)
 //    unifDepthMatrixID = context->glGetUniformLocation(prog, "u_depthMVP");
 }
 
-void PostProcessingShader::draw(Drawable &d, int textureSlot)
+void PostProcessingShader::draw(Quad &q, int textureSlot)
 {
     useMe();
 
-    if(d.elemCountOpaque() < 0) {
-        throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCountOpaque()) + "!");
-    }
-
     // Set our "u_sampler1" sampler to user Texture Unit
     context->glUniform1i(unifSampler2D, textureSlot);
 
-    // bind
-    if (d.bindAllOpaque()) {
-        int stride = 2 * 4 * sizeof(float);
-        // Pos
-        context->glEnableVertexAttribArray(attrPos);
-        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
-        // UV
-        context->glEnableVertexAttribArray(attrUV);
-        context->glVertexAttribPointer(attrUV, 4, GL_FLOAT, false, stride, (void*)(4 * sizeof(float)));
-    }
-
-    // Bind the index buffer and then draw shapes from it.
-    // This invokes the shader program, which accesses the vertex buffers.
-    d.bindIdx();
-    context->glDrawElements(d.drawMode(), d.elemCountOpaque(), GL_UNSIGNED_INT, 0);
-
-    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
-    if (attrUV != -1) context->glDisableVertexAttribArray(attrUV);
+    q.draw();
 
 //    std::cout << "PostProcessing Shader " << std::endl;
     context->printGLErrorLog();
@@ -13,6 +13,7 @@
 
 #include "drawable.h"
 #include "texture.h"
+#include "scene/quad.h"
 
 class PostProcessingShader
 {
@@ -36,7 +37,7 @@ public:
     ~PostProcessingShader();
     void create(const char *vertfile, const char *fragfile);
     void useMe();
-    void draw(Drawable &d, int textureSlot);
+    void draw(Quad &q, int textureSlot);
 
     char* textFileRead(const char*);
     QString qTextFileRead(const char *fileName);
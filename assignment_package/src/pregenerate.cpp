@@ -0,0 +1,126 @@
+#include "pregenerate.h"
+#include "scene/terrain.h"
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+bool wantsPregeneration(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--pregenerate") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Every zone within radius zones of the spawn zone, in rings going outward,
+// so an interrupted run has still covered the area nearest spawn
+static std::vector<glm::ivec2> spiralZones(int radius)
+{
+    glm::ivec2 center(static_cast<int>(glm::floor(PLAYER_SPAWN.x / BLOCK_LENGTH_IN_TERRAIN)) * BLOCK_LENGTH_IN_TERRAIN,
+                      static_cast<int>(glm::floor(PLAYER_SPAWN.z / BLOCK_LENGTH_IN_TERRAIN)) * BLOCK_LENGTH_IN_TERRAIN);
+    std::vector<glm::ivec2> zones;
+    zones.push_back(center);
+    for (int ring = 1; ring <= radius; ++ring) {
+        for (int dz = -ring; dz <= ring; ++dz) {
+            for (int dx = -ring; dx <= ring; ++dx) {
+                if (std::abs(dx) == ring || std::abs(dz) == ring) {
+                    zones.push_back(center + BLOCK_LENGTH_IN_TERRAIN * glm::ivec2(dx, dz));
+                }
+            }
+        }
+    }
+    return zones;
+}
+
+// Every zone touching the given rectangle of block coordinates
+static std::vector<glm::ivec2> rectangleZones(int minX, int minZ, int maxX, int maxZ)
+{
+    std::vector<glm::ivec2> zones;
+    int x0 = static_cast<int>(glm::floor(std::min(minX, maxX) / static_cast<float>(BLOCK_LENGTH_IN_TERRAIN)));
+    int x1 = static_cast<int>(glm::floor(std::max(minX, maxX) / static_cast<float>(BLOCK_LENGTH_IN_TERRAIN)));
+    int z0 = static_cast<int>(glm::floor(std::min(minZ, maxZ) / static_cast<float>(BLOCK_LENGTH_IN_TERRAIN)));
+    int z1 = static_cast<int>(glm::floor(std::max(minZ, maxZ) / static_cast<float>(BLOCK_LENGTH_IN_TERRAIN)));
+    for (int z = z0; z <= z1; ++z) {
+        for (int x = x0; x <= x1; ++x) {
+            zones.push_back(BLOCK_LENGTH_IN_TERRAIN * glm::ivec2(x, z));
+        }
+    }
+    return zones;
+}
+
+int pregenerateWorld(QCoreApplication &app)
+{
+    int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates the world around spawn ahead of time and saves it, "
+                                     "so the game loads it from disk instead of generating it.");
+    parser.addHelpOption();
+    QCommandLineOption pregenerateOption("pregenerate", "Generate the world, save it and exit.");
+    QCommandLineOption radiusOption("radius", "Generate this many terrain zones out from spawn in every direction.",
+                                    "zones", "4");
+    QCommandLineOption areaOption("area", "Generate every zone touching this rectangle of block coordinates instead.",
+                                  "minX,minZ,maxX,maxZ");
+    QCommandLineOption threadsOption("threads", "Worker threads to generate with.", "count", QString::number(cores));
+    parser.addOption(pregenerateOption);
+    parser.addOption(radiusOption);
+    parser.addOption(areaOption);
+    parser.addOption(threadsOption);
+    parser.process(app);
+
+    std::vector<glm::ivec2> zones;
+    if (parser.isSet(areaOption)) {
+        QStringList bounds = parser.value(areaOption).split(",");
+        bool ok = bounds.size() == 4;
+        int coords[4] = {0, 0, 0, 0};
+        for (int i = 0; ok && i < 4; ++i) {
+            coords[i] = bounds[i].toInt(&ok);
+        }
+        if (!ok) {
+            std::fprintf(stderr, "--area takes four integers: minX,minZ,maxX,maxZ\n");
+            return 1;
+        }
+        zones = rectangleZones(coords[0], coords[1], coords[2], coords[3]);
+    } else {
+        bool ok = false;
+        int radius = parser.value(radiusOption).toInt(&ok);
+        if (!ok || radius < 0) {
+            std::fprintf(stderr, "--radius takes a number of zones\n");
+            return 1;
+        }
+        zones = spiralZones(radius);
+    }
+    bool ok = false;
+    int threads = parser.value(threadsOption).toInt(&ok);
+    if (!ok || threads < 1) {
+        threads = cores;
+    }
+
+    std::printf("Pregenerating up to %d terrain zones on %d threads\n", static_cast<int>(zones.size()), threads);
+    // Nothing is drawn, so the Terrain needs no OpenGL context
+    Terrain terrain(nullptr);
+    QElapsedTimer timer;
+    timer.start();
+    int generated = 0;
+    terrain.pregenerateZones(zones, threads, [&timer, &generated](int done, int total) {
+        generated = total;
+        float seconds = std::max(timer.elapsed(), 1ll) / 1000.f;
+        float zonesPerSecond = done / seconds;
+        float eta = (total - done) / zonesPerSecond;
+        int chunksPerZone = CHUNK_LENGTH_IN_TERRAIN * CHUNK_LENGTH_IN_TERRAIN;
+        std::printf("\r%d / %d zones, %.1f chunks/s, ETA %.0f s   ", done, total,
+                    zonesPerSecond * chunksPerZone, eta);
+        std::fflush(stdout);
+    });
+    // Includes waiting for the last saves to reach disk
+    float seconds = timer.elapsed() / 1000.f;
+    std::printf("\nGenerated and saved %d zones in %.1f s (%.2f ms per chunk of block data)\n",
+                generated, seconds, Terrain::averageGenerateMs());
+    return 0;
+}
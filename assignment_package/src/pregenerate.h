@@ -0,0 +1,13 @@
+#pragma once
+#include <QCoreApplication>
+
+// Command line tool that generates the world around spawn ahead of time and
+// saves it to the region files, so the game loads it instead of generating
+// it. Run as: miniMinecraft --pregenerate [--radius zones | --area minX,minZ,maxX,maxZ] [--threads n]
+
+// Is --pregenerate on the command line? Checked before any application
+// object exists, so a headless run never needs a display.
+bool wantsPregeneration(int argc, char *argv[]);
+
+// Runs the tool and returns the process exit code
+int pregenerateWorld(QCoreApplication &app);
@@ -0,0 +1,162 @@
+#include "programbinarycache.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QOpenGLContext>
+#include <QDebug>
+#include <cstring>
+#include <vector>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// Every cache file starts with this, followed by the binary format
+// and then the binary itself
+const static char CACHE_MAGIC[4] = {'M', 'M', 'P', 'B'};
+
+bool ProgramBinaryCache::s_initialized = false;
+bool ProgramBinaryCache::s_supported = false;
+ProgramBinaryCache::ProgramBinaryFn ProgramBinaryCache::s_programBinary = nullptr;
+ProgramBinaryCache::GetProgramBinaryFn ProgramBinaryCache::s_getProgramBinary = nullptr;
+ProgramBinaryCache::ProgramParameteriFn ProgramBinaryCache::s_programParameteri = nullptr;
+QByteArray ProgramBinaryCache::s_driver;
+QString ProgramBinaryCache::s_directory;
+int ProgramBinaryCache::s_hits = 0;
+int ProgramBinaryCache::s_misses = 0;
+
+void ProgramBinaryCache::initialize(OpenGLContext *context)
+{
+    if (s_initialized) {
+        return;
+    }
+    s_initialized = true;
+
+    QOpenGLContext *ctx = context->context();
+    s_programBinary = reinterpret_cast<ProgramBinaryFn>(ctx->getProcAddress("glProgramBinary"));
+    s_getProgramBinary = reinterpret_cast<GetProgramBinaryFn>(ctx->getProcAddress("glGetProgramBinary"));
+    s_programParameteri = reinterpret_cast<ProgramParameteriFn>(ctx->getProcAddress("glProgramParameteri"));
+    if (!ctx->hasExtension("GL_ARB_get_program_binary") ||
+            !s_programBinary || !s_getProgramBinary || !s_programParameteri) {
+        return;
+    }
+    GLint formats = 0;
+    context->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        return;
+    }
+
+    s_driver.append(reinterpret_cast<const char*>(context->glGetString(GL_VENDOR)), -1);
+    s_driver.append(reinterpret_cast<const char*>(context->glGetString(GL_RENDERER)), -1);
+    s_driver.append(reinterpret_cast<const char*>(context->glGetString(GL_VERSION)), -1);
+
+    s_directory = QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("shaders");
+    s_supported = QDir().mkpath(s_directory);
+}
+
+QString ProgramBinaryCache::pathFor(const QByteArray &vertSource, const QByteArray &fragSource)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(s_driver);
+    hash.addData(vertSource);
+    hash.addData(fragSource);
+    return QDir(s_directory).filePath(QString(hash.result().toHex().constData()) + ".bin");
+}
+
+bool ProgramBinaryCache::load(OpenGLContext *context, GLuint prog, const QByteArray &vertSource, const QByteArray &fragSource)
+{
+    initialize(context);
+    if (!s_supported) {
+        return false;
+    }
+
+    QFile file(pathFor(vertSource, fragSource));
+    if (!file.open(QIODevice::ReadOnly)) {
+        ++s_misses;
+        return false;
+    }
+    QByteArray contents = file.readAll();
+    file.close();
+
+    size_t header = sizeof(CACHE_MAGIC) + sizeof(GLenum);
+    if (static_cast<size_t>(contents.size()) <= header ||
+            std::memcmp(contents.constData(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        QFile::remove(file.fileName());
+        ++s_misses;
+        return false;
+    }
+    GLenum format;
+    std::memcpy(&format, contents.constData() + sizeof(CACHE_MAGIC), sizeof(GLenum));
+    s_programBinary(prog, format, contents.constData() + header, static_cast<GLsizei>(contents.size() - header));
+
+    // Drivers may refuse binaries from other builds even when the version
+    // string matches; throw those away and compile instead
+    GLint linked = GL_FALSE;
+    context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        QFile::remove(file.fileName());
+        ++s_misses;
+        return false;
+    }
+    ++s_hits;
+    return true;
+}
+
+void ProgramBinaryCache::prepare(OpenGLContext *context, GLuint prog)
+{
+    initialize(context);
+    if (s_supported) {
+        s_programParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+void ProgramBinaryCache::store(OpenGLContext *context, GLuint prog, const QByteArray &vertSource, const QByteArray &fragSource)
+{
+    initialize(context);
+    if (!s_supported) {
+        return;
+    }
+
+    GLint length = 0;
+    context->glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    s_getProgramBinary(prog, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return;
+    }
+
+    // Written to a temporary file and renamed into place, so a crash
+    // mid-write never leaves a truncated binary behind
+    QSaveFile file(pathFor(vertSource, fragSource));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not write the shader binary cache in" << s_directory;
+        return;
+    }
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&format), sizeof(GLenum));
+    file.write(binary.data(), written);
+    file.commit();
+}
+
+int ProgramBinaryCache::hits()
+{
+    return s_hits;
+}
+
+int ProgramBinaryCache::misses()
+{
+    return s_misses;
+}
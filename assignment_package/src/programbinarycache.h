@@ -0,0 +1,51 @@
+#pragma once
+#include "openglcontext.h"
+#include <QByteArray>
+#include <QString>
+
+// Keeps linked shader programs on disk so later launches can hand the
+// driver its own binary instead of compiling GLSL again. Entries are keyed
+// by a hash of both shader sources and the GL vendor, renderer and version,
+// so editing a shader or updating the driver simply misses the cache.
+//
+// Program binaries are core only in GL 4.1, so the entry points are looked
+// up at runtime; without ARB_get_program_binary, or if the driver offers no
+// binary formats, every call here quietly does nothing and programs are
+// compiled as usual.
+class ProgramBinaryCache
+{
+private:
+    typedef void (QOPENGLF_APIENTRY *ProgramBinaryFn)(GLuint program, GLenum binaryFormat,
+                                                      const void *binary, GLsizei length);
+    typedef void (QOPENGLF_APIENTRY *GetProgramBinaryFn)(GLuint program, GLsizei bufSize, GLsizei *length,
+                                                         GLenum *binaryFormat, void *binary);
+    typedef void (QOPENGLF_APIENTRY *ProgramParameteriFn)(GLuint program, GLenum pname, GLint value);
+
+    static bool s_initialized;
+    static bool s_supported;
+    static ProgramBinaryFn s_programBinary;
+    static GetProgramBinaryFn s_getProgramBinary;
+    static ProgramParameteriFn s_programParameteri;
+    static QByteArray s_driver;     // Vendor, renderer and version strings
+    static QString s_directory;     // Where the binaries are kept
+
+    static int s_hits;
+    static int s_misses;
+
+    static void initialize(OpenGLContext *context);
+    static QString pathFor(const QByteArray &vertSource, const QByteArray &fragSource);
+
+public:
+    // Links prog from a cached binary of these sources. Returns false if there
+    // is none or the driver rejected it; the caller then compiles the sources
+    // into prog as usual.
+    static bool load(OpenGLContext *context, GLuint prog, const QByteArray &vertSource, const QByteArray &fragSource);
+    // Call before linking a freshly compiled prog so its binary can be read back
+    static void prepare(OpenGLContext *context, GLuint prog);
+    // Saves the binary of a successfully linked prog
+    static void store(OpenGLContext *context, GLuint prog, const QByteArray &vertSource, const QByteArray &fragSource);
+
+    // Programs loaded from and missing in the cache since startup
+    static int hits();
+    static int misses();
+};
@@ -0,0 +1,132 @@
+#include "rangeallocator.h"
+#include <algorithm>
+#include <iterator>
+
+RangeAllocator::RangeAllocator()
+    : m_free(), m_capacity(0), m_used(0)
+{}
+
+void RangeAllocator::reset(size_t capacity)
+{
+    m_free.clear();
+    m_capacity = capacity;
+    m_used = 0;
+    if (capacity > 0) {
+        m_free[0] = capacity;
+    }
+}
+
+void RangeAllocator::grow(size_t newCapacity)
+{
+    if (newCapacity <= m_capacity) {
+        return;
+    }
+    size_t oldCapacity = m_capacity;
+    m_capacity = newCapacity;
+    insertHole(oldCapacity, newCapacity - oldCapacity);
+}
+
+size_t RangeAllocator::takeFrom(std::map<size_t, size_t>::iterator hole, size_t size)
+{
+    size_t offset = hole->first;
+    size_t remaining = hole->second - size;
+    m_free.erase(hole);
+    if (remaining > 0) {
+        m_free[offset + size] = remaining;
+    }
+    m_used += size;
+    return offset;
+}
+
+size_t RangeAllocator::allocate(size_t size)
+{
+    return allocateBelow(size, m_capacity);
+}
+
+size_t RangeAllocator::allocateBelow(size_t size, size_t limit)
+{
+    if (size == 0) {
+        return INVALID;
+    }
+    auto best = m_free.end();
+    for (auto it = m_free.begin(); it != m_free.end() && it->first + size <= limit; ++it) {
+        if (it->second >= size && (best == m_free.end() || it->second < best->second)) {
+            best = it;
+            // An exact fit cannot be beaten
+            if (it->second == size) {
+                break;
+            }
+        }
+    }
+    if (best == m_free.end()) {
+        return INVALID;
+    }
+    return takeFrom(best, size);
+}
+
+void RangeAllocator::free(size_t offset, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    m_used -= size;
+    insertHole(offset, size);
+}
+
+void RangeAllocator::insertHole(size_t offset, size_t size)
+{
+    auto next = m_free.lower_bound(offset);
+    // Merge with the hole that ends where this range begins
+    if (next != m_free.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            m_free.erase(prev);
+        }
+    }
+    // Merge with the hole that begins where this range ends
+    if (next != m_free.end() && offset + size == next->first) {
+        size += next->second;
+        m_free.erase(next);
+    }
+    m_free[offset] = size;
+}
+
+size_t RangeAllocator::capacity() const
+{
+    return m_capacity;
+}
+
+size_t RangeAllocator::used() const
+{
+    return m_used;
+}
+
+size_t RangeAllocator::freeSpace() const
+{
+    return m_capacity - m_used;
+}
+
+size_t RangeAllocator::largestFreeBlock() const
+{
+    size_t largest = 0;
+    for (const auto &hole : m_free) {
+        largest = std::max(largest, hole.second);
+    }
+    return largest;
+}
+
+size_t RangeAllocator::freeBlockCount() const
+{
+    return m_free.size();
+}
+
+float RangeAllocator::fragmentation() const
+{
+    size_t freeSize = freeSpace();
+    if (freeSize == 0) {
+        return 0.f;
+    }
+    return 1.f - static_cast<float>(largestFreeBlock()) / freeSize;
+}
@@ -0,0 +1,53 @@
+#ifndef RANGEALLOCATOR_H
+#define RANGEALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+
+// Hands out [offset, offset + size) ranges from a linear address space
+// of a fixed capacity using a best-fit free list. Neighbouring free
+// ranges are merged as soon as they are returned, so the list only ever
+// holds the holes that actually exist.
+// The allocator only does the bookkeeping; it never touches the memory
+// (or GPU buffer) the offsets refer to. Units are whatever the caller
+// uses, e.g. vertices or indices.
+class RangeAllocator
+{
+private:
+    std::map<size_t, size_t> m_free; // Hole offset -> hole size, sorted by offset
+    size_t m_capacity;
+    size_t m_used;
+
+    size_t takeFrom(std::map<size_t, size_t>::iterator hole, size_t size);
+    // Add a free range to the list, merging it with adjacent holes
+    void insertHole(size_t offset, size_t size);
+
+public:
+    // Returned by allocate() when no hole is large enough
+    static const size_t INVALID = static_cast<size_t>(-1);
+
+    RangeAllocator();
+
+    // Forget every allocation and make [0, capacity) one free range
+    void reset(size_t capacity);
+    // Extend the address space to newCapacity, adding the new tail as free space
+    void grow(size_t newCapacity);
+
+    // Best-fit allocation of size units. Returns INVALID on failure.
+    size_t allocate(size_t size);
+    // Like allocate(), but only considers holes that end at or before limit.
+    // Used to move allocations toward the front when compacting.
+    size_t allocateBelow(size_t size, size_t limit);
+    void free(size_t offset, size_t size);
+
+    size_t capacity() const;
+    size_t used() const;
+    size_t freeSpace() const;
+    size_t largestFreeBlock() const;
+    size_t freeBlockCount() const;
+    // 0 when all free space is contiguous, approaching 1 as it splinters
+    // into many small holes
+    float fragmentation() const;
+};
+
+#endif // RANGEALLOCATOR_H
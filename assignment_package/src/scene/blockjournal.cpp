@@ -0,0 +1,217 @@
+#include "blockjournal.h"
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Longest an edit waits in memory before it is written and synced
+const static int JOURNAL_SYNC_MS = 100;
+// x, y, z as 32-bit ints, then the old and new block types
+const static int RECORD_SIZE = 3 * sizeof(qint32) + 2;
+
+static int64_t chunkKey(int x, int z)
+{
+    int chunkX = static_cast<int>(std::floor(x / 16.f)) * 16;
+    int chunkZ = static_cast<int>(std::floor(z / 16.f)) * 16;
+    return (static_cast<int64_t>(chunkX) << 32) | static_cast<uint32_t>(chunkZ);
+}
+
+BlockJournal::BlockJournal(const QString &directory)
+    : m_directory(directory), m_mutex(), m_wake(), m_batches(), m_segment(0),
+      m_discardThrough(-1), m_stopping(false), m_thread(), m_oldestSegment(0),
+      m_replay(), m_replayedCount(0), m_unsaved()
+{
+    // Segments are named journal.<n>.log; read them back oldest first
+    QStringList names = QDir(m_directory).entryList(QStringList() << "journal.*.log", QDir::Files);
+    std::vector<int> segments;
+    for (const QString &name : names) {
+        bool ok = false;
+        int segment = name.mid(8, name.length() - 12).toInt(&ok);
+        if (ok) {
+            segments.push_back(segment);
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    for (int segment : segments) {
+        readSegment(segmentPath(segment));
+    }
+    if (!segments.empty()) {
+        m_oldestSegment = segments.front();
+        m_segment = segments.back() + 1;
+        qDebug() << "Replaying" << m_replayedCount << "block edits from the journal.";
+    }
+    // The old segments go once their edits are safely in the new one
+    for (auto &entry : m_replay) {
+        for (const BlockEdit &edit : entry.second) {
+            appendLocked(edit);
+        }
+    }
+    m_discardThrough = m_segment - 1;
+
+    m_thread = std::thread(&BlockJournal::run, this);
+}
+
+BlockJournal::~BlockJournal()
+{
+    m_mutex.lock();
+    m_stopping = true;
+    m_mutex.unlock();
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+QString BlockJournal::segmentPath(int segment) const
+{
+    return QDir(m_directory).filePath(QString("journal.") + QString::number(segment) + ".log");
+}
+
+void BlockJournal::readSegment(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QByteArray bytes = file.readAll();
+    // A crash mid-write can leave part of a record at the end; drop it
+    int count = bytes.size() / RECORD_SIZE;
+    const char *p = bytes.constData();
+    for (int i = 0; i < count; ++i, p += RECORD_SIZE) {
+        qint32 pos[3];
+        std::memcpy(pos, p, sizeof(pos));
+        BlockEdit edit = {pos[0], pos[1], pos[2],
+                          static_cast<BlockType>(p[sizeof(pos)]), static_cast<BlockType>(p[sizeof(pos) + 1])};
+        m_replay[chunkKey(edit.x, edit.z)].push_back(edit);
+        ++m_replayedCount;
+    }
+}
+
+void BlockJournal::appendLocked(const BlockEdit &edit)
+{
+    if (m_batches.empty() || m_batches.back().segment != m_segment) {
+        m_batches.push_back(Batch{m_segment, std::vector<char>()});
+    }
+    std::vector<char> &bytes = m_batches.back().bytes;
+    size_t at = bytes.size();
+    bytes.resize(at + RECORD_SIZE);
+    qint32 pos[3] = {edit.x, edit.y, edit.z};
+    std::memcpy(&bytes[at], pos, sizeof(pos));
+    bytes[at + sizeof(pos)] = static_cast<char>(edit.oldType);
+    bytes[at + sizeof(pos) + 1] = static_cast<char>(edit.newType);
+}
+
+void BlockJournal::append(const BlockEdit &edit)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    appendLocked(edit);
+    m_unsaved[chunkKey(edit.x, edit.z)].push_back(edit);
+}
+
+int BlockJournal::rotate(const std::vector<glm::ivec2> &unsaved)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int sealed = m_segment++;
+    // Their Chunks were never filled in, so the save being started does
+    // not cover them
+    for (auto &entry : m_replay) {
+        for (const BlockEdit &edit : entry.second) {
+            appendLocked(edit);
+        }
+    }
+    // Nor does it cover these; every other Chunk's edits are in the save
+    std::unordered_map<int64_t, std::vector<BlockEdit>> kept;
+    for (const glm::ivec2 &corner : unsaved) {
+        auto it = m_unsaved.find(chunkKey(corner.x, corner.y));
+        if (it == m_unsaved.end()) {
+            continue;
+        }
+        for (const BlockEdit &edit : it->second) {
+            appendLocked(edit);
+        }
+        kept[it->first] = std::move(it->second);
+    }
+    std::swap(kept, m_unsaved);
+    return sealed;
+}
+
+void BlockJournal::discardThrough(int segment)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_discardThrough = std::max(m_discardThrough, segment);
+    m_wake.notify_one();
+}
+
+std::vector<BlockEdit> BlockJournal::takeEdits(int x, int z)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<BlockEdit> edits;
+    auto it = m_replay.find(chunkKey(x, z));
+    if (it != m_replay.end()) {
+        edits = std::move(it->second);
+        m_replay.erase(it);
+    }
+    return edits;
+}
+
+size_t BlockJournal::replayedCount() const
+{
+    return m_replayedCount;
+}
+
+void BlockJournal::run()
+{
+    QFile file;
+    int openSegment = -1;
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait_for(lock, std::chrono::milliseconds(JOURNAL_SYNC_MS), [this] { return m_stopping; });
+        std::vector<Batch> batches;
+        std::swap(batches, m_batches);
+        int discardThrough = m_discardThrough;
+        bool stopping = m_stopping;
+        lock.unlock();
+
+        for (const Batch &batch : batches) {
+            if (batch.segment != openSegment) {
+                file.close();
+                file.setFileName(segmentPath(batch.segment));
+                if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+                    qDebug() << "Could not open journal segment" << file.fileName();
+                    openSegment = -1;
+                    continue;
+                }
+                openSegment = batch.segment;
+            }
+            file.write(batch.bytes.data(), static_cast<qint64>(batch.bytes.size()));
+        }
+        // One sync for everything written this round
+        if (!batches.empty() && file.isOpen() && file.flush()) {
+#ifdef _WIN32
+            _commit(file.handle());
+#else
+            fsync(file.handle());
+#endif
+        }
+
+        // Only once what replaced them is on disk
+        while (m_oldestSegment <= discardThrough) {
+            if (m_oldestSegment == openSegment) {
+                file.close();
+                openSegment = -1;
+            }
+            QFile::remove(segmentPath(m_oldestSegment));
+            ++m_oldestSegment;
+        }
+
+        if (stopping) {
+            break;
+        }
+    }
+}
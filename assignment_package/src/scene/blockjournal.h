@@ -0,0 +1,84 @@
+#pragma once
+#include "chunk.h"
+#include <QString>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// One block changed through Terrain::setBlockAt
+struct BlockEdit {
+    int x, y, z;
+    BlockType oldType;
+    BlockType newType;
+};
+
+// Write-ahead journal of block edits, so edits made since the last save
+// survive a crash. Edits are appended in memory and a writer thread puts
+// them on disk and syncs the file every JOURNAL_SYNC_MS, so one sync
+// covers however many edits were made in that time and appending never
+// waits on the disk.
+//
+// The journal is split into numbered segment files. Saving changed Chunks
+// seals the current segment (see rotate()); once the saves have reached
+// disk, the sealed segments are no longer needed and are deleted. Edits to
+// Chunks a save leaves out are copied into the new segment first.
+//
+// On startup every segment left behind is read back, and the edits are
+// handed out per Chunk as the Chunks are loaded or generated.
+class BlockJournal
+{
+private:
+    struct Batch {
+        int segment;
+        std::vector<char> bytes; // Encoded edits
+    };
+
+    QString m_directory;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<Batch> m_batches; // Not yet written
+    int m_segment;                // Segment new edits go into
+    int m_discardThrough;         // Segments up to this one may be deleted
+    bool m_stopping;
+    std::thread m_thread;
+
+    // Writer thread only
+    int m_oldestSegment;          // Lowest segment that may still exist on disk
+
+    // Edits read back at startup whose Chunks have not been filled in yet,
+    // by Chunk. Only touched by the GL thread, but read under m_mutex.
+    std::unordered_map<int64_t, std::vector<BlockEdit>> m_replay;
+    size_t m_replayedCount;
+    // Edits appended since their Chunk was last saved, by Chunk
+    std::unordered_map<int64_t, std::vector<BlockEdit>> m_unsaved;
+
+    QString segmentPath(int segment) const;
+    // m_mutex must be held
+    void appendLocked(const BlockEdit &edit);
+    void readSegment(const QString &path);
+    void run();
+
+public:
+    // Reads back the segments left in directory and starts the writer
+    BlockJournal(const QString &directory);
+    ~BlockJournal();
+
+    void append(const BlockEdit &edit);
+
+    // Starts a new segment for edits made from now on and returns the one
+    // it sealed. Edits still waiting to be replayed are carried over, as are
+    // those made to the Chunks in unsaved, whose lower-left corners are
+    // given, since the save being started leaves them out.
+    int rotate(const std::vector<glm::ivec2> &unsaved);
+    // Every edit in segments up to and including segment is saved elsewhere
+    void discardThrough(int segment);
+
+    // Edits read back at startup for the Chunk whose lower-left corner is at
+    // (x, z). Each is handed out once.
+    std::vector<BlockEdit> takeEdits(int x, int z);
+    // Edits read back at startup, handed out or not
+    size_t replayedCount() const;
+};
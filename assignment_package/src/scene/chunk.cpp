@@ -2,12 +2,78 @@
 #include <openglcontext.h>
 #include <glm_includes.h>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+std::mutex MeshScratchPool::s_mutex;
+std::vector<std::vector<glm::vec4>> MeshScratchPool::s_free;
+
+std::vector<glm::vec4> MeshScratchPool::acquire(size_t predictedSize)
+{
+    std::vector<glm::vec4> buffer;
+    s_mutex.lock();
+    if (!s_free.empty()) {
+        buffer.swap(s_free.back());
+        s_free.pop_back();
+    }
+    s_mutex.unlock();
+    buffer.reserve(predictedSize);
+    return buffer;
+}
+
+void MeshScratchPool::recycle(std::vector<glm::vec4> &buffer)
+{
+    std::vector<glm::vec4> spare;
+    spare.swap(buffer);
+    if (spare.capacity() == 0) {
+        return;
+    }
+    spare.clear();
+    s_mutex.lock();
+    if (s_free.size() < MAX_POOLED) {
+        s_free.push_back(std::move(spare));
+    }
+    s_mutex.unlock();
+    // Otherwise spare's memory is freed on the way out
+}
+
+// Running estimates of a freshly generated Chunk's mesh size, used to
+// reserve space for Chunks that have never been meshed before.
+// Updated by every worker thread, so only ever approximately current.
+static std::atomic<size_t> typicalOpaqueSize(0);
+static std::atomic<size_t> typicalTransparentSize(0);
+
+// Reserve for the size this mesh had last time plus a little room to grow,
+// or for a typical Chunk if it has never been meshed
+static size_t predictMeshSize(size_t lastSize, const std::atomic<size_t> &typical)
+{
+    size_t base = lastSize > 0 ? lastSize : typical.load(std::memory_order_relaxed);
+    return base + base / 8;
+}
+
+static void updateTypicalSize(std::atomic<size_t> &typical, size_t size)
+{
+    size_t old = typical.load(std::memory_order_relaxed);
+    typical.store(old == 0 ? size : (3 * old + size) / 4, std::memory_order_relaxed);
+}
 
 Chunk::Chunk(OpenGLContext* context, int X, int Z)
-    : idx(std::vector<GLuint>()), data(std::vector<glm::vec4>()), Drawable(context), X(X), Z(Z), m_blocks(),
-      m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}}
+    : Drawable(context), data(std::vector<glm::vec4>()),
+      m_lastDataSize(0), m_lastTDataSize(0), m_minY(256.f), m_maxY(0.f),
+      m_builtMinY(256.f), m_builtMaxY(0.f),
+      m_sectionLinks(), m_builtSectionLinks(), m_blocks(),
+      m_light(), m_lightReady(false), m_fluidLevels(),
+      m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}},
+      m_lodLevel(0), m_builtLod(0), m_wantedLod(0), m_lodPending(false), m_lodStale(false),
+      X(X), Z(Z)
 {
-    std::fill_n(m_blocks.begin(), 65536, EMPTY);
+    std::fill_n(m_blocks.begin(), CHUNK_BLOCK_COUNT, EMPTY);
+    // Until it is lit, an empty Chunk looks like open sky to its neighbors
+    m_light.fill(0xF0);
+    for (auto &links : m_sectionLinks) {
+        links.fill(ALL_FACES);
+    }
 }
 
 void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
@@ -17,6 +83,15 @@ void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
     }
 }
 
+void Chunk::unlinkNeighbors() {
+    for (auto &entry : m_neighbors) {
+        if (entry.second != nullptr) {
+            entry.second->m_neighbors[oppositeDirection.at(entry.first)] = nullptr;
+            entry.second = nullptr;
+        }
+    }
+}
+
 // Does bounds checking with at()
 BlockType Chunk::getBlockAt(unsigned int x, unsigned int y, unsigned int z) const {
     return m_blocks.at(x + 16 * y + 16 * 256 * z);
@@ -32,17 +107,233 @@ void Chunk::setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType
     m_blocks.at(x + 16 * y + 16 * 256 * z) = t;
 }
 
-void Chunk::create()
+Chunk* Chunk::neighbor(Direction dir) const {
+    auto it = m_neighbors.find(dir);
+    return it == m_neighbors.end() ? nullptr : it->second;
+}
+
+unsigned char Chunk::getSkyLight(int x, int y, int z) const {
+    return m_light[x + 16 * y + 16 * 256 * z] >> 4;
+}
+
+unsigned char Chunk::getBlockLight(int x, int y, int z) const {
+    return m_light[x + 16 * y + 16 * 256 * z] & 0x0F;
+}
+
+void Chunk::setSkyLight(int x, int y, int z, unsigned char level) {
+    unsigned char &l = m_light[x + 16 * y + 16 * 256 * z];
+    l = static_cast<unsigned char>((level << 4) | (l & 0x0F));
+}
+
+void Chunk::setBlockLight(int x, int y, int z, unsigned char level) {
+    unsigned char &l = m_light[x + 16 * y + 16 * 256 * z];
+    l = static_cast<unsigned char>((l & 0xF0) | level);
+}
+
+unsigned char* Chunk::lightData() {
+    return m_light.data();
+}
+
+bool Chunk::isLightReady() const {
+    return m_lightReady;
+}
+
+void Chunk::setLightReady() {
+    m_lightReady = true;
+}
+
+unsigned char Chunk::getFluidLevel(int x, int y, int z) const {
+    auto it = m_fluidLevels.find(x + 16 * y + 16 * 256 * z);
+    return it == m_fluidLevels.end() ? 0 : it->second;
+}
+
+void Chunk::setFluidLevel(int x, int y, int z, unsigned char level) {
+    if (level == 0) {
+        m_fluidLevels.erase(x + 16 * y + 16 * 256 * z);
+    } else {
+        m_fluidLevels[x + 16 * y + 16 * 256 * z] = level;
+    }
+}
+
+const std::unordered_map<int, unsigned char>& Chunk::fluidLevels() const {
+    return m_fluidLevels;
+}
+
+float Chunk::faceLight(int x, int y, int z, Direction dir) const {
+    const Chunk *c = this;
+    switch (dir) {
+    case XPOS: ++x; break;
+    case XNEG: --x; break;
+    case YPOS: ++y; break;
+    case YNEG: --y; break;
+    case ZPOS: ++z; break;
+    case ZNEG: --z; break;
+    }
+    if (y > 255) {
+        return 1.f + 16.f * 15.f;
+    } else if (y < 0) {
+        return 1.f;
+    }
+    if (x < 0 || x > 15 || z < 0 || z > 15) {
+        c = neighbor(dir);
+        // The edge of the world is lit like open sky
+        if (c == nullptr) {
+            return 1.f + 16.f * 15.f;
+        }
+        x = (x + 16) % 16;
+        z = (z + 16) % 16;
+    }
+    return 1.f + c->m_light[x + 16 * y + 16 * 256 * z];
+}
+
+const BlockType* Chunk::blocks() const {
+    return m_blocks.data();
+}
+
+void Chunk::setBlocks(const BlockType *blocks) {
+    std::copy(blocks, blocks + CHUNK_BLOCK_COUNT, m_blocks.begin());
+}
+
+std::shared_lock<std::shared_mutex> Chunk::readBlocks() const {
+    return std::shared_lock<std::shared_mutex>(m_blocksMutex);
+}
+
+std::unique_lock<std::shared_mutex> Chunk::writeBlocks() {
+    return std::unique_lock<std::shared_mutex>(m_blocksMutex);
+}
+
+std::vector<std::shared_lock<std::shared_mutex>> Chunk::lockBlocksAround() const {
+    // The same Chunks blockNear() reaches: diagonals through the X sides
+    std::vector<const Chunk*> around = {this, neighbor(ZPOS), neighbor(ZNEG)};
+    for (Direction dir : {XPOS, XNEG}) {
+        const Chunk *side = neighbor(dir);
+        if (side != nullptr) {
+            around.insert(around.end(), {side, side->neighbor(ZPOS), side->neighbor(ZNEG)});
+        }
+    }
+    around.erase(std::remove(around.begin(), around.end(), nullptr), around.end());
+    std::sort(around.begin(), around.end(), std::less<const Chunk*>());
+    around.erase(std::unique(around.begin(), around.end()), around.end());
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    for (const Chunk *c : around) {
+        locks.push_back(c->readBlocks());
+    }
+    return locks;
+}
+
+// Blocks that meshing treats as part of the solid surface
+static bool isOpaqueBlock(BlockType t)
 {
-    this->idx.clear();
-    this->tIdx.clear();
+    return t != EMPTY && t != WATER && t != ICE;
+}
 
-    this->data.clear();
-    this->tData.clear();
+// One side of a unit cube, indexed by Direction. Corners are listed UL,
+// LL, LR, UR, the order every Chunk mesh uses for its quads.
+struct CubeFace {
+    Direction dir;
+    glm::ivec3 offset;
+    glm::vec3 corners[4];
+    glm::vec4 normal;
+};
 
-    int indexCount = 0;
-    int tIndexCount = 0;
+const static std::array<CubeFace, 6> cubeFaces {{
+    {XPOS, glm::ivec3(1, 0, 0),
+     {glm::vec3(1, 1, 0), glm::vec3(1, 0, 0), glm::vec3(1, 0, 1), glm::vec3(1, 1, 1)},
+     glm::vec4(1, 0, 0, 0)},
+    {XNEG, glm::ivec3(-1, 0, 0),
+     {glm::vec3(0, 1, 1), glm::vec3(0, 0, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0)},
+     glm::vec4(-1, 0, 0, 0)},
+    {YPOS, glm::ivec3(0, 1, 0),
+     {glm::vec3(0, 1, 1), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0), glm::vec3(1, 1, 1)},
+     glm::vec4(0, 1, 0, 0)},
+    {YNEG, glm::ivec3(0, -1, 0),
+     {glm::vec3(0, 0, 1), glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(1, 0, 1)},
+     glm::vec4(0, -1, 0, 0)},
+    {ZPOS, glm::ivec3(0, 0, 1),
+     {glm::vec3(0, 1, 1), glm::vec3(0, 0, 1), glm::vec3(1, 0, 1), glm::vec3(1, 1, 1)},
+     glm::vec4(0, 0, 1, 0)},
+    {ZNEG, glm::ivec3(0, 0, -1),
+     {glm::vec3(0, 1, 0), glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(1, 1, 0)},
+     glm::vec4(0, 0, -1, 0)}
+}};
 
+// UV offsets of the UL, LL, LR, UR corners within a texture tile
+const static std::array<glm::vec4, 4> cornerUVs {{
+    glm::vec4(0.f, 1.f, 0.f, 0.f),
+    glm::vec4(0.f),
+    glm::vec4(1.f, 0.f, 0.f, 0.f),
+    glm::vec4(1.f, 1.f, 0.f, 0.f)
+}};
+
+BlockType Chunk::blockNear(int x, int y, int z) const {
+    if (y < 0 || y > 255) {
+        return EMPTY;
+    }
+    const Chunk *c = this;
+    if (x < 0 || x > 15) {
+        c = c->neighbor(x < 0 ? XNEG : XPOS);
+    }
+    if (c != nullptr && (z < 0 || z > 15)) {
+        c = c->neighbor(z < 0 ? ZNEG : ZPOS);
+    }
+    if (c == nullptr) {
+        return EMPTY;
+    }
+    return c->m_blocks[(x + 16) % 16 + 16 * y + 16 * 256 * ((z + 16) % 16)];
+}
+
+void Chunk::pushFace(std::vector<glm::vec4> &out, BlockType t, int x, int y, int z,
+                     Direction dir, bool occluded) const
+{
+    const CubeFace &face = cubeFaces[dir];
+    glm::vec4 origin(this->X + x, y, this->Z + z, 1.f);
+    float light = faceLight(x, y, z, dir);
+    glm::vec4 uv = getUVs(t, dir);
+
+    // Classic voxel AO: each corner is darkened by the solid blocks among
+    // the two edges and the corner touching it, in the layer the face looks
+    // out onto. Two solid edges hide the corner block completely.
+    int occlusion[4] = {0, 0, 0, 0};
+    if (occluded) {
+        glm::ivec3 front = glm::ivec3(x, y, z) + face.offset;
+        // The two axes lying in the face
+        int u = face.offset.x != 0 ? 1 : 0;
+        int v = face.offset.z != 0 ? 1 : 2;
+        for (int c = 0; c < 4; ++c) {
+            glm::ivec3 du(0), dv(0);
+            du[u] = face.corners[c][u] > 0.f ? 1 : -1;
+            dv[v] = face.corners[c][v] > 0.f ? 1 : -1;
+            glm::ivec3 p = front + du, q = front + dv, r = front + du + dv;
+            bool side1 = isOpaqueBlock(blockNear(p.x, p.y, p.z));
+            bool side2 = isOpaqueBlock(blockNear(q.x, q.y, q.z));
+            bool corner = isOpaqueBlock(blockNear(r.x, r.y, r.z));
+            occlusion[c] = side1 && side2 ? 3 : side1 + side2 + corner;
+        }
+    }
+
+    // Quads are split along UL-LR. When the other diagonal joins the two
+    // darker corners, start from LL instead so the split runs along the
+    // brighter pair and the shading stays symmetric.
+    int first = occlusion[0] + occlusion[2] > occlusion[1] + occlusion[3] ? 1 : 0;
+    for (int n = 0; n < 4; ++n) {
+        int c = (first + n) % 4;
+        out.push_back(origin + glm::vec4(face.corners[c], 0.f));
+        out.push_back(glm::vec4(glm::vec3(face.normal), light + 256.f * occlusion[c]));
+        out.push_back(uv + cornerUVs[c]);
+    }
+}
+
+void Chunk::create()
+{
+    // Edits and flowing fluid wait until this is done reading
+    auto locks = lockBlocksAround();
+
+    // Mesh into pooled vectors already reserved for roughly the size the
+    // result will be, so the thousands of push_backs below rarely reallocate
+    MeshScratchPool::recycle(this->data);
+    MeshScratchPool::recycle(this->tData);
+    this->data = MeshScratchPool::acquire(predictMeshSize(m_lastDataSize, typicalOpaqueSize));
+    this->tData = MeshScratchPool::acquire(predictMeshSize(m_lastTDataSize, typicalTransparentSize));
 
     // Iterate over all blocks in chunk
     for (int i = 0; i < 16; i++) { // x
@@ -51,14 +342,11 @@ void Chunk::create()
                 // Block at current location
                 BlockType t = getBlockAt(i, j, k);
 
-                // World pos = chunk position + block local position
-                glm::vec4 worldPos = glm::vec4(this->X, 0.f, this->Z, 0.f) + glm::vec4(i, j, k, 1.f);
-
                 if (t == EMPTY) {
                     continue;
                 } else if (t == DIRT || t == GRASS || t == STONE || t == SNOW ||
                            t == LAVA || t == SPIRE || t == SPIRE_TOP) { // Solid blocks
-                    // Back face (face with LL vertex at worldPos)
+                    // Back face
                     BlockType blockBehind = getBlockAt(i, j, std::max(0, k - 1));
                     if (k == 0) {
                         if (m_neighbors.at(ZNEG) != nullptr) {
@@ -67,30 +355,7 @@ void Chunk::create()
                     }
                     if (blockBehind == EMPTY || blockBehind == WATER || blockBehind == ICE ||
                             (k == 0 && m_neighbors.at(ZNEG) == nullptr)) {
-                        // Back face positions
-                        // Back face normal is -k
-                        glm::vec4 norm = glm::vec4(0.f, 0.f, -1.f, 0.f);
-                        glm::vec4 uv = getUVs(t, ZNEG);
-                        //UL
-                        data.push_back(worldPos + glm::vec4(0.f, 1.f, 0.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        data.push_back(worldPos);
-                        data.push_back(glm::vec4(0.f, 0.f, -1.f, 0.f));
-                        data.push_back(uv);
-                        //LR
-                        data.push_back(worldPos + glm::vec4(1.f, 0.f, 0.f, 0.f));
-                        data.push_back(glm::vec4(0.f, 0.f, -1.f, 0.f));
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        data.push_back(worldPos + glm::vec4(1.f, 1.f, 0.f, 0.f));
-                        data.push_back(glm::vec4(0.f, 0.f, -1.f, 0.f));
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(idx, indexCount);
-                        indexCount += 4;
+                        pushFace(data, t, i, j, k, ZNEG, true);
                     }
 
                     // Front face
@@ -102,30 +367,7 @@ void Chunk::create()
                     }
                     if (blockFront == EMPTY || blockFront == WATER || blockFront == ICE ||
                             (k == 15 && m_neighbors.at(ZPOS) == nullptr)) {
-                        // Front face positions
-                        // Front face normal is +k
-                        glm::vec4 norm = glm::vec4(0.f, 0.f, 1.f, 0.f);
-                        glm::vec4 uv = getUVs(t, ZPOS);
-                        //UL
-                        data.push_back(worldPos + glm::vec4(0.f, 1.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        data.push_back(worldPos + glm::vec4(0.f, 0.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv);
-                        //LR
-                        data.push_back(worldPos + glm::vec4(1.f, 0.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        data.push_back(worldPos + glm::vec4(1.f, 1.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(idx, indexCount);
-                        indexCount += 4;
+                        pushFace(data, t, i, j, k, ZPOS, true);
                     }
 
                     // Left face
@@ -137,30 +379,7 @@ void Chunk::create()
                     }
                     if (blockLeft == EMPTY || blockLeft == WATER || blockLeft == ICE ||
                             (i == 0 && m_neighbors.at(XNEG) == nullptr)) {
-                        // Left face positions
-                        // Left face normal is -i
-                        glm::vec4 norm = glm::vec4(-1.f, 0.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, XNEG);
-                        //UL
-                        data.push_back(worldPos + glm::vec4(0.f, 1.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        data.push_back(worldPos + glm::vec4(0.f, 0.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv);
-                        //LR
-                        data.push_back(worldPos);
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        data.push_back(worldPos + glm::vec4(0.f, 1.f, 0.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(idx, indexCount);
-                        indexCount += 4;
+                        pushFace(data, t, i, j, k, XNEG, true);
                     }
 
                     // Right face
@@ -172,93 +391,24 @@ void Chunk::create()
                     }
                     if (blockRight == EMPTY || blockRight == WATER || blockRight == ICE ||
                             (i == 15 && m_neighbors.at(XPOS) == nullptr)) {
-                        // Right face positions
-                        // Right face normal is +i
-                        glm::vec4 norm = glm::vec4(1.f, 0.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, XPOS);
-                        //UL
-                        data.push_back(worldPos + glm::vec4(1.f, 1.f, 0.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        data.push_back(worldPos + glm::vec4(1.f, 0.f, 0.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv);
-                        //LR
-                        data.push_back(worldPos + glm::vec4(1.f, 0.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        data.push_back(worldPos + glm::vec4(1.f, 1.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(idx, indexCount);
-                        indexCount += 4;
+                        pushFace(data, t, i, j, k, XPOS, true);
                     }
 
                     // Bottom face
                     BlockType blockBottom = getBlockAt(i, std::max(0, j - 1), k);
                     if (blockBottom == EMPTY || blockBottom == WATER ||
                             blockBottom == ICE || j == 0) {
-                        // Bottom face positions
-                        // Bottom face normal is -j
-                        glm::vec4 norm = glm::vec4(0.f, -1.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, YNEG);
-                        //UL
-                        data.push_back(worldPos + glm::vec4(0.f, 0.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        data.push_back(worldPos);
-                        data.push_back(norm);
-                        data.push_back(uv);
-                        //LR
-                        data.push_back(worldPos + glm::vec4(1.f, 0.f, 0.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        data.push_back(worldPos + glm::vec4(1.f, 0.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(idx, indexCount);
-                        indexCount += 4;
+                        pushFace(data, t, i, j, k, YNEG, true);
                     }
 
                     //Top face
                     BlockType blockTop = getBlockAt(i, std::min(255, j + 1), k);
                     if (blockTop == EMPTY || blockTop == WATER ||
                             blockTop == ICE || j == 255) {
-                        // Top face positions
-                        // Top face normal is +j
-                        glm::vec4 norm = glm::vec4(0.f, 1.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, YPOS);
-                        //UL
-                        data.push_back(worldPos + glm::vec4(0.f, 1.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        data.push_back(worldPos + glm::vec4(0.f, 1.f, 0.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv);
-                        //LR
-                        data.push_back(worldPos + glm::vec4(1.f, 1.f, 0.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        data.push_back(worldPos + glm::vec4(1.f, 1.f, 1.f, 0.f));
-                        data.push_back(norm);
-                        data.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(idx, indexCount);
-                        indexCount += 4;
+                        pushFace(data, t, i, j, k, YPOS, true);
                     }
                 } else if (t == WATER || t == ICE) { // Transparent blocks
-                    // Back face (face with LL vertex at worldPos)
+                    // Back face
                     BlockType blockBehind = getBlockAt(i, j, std::max(0, k - 1));
                     if (k == 0) {
                         if (m_neighbors.at(ZNEG) != nullptr) {
@@ -266,30 +416,7 @@ void Chunk::create()
                         }
                     }
                     if (blockBehind == EMPTY || (k == 0 && m_neighbors.at(ZNEG) == nullptr)) {
-                        // Back face positions
-                        // Back face normal is -k
-                        glm::vec4 norm = glm::vec4(0.f, 0.f, -1.f, 0.f);
-                        glm::vec4 uv = getUVs(t, ZNEG);
-                        //UL
-                        tData.push_back(worldPos + glm::vec4(0.f, 1.f, 0.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        tData.push_back(worldPos);
-                        tData.push_back(glm::vec4(0.f, 0.f, -1.f, 0.f));
-                        tData.push_back(uv);
-                        //LR
-                        tData.push_back(worldPos + glm::vec4(1.f, 0.f, 0.f, 0.f));
-                        tData.push_back(glm::vec4(0.f, 0.f, -1.f, 0.f));
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        tData.push_back(worldPos + glm::vec4(1.f, 1.f, 0.f, 0.f));
-                        tData.push_back(glm::vec4(0.f, 0.f, -1.f, 0.f));
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(tIdx, tIndexCount);
-                        tIndexCount += 4;
+                        pushFace(tData, t, i, j, k, ZNEG, false);
                     }
 
                     // Front face
@@ -300,30 +427,7 @@ void Chunk::create()
                         }
                     }
                     if (blockFront == EMPTY || (k == 15 && m_neighbors.at(ZPOS) == nullptr)) {
-                        // Front face positions
-                        // Front face normal is +k
-                        glm::vec4 norm = glm::vec4(0.f, 0.f, 1.f, 0.f);
-                        glm::vec4 uv = getUVs(t, ZPOS);
-                        //UL
-                        tData.push_back(worldPos + glm::vec4(0.f, 1.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        tData.push_back(worldPos + glm::vec4(0.f, 0.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv);
-                        //LR
-                        tData.push_back(worldPos + glm::vec4(1.f, 0.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        tData.push_back(worldPos + glm::vec4(1.f, 1.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(tIdx, tIndexCount);
-                        tIndexCount += 4;
+                        pushFace(tData, t, i, j, k, ZPOS, false);
                     }
 
                     // Left face
@@ -334,30 +438,7 @@ void Chunk::create()
                         }
                     }
                     if (blockLeft == EMPTY || (i == 0 && m_neighbors.at(XNEG) == nullptr)) {
-                        // Left face positions
-                        // Left face normal is -i
-                        glm::vec4 norm = glm::vec4(-1.f, 0.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, XNEG);
-                        //UL
-                        tData.push_back(worldPos + glm::vec4(0.f, 1.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        tData.push_back(worldPos + glm::vec4(0.f, 0.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv);
-                        //LR
-                        tData.push_back(worldPos);
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        tData.push_back(worldPos + glm::vec4(0.f, 1.f, 0.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(tIdx, tIndexCount);
-                        tIndexCount += 4;
+                        pushFace(tData, t, i, j, k, XNEG, false);
                     }
 
                     // Right face
@@ -368,88 +449,100 @@ void Chunk::create()
                         }
                     }
                     if (blockRight == EMPTY || (i == 15 && m_neighbors.at(XPOS) == nullptr)) {
-                        // Right face positions
-                        // Right face normal is +i
-                        glm::vec4 norm = glm::vec4(1.f, 0.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, XPOS);
-                        //UL
-                        tData.push_back(worldPos + glm::vec4(1.f, 1.f, 0.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        tData.push_back(worldPos + glm::vec4(1.f, 0.f, 0.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv);
-                        //LR
-                        tData.push_back(worldPos + glm::vec4(1.f, 0.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        tData.push_back(worldPos + glm::vec4(1.f, 1.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(tIdx, tIndexCount);
-                        tIndexCount += 4;
+                        pushFace(tData, t, i, j, k, XPOS, false);
                     }
 
                     // Bottom face
                     BlockType blockBottom = getBlockAt(i, std::max(0, j - 1), k);
                     if (blockBottom == EMPTY || j == 0) {
-                        // Bottom face positions
-                        // Bottom face normal is -j
-                        glm::vec4 norm = glm::vec4(0.f, -1.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, YNEG);
-                        //UL
-                        tData.push_back(worldPos + glm::vec4(0.f, 0.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        tData.push_back(worldPos);
-                        tData.push_back(norm);
-                        tData.push_back(uv);
-                        //LR
-                        tData.push_back(worldPos + glm::vec4(1.f, 0.f, 0.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        tData.push_back(worldPos + glm::vec4(1.f, 0.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(tIdx, tIndexCount);
-                        tIndexCount += 4;
+                        pushFace(tData, t, i, j, k, YNEG, false);
                     }
 
                     //Top face
                     BlockType blockTop = getBlockAt(i, std::min(255, j + 1), k);
                     if (blockTop == EMPTY || j == 255) {
-                        // Top face positions
-                        // Top face normal is +j
-                        glm::vec4 norm = glm::vec4(0.f, 1.f, 0.f, 0.f);
-                        glm::vec4 uv = getUVs(t, YPOS);
-                        //UL
-                        tData.push_back(worldPos + glm::vec4(0.f, 1.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(0.f, 1.f / 16.f, 0.f, 0.f));
-                        //LL
-                        tData.push_back(worldPos + glm::vec4(0.f, 1.f, 0.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv);
-                        //LR
-                        tData.push_back(worldPos + glm::vec4(1.f, 1.f, 0.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 0.f, 0.f, 0.f));
-                        //UR
-                        tData.push_back(worldPos + glm::vec4(1.f, 1.f, 1.f, 0.f));
-                        tData.push_back(norm);
-                        tData.push_back(uv + glm::vec4(1.f / 16.f, 1.f / 16.f,
-                                                      0.f, 0.f));
-                        // Add indices
-                        pushIndexForFace(tIdx, tIndexCount);
-                        tIndexCount += 4;
+                        pushFace(tData, t, i, j, k, YPOS, false);
+                    }
+                }
+            }
+        }
+    }
+
+    // Every third vec4 is a position
+    m_builtMinY = 256.f;
+    m_builtMaxY = 0.f;
+    for (const std::vector<glm::vec4> *mesh : {&data, &tData}) {
+        for (size_t i = 0; i < mesh->size(); i += 3) {
+            m_builtMinY = std::min(m_builtMinY, (*mesh)[i].y);
+            m_builtMaxY = std::max(m_builtMaxY, (*mesh)[i].y);
+        }
+    }
+
+    m_lastDataSize = data.size();
+    m_lastTDataSize = tData.size();
+    updateTypicalSize(typicalOpaqueSize, m_lastDataSize);
+    updateTypicalSize(typicalTransparentSize, m_lastTDataSize);
+
+    buildSectionLinks();
+}
+
+void Chunk::buildSectionLinks()
+{
+    // Flood fill each section's open cells. Every connected pocket of air
+    // links all of the section faces it touches to one another.
+    const int SIZE = CHUNK_SECTION_HEIGHT;
+    std::vector<bool> visited(SIZE * SIZE * SIZE);
+    std::vector<glm::ivec3> stack;
+    for (int section = 0; section < CHUNK_SECTION_COUNT; ++section) {
+        std::array<FaceMask, 6> &links = m_builtSectionLinks[section];
+        links.fill(0);
+        std::fill(visited.begin(), visited.end(), false);
+        int yOffset = section * SIZE;
+        auto index = [SIZE](const glm::ivec3 &p) {
+            return p.x + SIZE * (p.y + SIZE * p.z);
+        };
+
+        for (int z = 0; z < SIZE; ++z) {
+            for (int y = 0; y < SIZE; ++y) {
+                for (int x = 0; x < SIZE; ++x) {
+                    glm::ivec3 seed(x, y, z);
+                    if (visited[index(seed)] || isOpaqueBlock(getBlockAt(x, y + yOffset, z))) {
+                        continue;
+                    }
+                    FaceMask touched = 0;
+                    visited[index(seed)] = true;
+                    stack.push_back(seed);
+                    while (!stack.empty()) {
+                        glm::ivec3 p = stack.back();
+                        stack.pop_back();
+                        if (p.x == SIZE - 1) touched |= 1 << XPOS;
+                        if (p.x == 0)        touched |= 1 << XNEG;
+                        if (p.y == SIZE - 1) touched |= 1 << YPOS;
+                        if (p.y == 0)        touched |= 1 << YNEG;
+                        if (p.z == SIZE - 1) touched |= 1 << ZPOS;
+                        if (p.z == 0)        touched |= 1 << ZNEG;
+
+                        const glm::ivec3 steps[6] = {
+                            p + glm::ivec3(1, 0, 0), p - glm::ivec3(1, 0, 0),
+                            p + glm::ivec3(0, 1, 0), p - glm::ivec3(0, 1, 0),
+                            p + glm::ivec3(0, 0, 1), p - glm::ivec3(0, 0, 1)
+                        };
+                        for (const glm::ivec3 &n : steps) {
+                            if (glm::any(glm::lessThan(n, glm::ivec3(0))) ||
+                                    glm::any(glm::greaterThanEqual(n, glm::ivec3(SIZE)))) {
+                                continue;
+                            }
+                            if (visited[index(n)] || isOpaqueBlock(getBlockAt(n.x, n.y + yOffset, n.z))) {
+                                continue;
+                            }
+                            visited[index(n)] = true;
+                            stack.push_back(n);
+                        }
+                    }
+                    for (int face = 0; face < 6; ++face) {
+                        if (touched & (1 << face)) {
+                            links[face] |= touched;
+                        }
                     }
                 }
             }
@@ -457,91 +550,264 @@ void Chunk::create()
     }
 }
 
+FaceMask Chunk::sectionLinks(int section, Direction entry) const
+{
+    return m_sectionLinks[section][entry];
+}
+
+// Emits one face of a cell. A non-zero skirt drags the face's lower edge
+// further down so it hides any gap against a neighbor drawn at another LOD.
+static void pushLodFace(std::vector<glm::vec4> &out, const CubeFace &face,
+                        const glm::vec4 &origin, float size, float skirt, const glm::vec4 &uv)
+{
+    for (int c = 0; c < 4; ++c) {
+        glm::vec4 pos = origin + glm::vec4(face.corners[c] * size, 0.f);
+        if (face.corners[c].y == 0.f) {
+            pos.y -= skirt;
+        }
+        out.push_back(pos);
+        out.push_back(face.normal);
+        out.push_back(uv + cornerUVs[c]);
+    }
+}
+
+void Chunk::createLod(int level)
+{
+    const int size = 1 << level;   // Blocks along each edge of a cell
+    const int n = 16 / size;       // Cells along the chunk's X and Z
+    const int h = 256 / size;      // Cells along Y
+    const int volume = size * size * size;
+
+    // Reduce every cell to one block type: the top-most solid block if most
+    // of the cell is solid, else the top-most water or ice if most of it is
+    // filled at all, else EMPTY
+    std::vector<BlockType> cells(n * h * n, EMPTY);
+    std::shared_lock<std::shared_mutex> lock = readBlocks();
+    for (int cz = 0; cz < n; ++cz) {
+        for (int cy = 0; cy < h; ++cy) {
+            for (int cx = 0; cx < n; ++cx) {
+                int opaque = 0;
+                int clear = 0;
+                BlockType topOpaque = EMPTY;
+                BlockType topClear = EMPTY;
+                for (int y = cy * size + size - 1; y >= cy * size; --y) {
+                    for (int z = cz * size; z < (cz + 1) * size; ++z) {
+                        for (int x = cx * size; x < (cx + 1) * size; ++x) {
+                            BlockType t = m_blocks[x + 16 * y + 16 * 256 * z];
+                            if (isOpaqueBlock(t)) {
+                                ++opaque;
+                                if (topOpaque == EMPTY) topOpaque = t;
+                            } else if (t != EMPTY) {
+                                ++clear;
+                                if (topClear == EMPTY) topClear = t;
+                            }
+                        }
+                    }
+                }
+                BlockType &cell = cells[cx + n * cy + n * h * cz];
+                if (2 * opaque >= volume) {
+                    cell = topOpaque;
+                } else if (2 * (opaque + clear) >= volume) {
+                    cell = topClear;
+                }
+            }
+        }
+    }
+    // Everything below works from the cells
+    lock.unlock();
+
+    MeshScratchPool::recycle(m_lodData);
+    MeshScratchPool::recycle(m_lodTData);
+    // Surface area shrinks with the square of the cell size
+    m_lodData = MeshScratchPool::acquire(m_lastDataSize / (size * size));
+    m_lodTData = MeshScratchPool::acquire(m_lastTDataSize / (size * size));
+
+    auto cellAt = [&](int x, int y, int z) {
+        return cells[x + n * y + n * h * z];
+    };
+
+    for (int cz = 0; cz < n; ++cz) {
+        for (int cy = 0; cy < h; ++cy) {
+            for (int cx = 0; cx < n; ++cx) {
+                BlockType t = cellAt(cx, cy, cz);
+                if (t == EMPTY) {
+                    continue;
+                }
+                bool opaque = isOpaqueBlock(t);
+                glm::vec4 origin(this->X + cx * size, cy * size, this->Z + cz * size, 1.f);
+                // Only the top cell of a column gets a skirt, since that is
+                // where neighbouring LODs can disagree about the surface height
+                bool surface = cy == h - 1 || !isOpaqueBlock(cellAt(cx, cy + 1, cz));
+
+                for (const CubeFace &face : cubeFaces) {
+                    glm::ivec3 p = glm::ivec3(cx, cy, cz) + face.offset;
+                    float skirt = 0.f;
+                    if (p.y < 0) {
+                        continue;
+                    } else if (p.y >= h) {
+                        // Open sky above
+                    } else if (p.x < 0 || p.x >= n || p.z < 0 || p.z >= n) {
+                        // Chunk border: the neighbor may be drawn at another
+                        // LOD, so close the surface off with a skirt
+                        if (!opaque || !surface) {
+                            continue;
+                        }
+                        skirt = LOD_SKIRT_DEPTH;
+                    } else {
+                        BlockType other = cellAt(p.x, p.y, p.z);
+                        if (opaque ? isOpaqueBlock(other) : other != EMPTY) {
+                            continue;
+                        }
+                    }
+                    glm::vec4 uv = getUVs(t, face.dir);
+                    pushLodFace(opaque ? m_lodData : m_lodTData, face, origin,
+                                static_cast<float>(size), skirt, uv);
+                }
+            }
+        }
+    }
+    m_builtLod = level;
+}
 
-void Chunk::pushIndexForFace(std::vector<GLuint>&idx, int index)
+// Layer of the atlas tile in the given column and row, counted in tiles
+// from the atlas' lower-left corner. Animated tiles scroll sideways through
+// the two tiles to their right.
+static glm::vec4 atlasTile(int column, int row, bool animated = false)
 {
-    idx.push_back(index);
-    idx.push_back(index + 1);
-    idx.push_back(index + 2);
-    idx.push_back(index);
-    idx.push_back(index + 2);
-    idx.push_back(index + 3);
+    return glm::vec4(0.f, 0.f, static_cast<float>(row * ATLAS_TILES_PER_SIDE + column), animated ? 1.f : 0.f);
 }
 
-glm::vec4 Chunk::getUVs(BlockType &type, Direction face)
+glm::vec4 Chunk::getUVs(BlockType type, Direction face)
 {
     if (type == DIRT) {
-        return glm::vec4(2.f, 15.f, 0.f, 0.f) / 16.f;
+        return atlasTile(2, 15);
     } else if (type == STONE) {
-        return glm::vec4(1.f, 15.f, 0.f, 0.f) / 16.f;
+        return atlasTile(1, 15);
     } else if (type == GRASS) {
         if (face == YPOS) {
-            return glm::vec4(8.f, 13.f, 0.f, 0.f) / 16.f;
+            return atlasTile(8, 13);
         } else {
-            return glm::vec4(3.f, 15.f, 0.f, 0.f) / 16.f;
+            return atlasTile(3, 15);
         }
     } else if (type == LAVA) {
-        return glm::vec4(13.f, 1.f, 0.f, 0.f) / 16.f;
+        return atlasTile(13, 1, true);
     } else if (type == WATER) {
-        return glm::vec4(13.f, 3.f, 0.f, 0.f) / 16.f;
+        return atlasTile(13, 3, true);
     } else if (type == ICE) {
-        return glm::vec4(3.f, 11.f, 0.f, 0.f) / 16.f;
+        return atlasTile(3, 11);
     } else if (type == SNOW) {
-        return glm::vec4(2.f, 11.f, 0.f, 0.f) / 16.f;
+        return atlasTile(2, 11);
     } else if (type == SPIRE) {
-        return glm::vec4(8.f, 4.f, 0.f, 0.f) / 16.f;
+        return atlasTile(8, 4);
     } else if (type == SPIRE_TOP) {
         if (face == YPOS) {
-            return glm::vec4(9.f, 5.f, 0.f, 0.f) / 16.f;
+            return atlasTile(9, 5);
         } else {
-            return glm::vec4(8.f, 5.f, 0.f, 0.f) / 16.f;
+            return atlasTile(8, 5);
         }
     } else {
         return glm::vec4(0.f);
     }
 }
 
-void Chunk::bufferToDrawableVBOs()
+void Chunk::bufferToDrawableVBOs(MeshBuffer &buffer)
 {
-    m_count = this->idx.size();
-    // Generate index buffer
-    generateIdx();
-    // Bind index buffer
-    bindIdx();
-    // Buffer index data
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, elemCountOpaque() * sizeof (GLuint), this->idx.data(), GL_STATIC_DRAW);
-    // Generate data buffer
-    generateAllOpaque();
-    // Bind data buffer
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_buffAllOpaque);
-//    bindAllOpaque();
-    // Buffer data to GPU
-    mp_context->glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(glm::vec4), this->data.data(), GL_STATIC_DRAW);
-}
-
-void Chunk::bufferTransparentDrawableVBOs()
+    // Rewrites the previous mesh's space in place when the new one still fits.
+    // Indices come from the buffer's shared quad pattern.
+    buffer.upload(m_opaqueRange, this->data);
+    m_count = m_opaqueRange.indexCount;
+    // Visibility follows the mesh that is actually on screen
+    m_sectionLinks = m_builtSectionLinks;
+    m_minY = m_builtMinY;
+    m_maxY = m_builtMaxY;
+    // The GPU has its own copy now; hand the memory on to the next Chunk
+    MeshScratchPool::recycle(this->data);
+}
+
+void Chunk::bufferTransparentDrawableVBOs(MeshBuffer &buffer)
+{
+    buffer.upload(m_transparentRange, this->tData);
+    m_count_t = m_transparentRange.indexCount;
+    MeshScratchPool::recycle(this->tData);
+}
+
+void Chunk::bufferLodVBOs(MeshBuffer &opaque, MeshBuffer &transparent)
+{
+    opaque.upload(m_lodRange, m_lodData);
+    transparent.upload(m_lodTransparentRange, m_lodTData);
+    MeshScratchPool::recycle(m_lodData);
+    MeshScratchPool::recycle(m_lodTData);
+    m_lodLevel = m_builtLod;
+    m_lodPending = false;
+}
+
+void Chunk::releaseLod(MeshBuffer &opaque, MeshBuffer &transparent)
+{
+    opaque.release(m_lodRange);
+    transparent.release(m_lodTransparentRange);
+    m_lodLevel = 0;
+    m_lodStale = false;
+}
+
+int Chunk::lodLevel() const
+{
+    return m_lodLevel;
+}
+
+int Chunk::wantedLod() const
+{
+    return m_wantedLod;
+}
+
+void Chunk::setWantedLod(int level)
+{
+    m_wantedLod = level;
+}
+
+bool Chunk::isLodPending() const
+{
+    return m_lodPending;
+}
+
+void Chunk::setLodPending()
 {
-    m_count_t = this->tIdx.size();
-    // Generate index buffer
-    generateIdxTransparent();
-    // Bind index buffer
-    bindIdxTransparent();
-    // Buffer index data
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, elemCountTransparent() * sizeof (GLuint), this->tIdx.data(), GL_STATIC_DRAW);
-    // Generate data buffer
-    generateAllTransparent();
-    // Bind data buffer
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_buffAllTransparent);
-//    bindAllTransparent();
-    // Buffer data to GPU
-    mp_context->glBufferData(GL_ARRAY_BUFFER, tData.size() * sizeof(glm::vec4), this->tData.data(), GL_STATIC_DRAW);
+    m_lodPending = true;
+    m_lodStale = false;
+}
+
+void Chunk::markLodStale()
+{
+    m_lodStale = true;
+}
+
+bool Chunk::isLodStale() const
+{
+    return m_lodStale;
+}
+
+const MeshRange& Chunk::lodRange() const
+{
+    return m_lodRange;
+}
+
+const MeshRange& Chunk::lodTransparentRange() const
+{
+    return m_lodTransparentRange;
+}
+
+const MeshRange& Chunk::opaqueRange() const
+{
+    return m_opaqueRange;
+}
+
+const MeshRange& Chunk::transparentRange() const
+{
+    return m_transparentRange;
 }
 
 void Chunk::clearIdxBuffers() {
-    idx.clear();
-    data.clear();
-    tIdx.clear();
-    tData.clear();
+    MeshScratchPool::recycle(data);
+    MeshScratchPool::recycle(tData);
 }
 
 bool Chunk::hasXPOSneighbor() { return m_neighbors.at(XPOS) != nullptr; }
@@ -549,4 +815,12 @@ bool Chunk::hasXNEGneighbor() { return m_neighbors.at(XNEG) != nullptr; }
 bool Chunk::hasZPOSneighbor() { return m_neighbors.at(ZPOS) != nullptr; }
 bool Chunk::hasZNEGneighbor() { return m_neighbors.at(ZNEG) != nullptr; }
 
+glm::vec3 Chunk::boundsMin() const
+{
+    return glm::vec3(X, m_minY, Z);
+}
 
+glm::vec3 Chunk::boundsMax() const
+{
+    return glm::vec3(X + 16, m_maxY, Z + 16);
+}
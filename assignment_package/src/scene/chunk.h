@@ -2,9 +2,12 @@
 #include "smartpointerhelp.h"
 #include "glm_includes.h"
 #include "drawable.h"
+#include "meshbuffer.h"
 #include <array>
 #include <unordered_map>
 #include <cstddef>
+#include <mutex>
+#include <shared_mutex>
 #include "texture.h"
 
 
@@ -43,6 +46,49 @@ const static std::unordered_map<Direction, Direction, EnumHash> oppositeDirectio
     {ZNEG, ZPOS}
 };
 
+// Every Chunk vertex is three interleaved vec4s: position, normal and UV.
+// The UV is local to one atlas tile and carries the tile's texture array
+// layer in z; see Chunk::getUVs. The normal's w holds the baked light of
+// the face (see Chunk::faceLight) plus 256 times the vertex's ambient
+// occlusion, from 0 to 3 solid blocks around it; it is 0 for meshes
+// without any.
+const static GLsizei CHUNK_VERTEX_STRIDE = 3 * sizeof(glm::vec4);
+
+// Keeps the large vertex vectors Chunks mesh into alive between uses, so
+// meshing a Chunk takes over memory some earlier Chunk already allocated
+// instead of growing a brand new vector one push_back at a time.
+// Shared by every meshing thread.
+class MeshScratchPool
+{
+private:
+    static std::mutex s_mutex;
+    static std::vector<std::vector<glm::vec4>> s_free;
+    // Extra buffers beyond this are freed rather than kept
+    const static size_t MAX_POOLED = 32;
+
+public:
+    // An empty vector with at least predictedSize capacity
+    static std::vector<glm::vec4> acquire(size_t predictedSize);
+    // Takes buffer's memory back into the pool, leaving buffer empty
+    // with no capacity
+    static void recycle(std::vector<glm::vec4> &buffer);
+};
+
+// Blocks in one 16 x 256 x 16 Chunk
+#define CHUNK_BLOCK_COUNT (16 * 256 * 16)
+
+// Chunks are split vertically into 16 x 16 x 16 sections for visibility
+#define CHUNK_SECTION_HEIGHT 16
+#define CHUNK_SECTION_COUNT (256 / CHUNK_SECTION_HEIGHT)
+
+// Faces of one section, as a bit per Direction
+typedef unsigned char FaceMask;
+const static FaceMask ALL_FACES = 0x3F;
+
+// How far below its top a LOD mesh's border faces extend, in blocks.
+// Covers the largest height step between two neighboring LODs.
+const static float LOD_SKIRT_DEPTH = 8.f;
+
 // One Chunk is a 16 x 256 x 16 section of the world,
 // containing all the Minecraft blocks in that area.
 // We divide the world into Chunks in order to make
@@ -54,30 +100,119 @@ const static std::unordered_map<Direction, Direction, EnumHash> oppositeDirectio
 class Chunk : public Drawable
 {
 private:
-    // Solid block data
-    std::vector<GLuint> idx;
+    // Solid block data, four interleaved vertices per face.
+    // No index lists are kept; every face uses the shared quad pattern.
     std::vector<glm::vec4> data;
 
     // Transparent block data
-    std::vector<GLuint> tIdx;
     std::vector<glm::vec4> tData;
+    // Both are only populated between create() and being uploaded
+
+    // Sizes of the last meshes built, used to reserve for the next rebuild
+    size_t m_lastDataSize;
+    size_t m_lastTDataSize;
+
+    // Vertical extent of the uploaded geometry. The bounds are inverted
+    // (min above max) while the Chunk has no faces at all. Like the section
+    // links, create() works out m_builtMinY and m_builtMaxY on a worker
+    // thread and they are only published when the mesh is uploaded.
+    float m_minY;
+    float m_maxY;
+    float m_builtMinY;
+    float m_builtMaxY;
+
+    // For every section and every face of it, the faces that can be reached
+    // from that face through empty or transparent blocks. The Terrain reads
+    // m_sectionLinks; m_builtSectionLinks is filled in by create() on a
+    // worker thread and only published when the mesh is uploaded.
+    std::array<std::array<FaceMask, 6>, CHUNK_SECTION_COUNT> m_sectionLinks;
+    std::array<std::array<FaceMask, 6>, CHUNK_SECTION_COUNT> m_builtSectionLinks;
+    void buildSectionLinks();
+
+    // The block at (x, y, z) in Chunk-local coordinates, which may lie one
+    // step outside this Chunk in X and Z, diagonals included. EMPTY where
+    // there is no Chunk yet.
+    BlockType blockNear(int x, int y, int z) const;
+    // Appends the face of block (x, y, z) pointing in dir, with its baked
+    // light and, if occluded, per-vertex ambient occlusion
+    void pushFace(std::vector<glm::vec4> &out, BlockType t, int x, int y, int z,
+                  Direction dir, bool occluded) const;
 
     // All of the blocks contained within this Chunk
-    std::array<BlockType, 65536> m_blocks;
+    std::array<BlockType, CHUNK_BLOCK_COUNT> m_blocks;
+    // Guards m_blocks between threads. Writers hold it exclusively around
+    // their writes; whatever reads the blocks off the GL thread holds it
+    // shared for as long as it reads. Never held while taking another one
+    // except by lockBlocksAround(), which takes them in a fixed order.
+    mutable std::shared_mutex m_blocksMutex;
+    // Light level of every block, sky light in the high four bits and
+    // block light in the low four. Laid out like m_blocks.
+    std::array<unsigned char, CHUNK_BLOCK_COUNT> m_light;
+    // Set on the GL thread once m_light is complete and joined up with the
+    // neighbors; light only spreads between Chunks that both have it
+    bool m_lightReady;
+    // Fluid level of every flowing WATER or LAVA block, by index into
+    // m_blocks. Sources, which is what every generated fluid block is,
+    // are left out, so still water takes no room here.
+    std::unordered_map<int, unsigned char> m_fluidLevels;
     // This Chunk's four neighbors to the north, south, east, and west
     // The third input to this map just lets us use a Direction as
     // a key for this map.
     // These allow us to properly determine
     std::unordered_map<Direction, Chunk*, EnumHash> m_neighbors;
 
-    glm::vec4 getUVs(BlockType &type, Direction face);
-    void pushIndexForFace(std::vector<GLuint>&idx, int index);
+    // Where this Chunk's geometry lives inside the Terrain's shared MeshBuffers
+    MeshRange m_opaqueRange;
+    MeshRange m_transparentRange;
+
+    // Downsampled geometry for drawing this Chunk from far away. At LOD
+    // level n each 2^n x 2^n x 2^n cell of blocks becomes a single cube.
+    // Only one level is kept at a time; level 0 means full detail.
+    std::vector<glm::vec4> m_lodData;
+    std::vector<glm::vec4> m_lodTData;
+    MeshRange m_lodRange;
+    MeshRange m_lodTransparentRange;
+    int m_lodLevel;    // Level currently uploaded to m_lodRange
+    int m_builtLod;    // Level sitting in m_lodData waiting to be uploaded
+    int m_wantedLod;   // Level the Terrain last asked to draw this Chunk at
+    bool m_lodPending; // A worker is building m_lodData
+    bool m_lodStale;   // The blocks changed since the current LOD was built
+
 public:
-    // Set up buffer for solid blocks
-    void bufferToDrawableVBOs();
-    // Set up buffer for transparent blocks
-    void bufferTransparentDrawableVBOs();
-    // Clear buffers
+    // Texture used for the given face of a block of this type: the
+    // lower-left UV of its tile, the tile's layer in the atlas array in z,
+    // and 1 in w if the tile is animated
+    static glm::vec4 getUVs(BlockType type, Direction face);
+    // Upload solid block geometry into the shared opaque buffer
+    void bufferToDrawableVBOs(MeshBuffer &buffer);
+    // Upload transparent block geometry into the shared transparent buffer
+    void bufferTransparentDrawableVBOs(MeshBuffer &buffer);
+    // Build the LOD mesh for the given level (1 to 3) on a worker thread
+    void createLod(int level);
+    // Upload the mesh createLod built and make it the current LOD
+    void bufferLodVBOs(MeshBuffer &opaque, MeshBuffer &transparent);
+    // Drop the LOD mesh once the Chunk is close enough for full detail
+    void releaseLod(MeshBuffer &opaque, MeshBuffer &transparent);
+    int lodLevel() const;
+    int wantedLod() const;
+    void setWantedLod(int level);
+    bool isLodPending() const;
+    // Also clears the stale flag, since the build reads the blocks as they are now
+    void setLodPending();
+    // Flags the LOD for a rebuild after an edit, even at an unchanged level
+    void markLodStale();
+    bool isLodStale() const;
+    const MeshRange& lodRange() const;
+    const MeshRange& lodTransparentRange() const;
+    const MeshRange& opaqueRange() const;
+    const MeshRange& transparentRange() const;
+    // Faces of the given section reachable from its face entry. Until the
+    // Chunk is first meshed every face is assumed to reach every other.
+    FaceMask sectionLinks(int section, Direction entry) const;
+    // World-space box around the geometry last uploaded
+    glm::vec3 boundsMin() const;
+    glm::vec3 boundsMax() const;
+    // Release the CPU-side mesh data
     void clearIdxBuffers();
     // Chunk's lower-left corner X and Z coordinates according to world
     int X;
@@ -90,8 +225,43 @@ public:
 
     BlockType getBlockAt(unsigned int X, unsigned int y, unsigned int Z) const;
     BlockType getBlockAt(int X, int y, int Z) const;
+    // Callers must hold writeBlocks() if any other thread could be reading
     void setBlockAt(unsigned int X, unsigned int y, unsigned int Z, BlockType t);
+    // All CHUNK_BLOCK_COUNT blocks at once, for saving and loading
+    const BlockType* blocks() const;
+    void setBlocks(const BlockType *blocks);
+    // Locks on m_blocks: shared for reading them off the GL thread, and
+    // exclusive for writing them
+    std::shared_lock<std::shared_mutex> readBlocks() const;
+    std::unique_lock<std::shared_mutex> writeBlocks();
+    // Shared locks on the blocks of this Chunk and of every Chunk around
+    // it, diagonals included, which is what meshing reads. Taken in address
+    // order, so readers of overlapping Chunks never wait on each other.
+    std::vector<std::shared_lock<std::shared_mutex>> lockBlocksAround() const;
     void linkNeighbor(uPtr<Chunk> &neighbor, Direction dir);
+    // Clears this Chunk from its neighbors and them from it
+    void unlinkNeighbors();
+    // The adjacent Chunk in a horizontal direction, or null
+    Chunk* neighbor(Direction dir) const;
+
+    // Light levels from 0 to 15, in Chunk-local coordinates
+    unsigned char getSkyLight(int x, int y, int z) const;
+    unsigned char getBlockLight(int x, int y, int z) const;
+    void setSkyLight(int x, int y, int z, unsigned char level);
+    void setBlockLight(int x, int y, int z, unsigned char level);
+    // Both levels at once, as stored
+    unsigned char* lightData();
+    bool isLightReady() const;
+    void setLightReady();
+    // How far the fluid in block (x, y, z) has flowed from its source; 0
+    // for a source or anything that is not fluid
+    unsigned char getFluidLevel(int x, int y, int z) const;
+    void setFluidLevel(int x, int y, int z, unsigned char level);
+    // Every nonzero fluid level by index into the blocks, for saving
+    const std::unordered_map<int, unsigned char>& fluidLevels() const;
+    // The light falling on the face of block (x, y, z) pointing in dir,
+    // packed for the vertex normal's w: 1 + 16 * sky + block
+    float faceLight(int x, int y, int z, Direction dir) const;
 
     bool hasXPOSneighbor();
     bool hasXNEGneighbor();
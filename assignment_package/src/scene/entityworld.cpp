@@ -0,0 +1,394 @@
+#include "entityworld.h"
+#include "terrain.h"
+#include <algorithm>
+#include <thread>
+
+const static uint32_t NO_SLOT = 0xffffffff;
+
+const static glm::vec3 MOB_HALF_SIZE(0.3f, 0.8f, 0.3f);
+const static glm::vec3 ITEM_HALF_SIZE(0.125f);
+const static float GRAVITY = 25.f;
+const static float TERMINAL_VELOCITY = 50.f;
+const static float MOB_SPEED = 2.f;
+const static float JUMP_SPEED = 8.f;
+// Rate at which items on the ground and anything in fluid slow down
+const static float ITEM_GROUND_FRICTION = 8.f;
+const static float FLUID_DRAG = 3.f;
+// Fraction of gravity fluid pushes back up with
+const static float BUOYANCY = 0.8f;
+// Farthest an entity moves along an axis in one tick, which keeps the
+// blocks it may touch few and stops it from tunneling through walls
+const static float MAX_STEP = 0.9f;
+const static float ITEM_LIFETIME = 300.f;
+const static float PICKUP_RADIUS = 1.5f;
+// Keeps an item from being picked up in the same moment it drops
+const static float PICKUP_DELAY = 0.5f;
+// Keeps boxes resting exactly on a face from counting as inside the block
+const static float EPSILON = 0.001f;
+
+static uint32_t hash(uint32_t a, uint32_t b)
+{
+    uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// Maps a hash to [0, 1)
+static float unitFloat(uint32_t h)
+{
+    return (h & 0xFFFFFF) / 16777216.f;
+}
+
+static bool isSolid(BlockType t)
+{
+    return t != EMPTY && t != WATER && t != LAVA;
+}
+
+static int64_t bucketKey(glm::vec3 p)
+{
+    return toKey(static_cast<int>(glm::floor(p.x)) & ~15, static_cast<int>(glm::floor(p.z)) & ~15);
+}
+
+EntityWorld::EntityWorld()
+    : m_position(), m_velocity(), m_halfSize(), m_kind(), m_itemType(), m_onGround(),
+      m_age(), m_wanderTimer(), m_heading(), m_ids(), m_slots(), m_freeIds(),
+      m_pendingDespawn(), m_buckets(), m_scratch(1), m_tick(0), m_itemsCollected(0)
+{}
+
+EntityId EntityWorld::spawn(glm::vec3 pos, glm::vec3 velocity, glm::vec3 halfSize, EntityKind kind, BlockType itemType)
+{
+    EntityId id;
+    if (m_freeIds.empty()) {
+        id = static_cast<EntityId>(m_slots.size());
+        m_slots.push_back(NO_SLOT);
+    } else {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    m_slots[id] = static_cast<uint32_t>(m_ids.size());
+    m_position.push_back(pos);
+    m_velocity.push_back(velocity);
+    m_halfSize.push_back(halfSize);
+    m_kind.push_back(kind);
+    m_itemType.push_back(itemType);
+    m_onGround.push_back(false);
+    m_age.push_back(0.f);
+    m_wanderTimer.push_back(0.f);
+    m_heading.push_back(glm::vec2(0.f));
+    m_ids.push_back(id);
+    return id;
+}
+
+EntityId EntityWorld::spawnMob(glm::vec3 pos)
+{
+    return spawn(pos, glm::vec3(0.f), MOB_HALF_SIZE, MOB, EMPTY);
+}
+
+EntityId EntityWorld::spawnItem(glm::vec3 pos, BlockType type, glm::vec3 velocity)
+{
+    return spawn(pos, velocity, ITEM_HALF_SIZE, ITEM, type);
+}
+
+void EntityWorld::despawn(EntityId id)
+{
+    if (id < m_slots.size() && m_slots[id] != NO_SLOT) {
+        m_pendingDespawn.push_back(id);
+    }
+}
+
+void EntityWorld::removeSlot(uint32_t slot)
+{
+    EntityId removed = m_ids[slot];
+    uint32_t last = static_cast<uint32_t>(m_ids.size() - 1);
+    if (slot != last) {
+        m_position[slot] = m_position[last];
+        m_velocity[slot] = m_velocity[last];
+        m_halfSize[slot] = m_halfSize[last];
+        m_kind[slot] = m_kind[last];
+        m_itemType[slot] = m_itemType[last];
+        m_onGround[slot] = m_onGround[last];
+        m_age[slot] = m_age[last];
+        m_wanderTimer[slot] = m_wanderTimer[last];
+        m_heading[slot] = m_heading[last];
+        m_ids[slot] = m_ids[last];
+        m_slots[m_ids[slot]] = slot;
+    }
+    m_position.pop_back();
+    m_velocity.pop_back();
+    m_halfSize.pop_back();
+    m_kind.pop_back();
+    m_itemType.pop_back();
+    m_onGround.pop_back();
+    m_age.pop_back();
+    m_wanderTimer.pop_back();
+    m_heading.pop_back();
+    m_ids.pop_back();
+    m_slots[removed] = NO_SLOT;
+    m_freeIds.push_back(removed);
+}
+
+void EntityWorld::steer(uint32_t begin, uint32_t end, float dT)
+{
+    float groundFriction = glm::exp(-ITEM_GROUND_FRICTION * dT);
+    for (uint32_t i = begin; i < end; ++i) {
+        m_age[i] += dT;
+        glm::vec3 &v = m_velocity[i];
+        if (m_kind[i] == MOB) {
+            m_wanderTimer[i] -= dT;
+            if (m_wanderTimer[i] <= 0.f) {
+                // Hashed rather than drawn from a shared generator, so any
+                // thread can pick for any mob
+                uint32_t h = hash(m_ids[i], static_cast<uint32_t>(m_tick));
+                if (h % 10 < 3) {
+                    m_heading[i] = glm::vec2(0.f);
+                } else {
+                    float angle = unitFloat(hash(h, 1)) * 6.2831853f;
+                    m_heading[i] = MOB_SPEED * glm::vec2(glm::cos(angle), glm::sin(angle));
+                }
+                m_wanderTimer[i] = 2.f + 4.f * unitFloat(hash(h, 2));
+            }
+            v.x = m_heading[i].x;
+            v.z = m_heading[i].y;
+        } else if (m_onGround[i]) {
+            v.x *= groundFriction;
+            v.z *= groundFriction;
+        }
+    }
+}
+
+void EntityWorld::integrate(uint32_t begin, uint32_t end, float dT)
+{
+    for (uint32_t i = begin; i < end; ++i) {
+        m_velocity[i].y = glm::max(m_velocity[i].y - GRAVITY * dT, -TERMINAL_VELOCITY);
+    }
+}
+
+void EntityWorld::collide(uint32_t begin, uint32_t end, float dT, const Terrain &terrain, Scratch &scratch)
+{
+    // Gather the blocks every entity of the range could touch this tick,
+    // and fetch all of them at once
+    scratch.voxels.clear();
+    scratch.boxMin.clear();
+    scratch.boxSize.clear();
+    for (uint32_t i = begin; i < end; ++i) {
+        glm::vec3 move = glm::clamp(m_velocity[i] * dT, -MAX_STEP, MAX_STEP);
+        glm::vec3 lo = m_position[i] - m_halfSize[i];
+        glm::vec3 hi = m_position[i] + m_halfSize[i];
+        glm::ivec3 boxMin = glm::ivec3(glm::floor(glm::min(lo, lo + move)));
+        glm::ivec3 boxMax = glm::ivec3(glm::floor(glm::max(hi, hi + move)));
+        // Buoyancy, applied below once the block it is in is known, only
+        // ever speeds it up upward, and by far less than a block a tick
+        boxMax.y += 1;
+        glm::ivec3 size = boxMax - boxMin + 1;
+        scratch.boxMin.push_back(boxMin);
+        scratch.boxSize.push_back(glm::ivec4(size, static_cast<int>(scratch.voxels.size())));
+        for (int z = 0; z < size.z; ++z) {
+            for (int y = 0; y < size.y; ++y) {
+                for (int x = 0; x < size.x; ++x) {
+                    scratch.voxels.push_back(boxMin + glm::ivec3(x, y, z));
+                }
+            }
+        }
+    }
+    scratch.blocks.resize(scratch.voxels.size());
+    // Unloaded space is a wall, so nothing falls out of the world
+    terrain.getBlocksAt(scratch.voxels.data(), scratch.voxels.size(), scratch.blocks.data(), STONE);
+
+    for (uint32_t i = begin; i < end; ++i) {
+        const glm::ivec3 &boxMin = scratch.boxMin[i - begin];
+        const glm::ivec4 &boxSize = scratch.boxSize[i - begin];
+        auto blockAt = [&](glm::ivec3 p) {
+            glm::ivec3 d = p - boxMin;
+            return scratch.blocks[boxSize.w + d.x + boxSize.x * (d.y + boxSize.y * d.z)];
+        };
+
+        glm::vec3 &v = m_velocity[i];
+        BlockType inside = blockAt(glm::ivec3(glm::floor(m_position[i])));
+        if (inside == WATER || inside == LAVA) {
+            v *= glm::exp(-FLUID_DRAG * dT);
+            v.y += GRAVITY * BUOYANCY * dT;
+        }
+
+        glm::vec3 lo = m_position[i] - m_halfSize[i];
+        glm::vec3 hi = m_position[i] + m_halfSize[i];
+        glm::vec3 move = glm::clamp(v * dT, -MAX_STEP, MAX_STEP);
+        // Never past the blocks gathered for it
+        glm::vec3 gatheredLo = glm::vec3(boxMin);
+        glm::vec3 gatheredHi = glm::vec3(boxMin + glm::ivec3(boxSize));
+        move = glm::clamp(move, gatheredLo - lo, gatheredHi - hi);
+        bool onGround = false;
+        bool blockedSide = false;
+        // Vertical first, so walking along the ground is not stopped by it
+        for (int axis : {1, 0, 2}) {
+            if (move[axis] == 0.f) {
+                continue;
+            }
+            glm::vec3 movedLo = lo;
+            glm::vec3 movedHi = hi;
+            movedLo[axis] += move[axis];
+            movedHi[axis] += move[axis];
+            glm::ivec3 from = glm::ivec3(glm::floor(movedLo + EPSILON));
+            glm::ivec3 to = glm::ivec3(glm::floor(movedHi - EPSILON));
+            float allowed = move[axis];
+            for (int z = from.z; z <= to.z; ++z) {
+                for (int y = from.y; y <= to.y; ++y) {
+                    for (int x = from.x; x <= to.x; ++x) {
+                        glm::ivec3 p(x, y, z);
+                        if (!isSolid(blockAt(p))) {
+                            continue;
+                        }
+                        // Blocks the box already overlaps are let go of,
+                        // so an entity a block was placed on can get out
+                        if (move[axis] > 0.f && p[axis] >= hi[axis] - EPSILON) {
+                            allowed = glm::min(allowed, glm::max(p[axis] - hi[axis], 0.f));
+                        } else if (move[axis] < 0.f && p[axis] + 1 <= lo[axis] + EPSILON) {
+                            allowed = glm::max(allowed, glm::min(p[axis] + 1 - lo[axis], 0.f));
+                        }
+                    }
+                }
+            }
+            if (allowed != move[axis]) {
+                v[axis] = 0.f;
+                if (axis == 1) {
+                    onGround = onGround || move[axis] < 0.f;
+                } else {
+                    blockedSide = true;
+                }
+            }
+            lo[axis] += allowed;
+            hi[axis] += allowed;
+        }
+        m_position[i] = (lo + hi) * 0.5f;
+        m_onGround[i] = onGround;
+        // Mobs hop up anything a block high that they walk into
+        if (m_kind[i] == MOB && blockedSide && onGround) {
+            v.y = JUMP_SPEED;
+        }
+    }
+}
+
+void EntityWorld::rebuildBuckets()
+{
+    for (auto &bucket : m_buckets) {
+        bucket.second.clear();
+    }
+    for (uint32_t i = 0; i < m_ids.size(); ++i) {
+        m_buckets[bucketKey(m_position[i])].push_back(i);
+    }
+    for (auto it = m_buckets.begin(); it != m_buckets.end();) {
+        it = it->second.empty() ? m_buckets.erase(it) : std::next(it);
+    }
+}
+
+void EntityWorld::tick(float dT, const Terrain &terrain, glm::vec3 playerPos)
+{
+    for (EntityId id : m_pendingDespawn) {
+        if (m_slots[id] != NO_SLOT) {
+            removeSlot(m_slots[id]);
+        }
+    }
+    m_pendingDespawn.clear();
+
+    uint32_t count = static_cast<uint32_t>(m_ids.size());
+    uint32_t threadCount = std::min(count / MIN_ENTITIES_PER_THREAD,
+                                    std::max(1u, std::thread::hardware_concurrency()));
+    threadCount = std::max(threadCount, 1u);
+    m_scratch.resize(std::max<size_t>(m_scratch.size(), threadCount));
+    auto runRange = [this, dT, &terrain](uint32_t begin, uint32_t end, Scratch &scratch) {
+        steer(begin, end, dT);
+        integrate(begin, end, dT);
+        collide(begin, end, dT, terrain, scratch);
+    };
+    if (threadCount == 1) {
+        runRange(0, count, m_scratch[0]);
+    } else {
+        // Each slot is only ever touched by the thread whose range holds it
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; ++t) {
+            uint32_t begin = count * t / threadCount;
+            uint32_t end = count * (t + 1) / threadCount;
+            threads.emplace_back(runRange, begin, end, std::ref(m_scratch[t]));
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    rebuildBuckets();
+
+    std::vector<EntityId> nearby;
+    entitiesNear(playerPos, PICKUP_RADIUS, nearby);
+    for (EntityId id : nearby) {
+        uint32_t slot = m_slots[id];
+        if (m_kind[slot] == ITEM && m_age[slot] > PICKUP_DELAY) {
+            despawn(id);
+            ++m_itemsCollected;
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (m_kind[i] == ITEM && m_age[i] > ITEM_LIFETIME) {
+            despawn(m_ids[i]);
+        }
+    }
+    ++m_tick;
+}
+
+void EntityWorld::entitiesNear(glm::vec3 p, float radius, std::vector<EntityId> &out) const
+{
+    int xMin = static_cast<int>(glm::floor(p.x - radius)) & ~15;
+    int xMax = static_cast<int>(glm::floor(p.x + radius)) & ~15;
+    int zMin = static_cast<int>(glm::floor(p.z - radius)) & ~15;
+    int zMax = static_cast<int>(glm::floor(p.z + radius)) & ~15;
+    for (int x = xMin; x <= xMax; x += 16) {
+        for (int z = zMin; z <= zMax; z += 16) {
+            auto bucket = m_buckets.find(toKey(x, z));
+            if (bucket == m_buckets.end()) {
+                continue;
+            }
+            for (uint32_t slot : bucket->second) {
+                glm::vec3 d = m_position[slot] - p;
+                if (glm::dot(d, d) <= radius * radius) {
+                    out.push_back(m_ids[slot]);
+                }
+            }
+        }
+    }
+}
+
+void EntityWorld::fillInstances(glm::vec3 eye, std::vector<glm::vec4> &out) const
+{
+    out.clear();
+    // Whole Chunks out of range are skipped without looking at their
+    // entities; 12 covers the distance from a Chunk's center to its corners
+    float chunkRange = ENTITY_DRAW_DISTANCE + 12.f;
+    for (const auto &bucket : m_buckets) {
+        glm::vec3 first = m_position[bucket.second.front()];
+        glm::vec2 center = glm::floor(glm::vec2(first.x, first.z) / 16.f) * 16.f + 8.f;
+        glm::vec2 toChunk = center - glm::vec2(eye.x, eye.z);
+        if (glm::dot(toChunk, toChunk) > chunkRange * chunkRange) {
+            continue;
+        }
+        for (uint32_t slot : bucket.second) {
+            glm::vec3 d = m_position[slot] - eye;
+            if (glm::dot(d, d) > ENTITY_DRAW_DISTANCE * ENTITY_DRAW_DISTANCE) {
+                continue;
+            }
+            out.push_back(glm::vec4(m_position[slot], static_cast<float>(m_kind[slot])));
+            out.push_back(glm::vec4(m_halfSize[slot], static_cast<float>(m_itemType[slot])));
+        }
+    }
+}
+
+size_t EntityWorld::count() const
+{
+    return m_ids.size();
+}
+
+int EntityWorld::itemsCollected() const
+{
+    return m_itemsCollected;
+}
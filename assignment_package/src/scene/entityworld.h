@@ -0,0 +1,106 @@
+#pragma once
+#include "glm_includes.h"
+#include "chunk.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Terrain;
+
+typedef uint32_t EntityId;
+
+enum EntityKind : unsigned char {
+    MOB, ITEM
+};
+
+// Below this many entities per thread the systems are not worth splitting
+#define MIN_ENTITIES_PER_THREAD 2048
+// Entities further than this from the camera are not drawn
+#define ENTITY_DRAW_DISTANCE 128.f
+
+// Mobs and dropped items. Unlike the Player, which is a single Entity
+// driven by input, these come in the thousands, so they are kept as
+// components: one dense array per field, every array indexed alike, with
+// an entity's slot moving when another is removed. Each tick runs as
+// systems over those arrays: wandering and friction, gravity and
+// integration, then collision against the terrain. They touch nothing but
+// the slots they are given, so a large population is split into ranges
+// run on threads of their own.
+//
+// Collision asks Terrain for every block around every entity of a range
+// in one batched query, rather than locking the Chunk map per block. After
+// moving, entities are bucketed by the Chunk they stand in, which is how
+// nearby entities are found and which of them are drawn.
+//
+// Belongs to the simulation thread, which reads Terrain like the Player.
+class EntityWorld
+{
+private:
+    // Components, one entry per live entity
+    std::vector<glm::vec3> m_position;   // Center of the bounding box
+    std::vector<glm::vec3> m_velocity;
+    std::vector<glm::vec3> m_halfSize;   // Of the bounding box
+    std::vector<EntityKind> m_kind;
+    std::vector<BlockType> m_itemType;   // What a dropped item is made of
+    std::vector<unsigned char> m_onGround;
+    std::vector<float> m_age;            // Seconds since spawning
+    std::vector<float> m_wanderTimer;    // Seconds until a mob picks a new heading
+    std::vector<glm::vec2> m_heading;    // Horizontal velocity a mob wants
+    std::vector<EntityId> m_ids;
+
+    // Slot of each id, or NO_SLOT once despawned; freed ids are reused
+    std::vector<uint32_t> m_slots;
+    std::vector<EntityId> m_freeIds;
+    // Despawned at the start of the next tick, so slots stay put until then
+    std::vector<EntityId> m_pendingDespawn;
+
+    // Slots of the entities in each Chunk, by Chunk key; rebuilt every tick
+    std::unordered_map<int64_t, std::vector<uint32_t>> m_buckets;
+
+    // What each thread's range needs for its batched voxel query
+    struct Scratch {
+        std::vector<glm::ivec3> voxels;
+        std::vector<BlockType> blocks;
+        // Per entity: the lowest corner of the blocks it may touch, and
+        // where in voxels they start
+        std::vector<glm::ivec3> boxMin;
+        std::vector<glm::ivec4> boxSize;
+    };
+    std::vector<Scratch> m_scratch;
+
+    int m_tick;
+    int m_itemsCollected;
+
+    EntityId spawn(glm::vec3 pos, glm::vec3 velocity, glm::vec3 halfSize, EntityKind kind, BlockType itemType);
+    // Moves the last slot into slot, keeping the arrays dense
+    void removeSlot(uint32_t slot);
+
+    // The systems, each run over the slots [begin, end)
+    void steer(uint32_t begin, uint32_t end, float dT);
+    void integrate(uint32_t begin, uint32_t end, float dT);
+    void collide(uint32_t begin, uint32_t end, float dT, const Terrain &terrain, Scratch &scratch);
+
+    void rebuildBuckets();
+
+public:
+    EntityWorld();
+
+    EntityId spawnMob(glm::vec3 pos);
+    EntityId spawnItem(glm::vec3 pos, BlockType type, glm::vec3 velocity);
+    // Takes effect at the start of the next tick
+    void despawn(EntityId id);
+
+    // Advances every entity by dT seconds. Dropped items within reach of
+    // the player are picked up.
+    void tick(float dT, const Terrain &terrain, glm::vec3 playerPos);
+
+    // Ids of the entities whose centers are within radius of p
+    void entitiesNear(glm::vec3 p, float radius, std::vector<EntityId> &out) const;
+    // Writes two texels per entity within ENTITY_DRAW_DISTANCE of eye for
+    // the instanced draw: its center and kind, then its half size and, for
+    // items, block type
+    void fillInstances(glm::vec3 eye, std::vector<glm::vec4> &out) const;
+
+    size_t count() const;
+    int itemsCollected() const;
+};
@@ -0,0 +1,256 @@
+#include "farterrain.h"
+#include "terrain.h"
+#include <thread>
+
+FarTile::FarTile(int level, int x, int z)
+    : level(level), x(x), z(z), data(), range(), pending(false), lastUsedTick(0)
+{}
+
+int FarTile::length() const
+{
+    return FAR_TILE_LENGTH << level;
+}
+
+FarTerrain::FarTerrain(OpenGLContext *context, QuadIndexBuffer &quadIndices)
+    : mp_context(context), m_meshes(context, quadIndices, CHUNK_VERTEX_STRIDE),
+      m_commands(), m_tiles(), m_visible(), m_built(), m_builtMutex(), m_builtAdded(), m_tick(0)
+{}
+
+void FarTerrain::create()
+{
+    // Around 600 tiles' worth; grows if needed
+    m_meshes.create(1 << 17);
+}
+
+void FarTerrain::destroy()
+{
+    // Every pending tile is either still with its worker or in m_built
+    size_t pending = 0;
+    for (auto &entry : m_tiles) {
+        if (entry.second->pending) {
+            ++pending;
+        }
+    }
+    std::unique_lock<std::mutex> lock(m_builtMutex);
+    m_builtAdded.wait(lock, [this, pending] { return m_built.size() >= pending; });
+    m_built.clear();
+    lock.unlock();
+
+    m_meshes.destroy();
+    m_visible.clear();
+    m_tiles.clear();
+}
+
+FarTile* FarTerrain::tileAt(int level, int x, int z)
+{
+    uPtr<FarTile> &tile = m_tiles[std::make_tuple(level, x, z)];
+    if (tile == nullptr) {
+        tile = mkU<FarTile>(level, x, z);
+    }
+    return tile.get();
+}
+
+void FarTerrain::select(int level, int x, int z, glm::vec2 eye, glm::ivec2 detailMin, glm::ivec2 detailMax)
+{
+    int len = FAR_TILE_LENGTH << level;
+    // Entirely covered by Chunks
+    if (x >= detailMin.x && x + len <= detailMax.x && z >= detailMin.y && z + len <= detailMax.y) {
+        return;
+    }
+    bool overlapsDetail = x < detailMax.x && x + len > detailMin.x &&
+                          z < detailMax.y && z + len > detailMin.y;
+    glm::vec2 nearest = glm::clamp(eye, glm::vec2(x, z), glm::vec2(x + len, z + len));
+    bool close = glm::distance(eye, nearest) < len;
+
+    if (overlapsDetail || close) {
+        if (level == 0) {
+            // Level 0 tiles line up with zones, so this only happens if
+            // the Chunk area is not zone aligned; leave the gap to the Chunks
+            if (overlapsDetail) {
+                return;
+            }
+        } else {
+            int half = len / 2;
+            select(level - 1, x, z, eye, detailMin, detailMax);
+            select(level - 1, x + half, z, eye, detailMin, detailMax);
+            select(level - 1, x, z + half, eye, detailMin, detailMax);
+            select(level - 1, x + half, z + half, eye, detailMin, detailMax);
+            return;
+        }
+    }
+    m_visible.push_back(tileAt(level, x, z));
+}
+
+void FarTerrain::update(glm::vec3 eye, glm::ivec2 detailMin, glm::ivec2 detailMax)
+{
+    ++m_tick;
+    m_visible.clear();
+
+    // A 3 x 3 block of root tiles around the camera
+    glm::vec2 eye2(eye.x, eye.z);
+    int rootLen = FAR_TILE_LENGTH << FAR_MAX_LEVEL;
+    int rootX = static_cast<int>(glm::floor(eye.x / rootLen)) * rootLen;
+    int rootZ = static_cast<int>(glm::floor(eye.z / rootLen)) * rootLen;
+    for (int dz = -1; dz <= 1; ++dz) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            select(FAR_MAX_LEVEL, rootX + dx * rootLen, rootZ + dz * rootLen, eye2, detailMin, detailMax);
+        }
+    }
+
+#ifdef MAC
+    std::vector<std::thread> threads;
+#endif
+    int jobs = 0;
+    for (FarTile *tile : m_visible) {
+        tile->lastUsedTick = m_tick;
+        if (tile->range.isAllocated() || tile->pending || jobs >= FAR_TILE_JOBS_PER_TICK) {
+            continue;
+        }
+        tile->pending = true;
+        ++jobs;
+        std::thread t(&FarTerrain::buildTile, this, tile);
+#ifdef MAC
+        threads.push_back(std::move(t));
+#endif
+#ifndef MAC
+        t.detach();
+#endif
+    }
+#ifdef MAC
+    for (auto &t : threads) {
+        t.join();
+    }
+#endif
+
+    m_builtMutex.lock();
+    for (FarTile *tile : m_built) {
+        m_meshes.upload(tile->range, tile->data);
+        std::vector<glm::vec4>().swap(tile->data);
+        tile->pending = false;
+    }
+    m_built.clear();
+    m_builtMutex.unlock();
+
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+        FarTile *tile = it->second.get();
+        if (!tile->pending && m_tick - tile->lastUsedTick > FAR_TILE_EVICT_TICKS) {
+            m_meshes.release(tile->range);
+            it = m_tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FarTerrain::draw(ShaderProgram *shaderProgram)
+{
+    m_commands.clear();
+    for (FarTile *tile : m_visible) {
+        m_commands.add(tile->range);
+    }
+    shaderProgram->setModelMatrix(glm::mat4(1.f));
+    shaderProgram->drawMulti(m_meshes, m_commands);
+}
+
+// UV offsets of the UL, LL, LR, UR corners within a texture tile
+const static glm::vec4 farCornerUVs[4] = {
+    glm::vec4(0.f, 1.f, 0.f, 0.f),
+    glm::vec4(0.f),
+    glm::vec4(1.f, 0.f, 0.f, 0.f),
+    glm::vec4(1.f, 1.f, 0.f, 0.f)
+};
+
+// Appends one quad whose corners are given in UL, LL, LR, UR order
+static void pushFarQuad(std::vector<glm::vec4> &out, const glm::vec4 corners[4],
+                        const glm::vec4 &normal, const glm::vec4 &uv)
+{
+    for (int c = 0; c < 4; ++c) {
+        out.push_back(corners[c]);
+        out.push_back(normal);
+        out.push_back(uv + farCornerUVs[c]);
+    }
+}
+
+void FarTerrain::buildTile(FarTile *tile)
+{
+    const int n = FAR_TILE_QUADS + 1;
+    const int step = tile->length() / FAR_TILE_QUADS;
+
+    // Sample the surface at every grid point, treating flooded spire
+    // valleys as a flat sheet of water
+    std::vector<float> heights(n * n);
+    std::vector<BlockType> types(n * n);
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            BlockType t;
+            int y = Terrain::surfaceAt(tile->x + i * step, tile->z + j * step, t);
+            if (t == SPIRE_TOP && y < SPIRE_WATER_LEVEL) {
+                y = SPIRE_WATER_LEVEL;
+                t = WATER;
+            }
+            // The top of the block, not its bottom
+            heights[i + n * j] = y + 1.f;
+            types[i + n * j] = t;
+        }
+    }
+    auto pointAt = [&](int i, int j) {
+        return glm::vec4(tile->x + i * step, heights[i + n * j], tile->z + j * step, 1.f);
+    };
+
+    std::vector<glm::vec4> &data = tile->data;
+    // One top quad per cell plus one skirt quad per edge segment
+    data.reserve((FAR_TILE_QUADS * FAR_TILE_QUADS + 4 * FAR_TILE_QUADS) * 4 * 3);
+
+    for (int j = 0; j < FAR_TILE_QUADS; ++j) {
+        for (int i = 0; i < FAR_TILE_QUADS; ++i) {
+            glm::vec4 corners[4] = {pointAt(i, j + 1), pointAt(i, j), pointAt(i + 1, j), pointAt(i + 1, j + 1)};
+            // Cells are generally not planar, so light them by the cross
+            // product of their diagonals
+            glm::vec3 normal = glm::normalize(glm::cross(glm::vec3(corners[0] - corners[2]),
+                                                         glm::vec3(corners[3] - corners[1])));
+            pushFarQuad(data, corners, glm::vec4(normal, 0.f), Chunk::getUVs(types[i + n * j], YPOS));
+        }
+    }
+
+    // Skirts hang down from every edge to hide the cracks where this tile
+    // meets a neighbor sampled at a different resolution
+    const glm::vec4 skirt(0.f, 2.f * step + 8.f, 0.f, 0.f);
+    struct Edge {
+        glm::ivec2 start;
+        glm::ivec2 along;
+        Direction dir;
+        glm::vec4 normal;
+    };
+    const Edge edges[4] = {
+        {glm::ivec2(0, 0), glm::ivec2(1, 0), ZNEG, glm::vec4(0, 0, -1, 0)},
+        {glm::ivec2(0, FAR_TILE_QUADS), glm::ivec2(1, 0), ZPOS, glm::vec4(0, 0, 1, 0)},
+        {glm::ivec2(0, 0), glm::ivec2(0, 1), XNEG, glm::vec4(-1, 0, 0, 0)},
+        {glm::ivec2(FAR_TILE_QUADS, 0), glm::ivec2(0, 1), XPOS, glm::vec4(1, 0, 0, 0)}
+    };
+    for (const Edge &edge : edges) {
+        for (int s = 0; s < FAR_TILE_QUADS; ++s) {
+            glm::ivec2 a = edge.start + edge.along * s;
+            glm::ivec2 b = a + edge.along;
+            glm::vec4 top0 = pointAt(a.x, a.y);
+            glm::vec4 top1 = pointAt(b.x, b.y);
+            glm::vec4 corners[4] = {top0, top0 - skirt, top1 - skirt, top1};
+            pushFarQuad(data, corners, edge.normal, Chunk::getUVs(types[a.x + n * a.y], edge.dir));
+        }
+    }
+
+    // Notified under the lock, so destroy() cannot go on and free the
+    // condition variable before this is done with it
+    std::lock_guard<std::mutex> lock(m_builtMutex);
+    m_built.push_back(tile);
+    m_builtAdded.notify_one();
+}
+
+MeshBufferStats FarTerrain::vertexStats() const
+{
+    return m_meshes.vertexStats();
+}
+
+size_t FarTerrain::tileCount() const
+{
+    return m_tiles.size();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "smartpointerhelp.h"
+#include "glm_includes.h"
+#include "meshbuffer.h"
+#include "shaderprogram.h"
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// A far terrain tile at level n covers (FAR_TILE_LENGTH << n) blocks
+// on a side, so a level 0 tile lines up with one terrain generation zone
+#define FAR_TILE_LENGTH 64
+// Height samples along each side of a tile, minus one
+#define FAR_TILE_QUADS 16
+// Coarsest tile level; the root tiles around the camera are 4096 blocks wide
+#define FAR_MAX_LEVEL 6
+// Caps how many tiles are built per tick
+#define FAR_TILE_JOBS_PER_TICK 16
+// Ticks a tile may go undrawn before its mesh is thrown away
+#define FAR_TILE_EVICT_TICKS 300
+
+// One square of the far terrain heightfield
+struct FarTile {
+    int level;
+    int x;             // World-space X of the tile's lower-left corner
+    int z;             // World-space Z of the tile's lower-left corner
+    std::vector<glm::vec4> data; // Interleaved pos, nor, uv; only populated between build and upload
+    MeshRange range;
+    bool pending;      // A worker is building data
+    int lastUsedTick;
+
+    FarTile(int level, int x, int z);
+    int length() const;
+};
+
+// Draws the world beyond the loaded chunks as a low-poly heightfield.
+// Tiles sample Terrain::surfaceAt on a coarse grid and never touch block
+// data, so they cost a few kilobytes of vertices each instead of whole
+// Chunks. Each tick the tiles around the camera are chosen as a quadtree
+// clipmap: tiles split while the camera is close relative to their size,
+// and tiles inside the area drawn with Chunks are left out.
+class FarTerrain
+{
+private:
+    OpenGLContext *mp_context;
+    MeshBuffer m_meshes;
+    MultiDrawCommands m_commands;
+
+    // Every tile that has a mesh or is being built, keyed by (level, x, z)
+    std::map<std::tuple<int, int, int>, uPtr<FarTile>> m_tiles;
+    // Tiles chosen by the last update(), in no particular order
+    std::vector<FarTile*> m_visible;
+
+    // Tiles whose worker finished, waiting for their upload
+    std::vector<FarTile*> m_built;
+    std::mutex m_builtMutex;
+    std::condition_variable m_builtAdded;
+
+    int m_tick;
+
+    // Recursively chooses the tiles to draw under the given tile
+    void select(int level, int x, int z, glm::vec2 eye, glm::ivec2 detailMin, glm::ivec2 detailMax);
+    FarTile* tileAt(int level, int x, int z);
+
+    // Runs on a worker thread and hands the tile to m_built when done
+    void buildTile(FarTile *tile);
+
+public:
+    FarTerrain(OpenGLContext *context, QuadIndexBuffer &quadIndices);
+
+    void create();
+    // Waits for tiles still being built before freeing them
+    void destroy();
+
+    // Chooses the tiles around eye, starts building missing ones, uploads
+    // finished ones and evicts tiles that have not been drawn in a while.
+    // [detailMin, detailMax) is the X/Z area already drawn with Chunks.
+    void update(glm::vec3 eye, glm::ivec2 detailMin, glm::ivec2 detailMax);
+    // Draws every chosen tile whose mesh is ready
+    void draw(ShaderProgram *shaderProgram);
+
+    MeshBufferStats vertexStats() const;
+    size_t tileCount() const;
+};
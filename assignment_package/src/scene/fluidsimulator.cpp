@@ -0,0 +1,287 @@
+#include "fluidsimulator.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+const static Direction SIDES[4] = {XPOS, XNEG, ZPOS, ZNEG};
+const static Direction DIRECTIONS[6] = {XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG};
+// Below this many blocks a phase is not worth a thread per share
+const static size_t MIN_CELLS_PER_THREAD = 512;
+
+static bool isFluid(BlockType t)
+{
+    return t == WATER || t == LAVA;
+}
+
+// How far each fluid flows from a source
+static unsigned char maxLevel(BlockType t)
+{
+    return t == LAVA ? 3 : 7;
+}
+
+static int cellIndex(int x, int y, int z)
+{
+    return x + 16 * y + 16 * 256 * z;
+}
+
+FluidSimulator::FluidSimulator()
+    : m_active(), m_sinceTick(0.f), m_tick(0), m_lastTickCells(0), m_lastTickMs(0.f)
+{}
+
+bool FluidSimulator::step(Cell &c, Direction dir)
+{
+    switch (dir) {
+    case XPOS: ++c.x; break;
+    case XNEG: --c.x; break;
+    case YPOS: ++c.y; break;
+    case YNEG: --c.y; break;
+    case ZPOS: ++c.z; break;
+    case ZNEG: --c.z; break;
+    }
+    if (c.y < 0 || c.y > 255) {
+        return false;
+    }
+    if (c.x < 0 || c.x > 15 || c.z < 0 || c.z > 15) {
+        Chunk *next = c.chunk->neighbor(dir);
+        // Chunks are lit as soon as their blocks arrive
+        if (next == nullptr || !next->isLightReady()) {
+            return false;
+        }
+        c.chunk = next;
+        c.x = (c.x + 16) % 16;
+        c.z = (c.z + 16) % 16;
+    }
+    return true;
+}
+
+BlockType FluidSimulator::blockBeside(const Cell &c, Direction dir, unsigned char &level)
+{
+    Cell n = c;
+    if (!step(n, dir)) {
+        level = 0;
+        return STONE;
+    }
+    BlockType t = n.chunk->getBlockAt(n.x, n.y, n.z);
+    level = isFluid(t) ? n.chunk->getFluidLevel(n.x, n.y, n.z) : 0;
+    return t;
+}
+
+bool FluidSimulator::nextState(const Cell &c, bool lavaTick, bool &deferred, Write &next)
+{
+    deferred = false;
+    BlockType t = c.chunk->getBlockAt(c.x, c.y, c.z);
+    if (t != EMPTY && !isFluid(t)) {
+        return false;
+    }
+    unsigned char level = isFluid(t) ? c.chunk->getFluidLevel(c.x, c.y, c.z) : 0;
+
+    bool touchesWater = false;
+    unsigned char l;
+    for (Direction dir : DIRECTIONS) {
+        touchesWater = touchesWater || blockBeside(c, dir, l) == WATER;
+    }
+
+    BlockType kind = EMPTY;
+    unsigned char best = 255;
+    if (isFluid(t) && level == 0) {
+        // Sources stay put, unless lava meets water
+        if (t != LAVA || !touchesWater) {
+            return false;
+        }
+        kind = LAVA;
+        best = 0;
+    } else {
+        // Fed from above, it falls
+        BlockType above = blockBeside(c, YPOS, l);
+        if (isFluid(above)) {
+            kind = above;
+            best = 1;
+        }
+        // Fed from the side by fluid resting on something
+        int waterSources = 0;
+        for (Direction dir : SIDES) {
+            Cell q = c;
+            if (!step(q, dir)) {
+                continue;
+            }
+            BlockType side = q.chunk->getBlockAt(q.x, q.y, q.z);
+            if (!isFluid(side)) {
+                continue;
+            }
+            unsigned char sideLevel = q.chunk->getFluidLevel(q.x, q.y, q.z);
+            if (side == WATER && sideLevel == 0) {
+                ++waterSources;
+            }
+            unsigned char belowLevel;
+            BlockType below = blockBeside(q, YNEG, belowLevel);
+            if (below == EMPTY || (isFluid(below) && belowLevel > 0)) {
+                continue;
+            }
+            unsigned char reached = static_cast<unsigned char>(sideLevel + 1);
+            if (reached <= maxLevel(side) && reached < best) {
+                kind = side;
+                best = reached;
+            }
+        }
+        // Between two water sources, on top of something, it becomes one
+        unsigned char belowLevel;
+        BlockType below = blockBeside(c, YNEG, belowLevel);
+        if (waterSources >= 2 && kind != LAVA && below != EMPTY &&
+                (!isFluid(below) || (below == WATER && belowLevel == 0))) {
+            kind = WATER;
+            best = 0;
+        }
+    }
+
+    if (kind == LAVA && touchesWater) {
+        kind = STONE;
+    }
+    if ((t == LAVA || kind == LAVA) && !lavaTick) {
+        deferred = true;
+        return false;
+    }
+    next.index = cellIndex(c.x, c.y, c.z);
+    next.type = kind;
+    next.level = isFluid(kind) ? best : 0;
+    return next.type != t || next.level != level;
+}
+
+void FluidSimulator::runBatch(Batch &batch, bool lavaTick)
+{
+    for (int index : batch.cells) {
+        Cell c = {batch.chunk, index % 16, (index / 16) % 256, index / (16 * 256)};
+        bool deferred;
+        Write next;
+        if (nextState(c, lavaTick, deferred, next)) {
+            batch.writes.push_back(next);
+        } else if (deferred) {
+            batch.wake.push_back(c);
+        }
+    }
+    // Only now, so every block above was worked out from the same state
+    auto lock = batch.chunk->writeBlocks();
+    for (const Write &w : batch.writes) {
+        Cell c = {batch.chunk, w.index % 16, (w.index / 16) % 256, w.index / (16 * 256)};
+        batch.chunk->setBlockAt(static_cast<unsigned int>(c.x), static_cast<unsigned int>(c.y),
+                                static_cast<unsigned int>(c.z), w.type);
+        batch.chunk->setFluidLevel(c.x, c.y, c.z, w.level);
+        batch.wake.push_back(c);
+        for (Direction dir : DIRECTIONS) {
+            Cell n = c;
+            if (step(n, dir)) {
+                batch.wake.push_back(n);
+            }
+        }
+    }
+}
+
+void FluidSimulator::blockChanged(Chunk &c, int x, int y, int z)
+{
+    c.setFluidLevel(x, y, z, 0);
+    Cell cell = {&c, x, y, z};
+    m_active[&c].insert(cellIndex(x, y, z));
+    for (Direction dir : DIRECTIONS) {
+        Cell n = cell;
+        if (step(n, dir)) {
+            m_active[n.chunk].insert(cellIndex(n.x, n.y, n.z));
+        }
+    }
+}
+
+std::vector<FluidSimulator::Cell> FluidSimulator::advance(float ms)
+{
+    std::vector<Cell> changed;
+    m_sinceTick += ms;
+    if (m_sinceTick < FLUID_TICK_MS) {
+        return changed;
+    }
+    // A long frame runs one tick late rather than several at once
+    m_sinceTick = std::min(m_sinceTick - FLUID_TICK_MS, FLUID_TICK_MS);
+    ++m_tick;
+    m_lastTickCells = 0;
+    if (m_active.empty()) {
+        m_lastTickMs = 0.f;
+        return changed;
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool lavaTick = m_tick % LAVA_TICK_INTERVAL == 0;
+
+    // Take this tick's blocks out of the active set, up to the budget
+    std::vector<Batch> batches;
+    size_t budget = MAX_FLUID_CELLS_PER_TICK;
+    for (auto it = m_active.begin(); it != m_active.end() && budget > 0;) {
+        Batch batch;
+        batch.chunk = it->first;
+        std::unordered_set<int> &cells = it->second;
+        while (!cells.empty() && budget > 0) {
+            batch.cells.push_back(*cells.begin());
+            cells.erase(cells.begin());
+            --budget;
+        }
+        m_lastTickCells += batch.cells.size();
+        batches.push_back(std::move(batch));
+        it = cells.empty() ? m_active.erase(it) : std::next(it);
+    }
+
+    for (int phase = 0; phase < 4; ++phase) {
+        std::vector<Batch*> running;
+        size_t cellCount = 0;
+        for (Batch &batch : batches) {
+            int parity = ((batch.chunk->X / 16) & 1) | (((batch.chunk->Z / 16) & 1) << 1);
+            if (parity == phase) {
+                running.push_back(&batch);
+                cellCount += batch.cells.size();
+            }
+        }
+        size_t threadCount = std::min({running.size(), cellCount / MIN_CELLS_PER_THREAD,
+                                       static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()))});
+        if (threadCount <= 1) {
+            for (Batch *batch : running) {
+                runBatch(*batch, lavaTick);
+            }
+        } else {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < threadCount; ++t) {
+                threads.emplace_back([&running, t, threadCount, lavaTick]() {
+                    for (size_t i = t; i < running.size(); i += threadCount) {
+                        runBatch(*running[i], lavaTick);
+                    }
+                });
+            }
+            // The next phase reads what this one wrote
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+        }
+    }
+
+    for (Batch &batch : batches) {
+        for (const Cell &c : batch.wake) {
+            m_active[c.chunk].insert(cellIndex(c.x, c.y, c.z));
+        }
+        for (const Write &w : batch.writes) {
+            changed.push_back({batch.chunk, w.index % 16, (w.index / 16) % 256, w.index / (16 * 256)});
+        }
+    }
+    m_lastTickMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return changed;
+}
+
+size_t FluidSimulator::activeCount() const
+{
+    size_t count = 0;
+    for (const auto &entry : m_active) {
+        count += entry.second.size();
+    }
+    return count;
+}
+
+size_t FluidSimulator::lastTickCells() const
+{
+    return m_lastTickCells;
+}
+
+float FluidSimulator::lastTickMs() const
+{
+    return m_lastTickMs;
+}
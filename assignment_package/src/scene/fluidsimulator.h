@@ -0,0 +1,82 @@
+#pragma once
+#include "chunk.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// How often water moves one block, and how many of those ticks lava waits
+// between its own moves
+#define FLUID_TICK_MS 200.f
+#define LAVA_TICK_INTERVAL 3
+// Caps the blocks updated in one tick; the rest wait for the next one
+#define MAX_FLUID_CELLS_PER_TICK 8192
+
+// Lets WATER and LAVA flow. Every generated or placed fluid block is a
+// source, which never moves or runs dry by itself; flowing blocks carry
+// their distance from a source as a level and dry up once nothing feeds
+// them. Only blocks that might change are kept in the active set, woken by
+// an edit next to them or by a change next to them last tick, so still
+// water costs nothing however much of it there is.
+//
+// Each tick a block's next state is worked out from its neighbors, and a
+// Chunk's changes are only written once all of its blocks are worked out.
+// Chunks are split into four phases by the parity of their grid
+// coordinates, so no two Chunks running at once are neighbors, and those
+// of a phase run in parallel without one reading the other mid-write.
+// Runs on the GL thread, along with everything else that writes blocks.
+class FluidSimulator
+{
+public:
+    struct Cell {
+        Chunk *chunk;
+        int x, y, z; // Chunk-local
+    };
+
+private:
+    // A block whose next state is worked out, and the state itself
+    struct Write {
+        int index;
+        BlockType type;
+        unsigned char level;
+    };
+    // One Chunk's share of a tick, worked out on whichever thread runs it
+    struct Batch {
+        Chunk *chunk;
+        std::vector<int> cells;
+        std::vector<Write> writes;
+        // Blocks to update next tick, in this Chunk or the ones around it
+        std::vector<Cell> wake;
+    };
+
+    // Blocks of each Chunk to update next tick, by index into its blocks
+    std::unordered_map<Chunk*, std::unordered_set<int>> m_active;
+    float m_sinceTick;
+    int m_tick;
+    size_t m_lastTickCells;
+    float m_lastTickMs;
+
+    // Moves c one block in dir, across into a neighboring Chunk if need be.
+    // False if that leaves the world or reaches a Chunk whose blocks are
+    // not in yet, which fluid treats like a wall.
+    static bool step(Cell &c, Direction dir);
+    // The block beside c in dir and its fluid level; walls count as STONE
+    static BlockType blockBeside(const Cell &c, Direction dir, unsigned char &level);
+    static void runBatch(Batch &batch, bool lavaTick);
+    // Whether block c changes this tick, and what into
+    static bool nextState(const Cell &c, bool lavaTick, bool &deferred, Write &next);
+
+public:
+    FluidSimulator();
+
+    // Wakes block (x, y, z) of c, in Chunk-local coordinates, and the
+    // blocks around it after something other than the flow changed it. A
+    // fluid block set this way becomes a source.
+    void blockChanged(Chunk &c, int x, int y, int z);
+    // Runs a tick if FLUID_TICK_MS have passed since the last one, given
+    // the ms since this was last called. Returns the blocks it changed.
+    std::vector<Cell> advance(float ms);
+
+    size_t activeCount() const;
+    size_t lastTickCells() const;
+    float lastTickMs() const;
+};
@@ -0,0 +1,88 @@
+#include "instancedcubes.h"
+
+// Outward normal, then the two axes spanning each face, ordered so the
+// face winds counterclockwise seen from outside
+const static glm::vec3 FACES[6][3] = {
+    {{ 1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+    {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+    {{ 0, 1, 0}, {0, 0, 1}, {1, 0, 0}},
+    {{ 0,-1, 0}, {1, 0, 0}, {0, 0, 1}},
+    {{ 0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+    {{ 0, 0,-1}, {0, 1, 0}, {1, 0, 0}},
+};
+
+InstancedCubes::InstancedCubes(OpenGLContext *context, int texelsPerInstance)
+    : Drawable(context), m_bufInstances(0), m_texInstances(0), m_instancesGenerated(false),
+      m_instanceCount(0), m_texelsPerInstance(texelsPerInstance)
+{}
+
+void InstancedCubes::create()
+{
+    // Position, normal and an unused color per vertex, interleaved like
+    // every other opaque mesh
+    std::vector<glm::vec4> verts;
+    std::vector<GLuint> idx;
+    for (const auto &face : FACES) {
+        glm::vec3 n = face[0];
+        // The corner the face's spanning axes start from
+        glm::vec3 origin = glm::max(n, glm::vec3(0.f));
+        GLuint first = static_cast<GLuint>(verts.size() / 3);
+        for (glm::vec2 uv : {glm::vec2(0, 0), glm::vec2(1, 0), glm::vec2(1, 1), glm::vec2(0, 1)}) {
+            verts.push_back(glm::vec4(origin + uv.x * face[1] + uv.y * face[2], 1.f));
+            verts.push_back(glm::vec4(n, 0.f));
+            verts.push_back(glm::vec4(0.f));
+        }
+        for (GLuint i : {0u, 1u, 2u, 0u, 2u, 3u}) {
+            idx.push_back(first + i);
+        }
+    }
+    m_count = static_cast<int>(idx.size());
+
+    generateIdx();
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
+    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(GLuint), idx.data(), GL_STATIC_DRAW);
+
+    generateAllOpaque();
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_buffAllOpaque);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(glm::vec4), verts.data(), GL_STATIC_DRAW);
+
+    mp_context->glGenBuffers(1, &m_bufInstances);
+    mp_context->glGenTextures(1, &m_texInstances);
+    mp_context->glBindBuffer(GL_TEXTURE_BUFFER, m_bufInstances);
+    mp_context->glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+    mp_context->glBindTexture(GL_TEXTURE_BUFFER, m_texInstances);
+    mp_context->glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_bufInstances);
+    m_instancesGenerated = true;
+}
+
+void InstancedCubes::destroyInstances()
+{
+    if (m_instancesGenerated) {
+        mp_context->glDeleteTextures(1, &m_texInstances);
+        mp_context->glDeleteBuffers(1, &m_bufInstances);
+        m_instancesGenerated = false;
+    }
+}
+
+void InstancedCubes::setInstances(const std::vector<glm::vec4> &texels)
+{
+    m_instanceCount = static_cast<int>(texels.size()) / m_texelsPerInstance;
+    mp_context->glBindBuffer(GL_TEXTURE_BUFFER, m_bufInstances);
+    // Orphaned rather than overwritten, so the draw reading last frame's
+    // data does not hold this one up
+    mp_context->glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    if (!texels.empty()) {
+        mp_context->glBufferSubData(GL_TEXTURE_BUFFER, 0, texels.size() * sizeof(glm::vec4), texels.data());
+    }
+}
+
+void InstancedCubes::bindInstances(int textureSlot)
+{
+    mp_context->glActiveTexture(GL_TEXTURE0 + textureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_BUFFER, m_texInstances);
+}
+
+int InstancedCubes::instanceCount() const
+{
+    return m_instanceCount;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "drawable.h"
+#include <vector>
+
+// One unit cube, from (0, 0, 0) to (1, 1, 1), drawn once per instance with a
+// single glDrawElementsInstanced. The GL 3.2 core profile has no attribute
+// divisors, so per-instance data lives in a buffer texture instead, fetched
+// by gl_InstanceID in the vertex shader (see entity.vert.glsl).
+class InstancedCubes : public Drawable
+{
+private:
+    GLuint m_bufInstances;
+    GLuint m_texInstances; // The buffer texture reading m_bufInstances
+    bool m_instancesGenerated;
+    int m_instanceCount;
+    int m_texelsPerInstance;
+
+public:
+    InstancedCubes(OpenGLContext* context, int texelsPerInstance);
+    virtual ~InstancedCubes(){}
+    void create() override;
+    void destroyInstances();
+
+    // Replaces the per-instance data with texels, m_texelsPerInstance RGBA32F
+    // texels for each instance
+    void setInstances(const std::vector<glm::vec4> &texels);
+    // Binds the buffer texture to the given texture slot
+    void bindInstances(int textureSlot);
+    int instanceCount() const;
+};
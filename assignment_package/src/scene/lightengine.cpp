@@ -0,0 +1,320 @@
+#include "lightengine.h"
+#include <algorithm>
+
+const static Direction DIRECTIONS[6] = {XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG};
+const static unsigned char OPAQUE_COST = 16;
+
+unsigned char lightCost(BlockType t)
+{
+    switch (t) {
+    case EMPTY:
+        return 1;
+    case WATER:
+    case ICE:
+        return 2;
+    default:
+        return OPAQUE_COST;
+    }
+}
+
+unsigned char lightEmission(BlockType t)
+{
+    return t == LAVA ? 15 : 0;
+}
+
+// What a block of type t reached from a block at level, moving in dir, is lit to
+static unsigned char spreadLevel(unsigned char level, BlockType t, Direction dir, bool sky)
+{
+    unsigned char cost = lightCost(t);
+    if (cost >= OPAQUE_COST) {
+        return 0;
+    }
+    // Open sky falls straight down without fading
+    if (sky && dir == YNEG && level == 15 && t == EMPTY) {
+        return 15;
+    }
+    return level > cost ? level - cost : 0;
+}
+
+// Flood fill within one Chunk's light data, from the blocks in queue, for
+// the nibble at shift
+static void floodChunk(const BlockType *blocks, unsigned char *light, std::vector<int> &queue, int shift)
+{
+    bool sky = shift == 4;
+    for (size_t q = 0; q < queue.size(); ++q) {
+        int index = queue[q];
+        unsigned char level = (light[index] >> shift) & 0x0F;
+        if (level <= 1) {
+            continue;
+        }
+        int x = index % 16, y = (index / 16) % 256, z = index / (16 * 256);
+        for (Direction dir : DIRECTIONS) {
+            int nx = x, ny = y, nz = z;
+            switch (dir) {
+            case XPOS: ++nx; break;
+            case XNEG: --nx; break;
+            case YPOS: ++ny; break;
+            case YNEG: --ny; break;
+            case ZPOS: ++nz; break;
+            case ZNEG: --nz; break;
+            }
+            if (nx < 0 || nx > 15 || ny < 0 || ny > 255 || nz < 0 || nz > 15) {
+                continue;
+            }
+            int n = nx + 16 * ny + 16 * 256 * nz;
+            unsigned char reached = spreadLevel(level, blocks[n], dir, sky);
+            if (reached > ((light[n] >> shift) & 0x0F)) {
+                light[n] = static_cast<unsigned char>((light[n] & ~(0x0F << shift)) | (reached << shift));
+                queue.push_back(n);
+            }
+        }
+    }
+    queue.clear();
+}
+
+void LightEngine::lightChunk(Chunk &c)
+{
+    const BlockType *blocks = c.blocks();
+    unsigned char *light = c.lightData();
+    std::fill_n(light, CHUNK_BLOCK_COUNT, 0);
+    std::vector<int> queue;
+
+    // Sky light comes straight down each column until something stops it
+    for (int z = 0; z < 16; ++z) {
+        for (int x = 0; x < 16; ++x) {
+            unsigned char level = 15;
+            for (int y = 255; y >= 0 && level > 0; --y) {
+                int index = x + 16 * y + 16 * 256 * z;
+                unsigned char cost = lightCost(blocks[index]);
+                if (cost >= OPAQUE_COST) {
+                    break;
+                }
+                // Only full sky light goes down through air for free
+                if (level < 15 || blocks[index] != EMPTY) {
+                    level = level > cost ? level - cost : 0;
+                }
+                light[index] = static_cast<unsigned char>(level << 4);
+            }
+        }
+    }
+    // and spreads sideways from wherever a column beside it is darker
+    for (int index = 0; index < CHUNK_BLOCK_COUNT; ++index) {
+        unsigned char level = light[index] >> 4;
+        if (level <= 1) {
+            continue;
+        }
+        int x = index % 16, z = index / (16 * 256);
+        int sides[4] = {x > 0 ? index - 1 : -1, x < 15 ? index + 1 : -1,
+                        z > 0 ? index - 16 * 256 : -1, z < 15 ? index + 16 * 256 : -1};
+        for (int n : sides) {
+            if (n >= 0 && lightCost(blocks[n]) < OPAQUE_COST && (light[n] >> 4) + 1 < level) {
+                queue.push_back(index);
+                break;
+            }
+        }
+    }
+    floodChunk(blocks, light, queue, 4);
+
+    for (int index = 0; index < CHUNK_BLOCK_COUNT; ++index) {
+        unsigned char emission = lightEmission(blocks[index]);
+        if (emission > 0) {
+            light[index] = static_cast<unsigned char>((light[index] & 0xF0) | emission);
+            queue.push_back(index);
+        }
+    }
+    floodChunk(blocks, light, queue, 0);
+}
+
+LightEngine::LightEngine()
+    : m_addQueue(), m_removeQueue(), m_changed(), m_locked(nullptr), m_lock()
+{}
+
+unsigned char LightEngine::getLight(const Chunk &c, int x, int y, int z, Channel channel)
+{
+    return channel == SKY ? c.getSkyLight(x, y, z) : c.getBlockLight(x, y, z);
+}
+
+void LightEngine::setLight(Chunk &c, int x, int y, int z, Channel channel, unsigned char level)
+{
+    if (m_locked != &c) {
+        unlock();
+        m_lock = c.writeBlocks();
+        m_locked = &c;
+    }
+    if (channel == SKY) {
+        c.setSkyLight(x, y, z, level);
+    } else {
+        c.setBlockLight(x, y, z, level);
+    }
+}
+
+void LightEngine::unlock()
+{
+    if (m_locked != nullptr) {
+        m_lock.unlock();
+        m_locked = nullptr;
+    }
+}
+
+bool LightEngine::step(Node &n, Direction dir)
+{
+    switch (dir) {
+    case XPOS: ++n.x; break;
+    case XNEG: --n.x; break;
+    case YPOS: ++n.y; break;
+    case YNEG: --n.y; break;
+    case ZPOS: ++n.z; break;
+    case ZNEG: --n.z; break;
+    }
+    if (n.y < 0 || n.y > 255) {
+        return false;
+    }
+    if (n.x < 0 || n.x > 15 || n.z < 0 || n.z > 15) {
+        Chunk *next = n.chunk->neighbor(dir);
+        if (next == nullptr || !next->isLightReady()) {
+            return false;
+        }
+        n.chunk = next;
+        n.x = (n.x + 16) % 16;
+        n.z = (n.z + 16) % 16;
+    }
+    return true;
+}
+
+void LightEngine::propagateAdds(Channel channel)
+{
+    for (size_t q = 0; q < m_addQueue.size(); ++q) {
+        Node n = m_addQueue[q];
+        unsigned char level = getLight(*n.chunk, n.x, n.y, n.z, channel);
+        if (level <= 1) {
+            continue;
+        }
+        for (Direction dir : DIRECTIONS) {
+            Node m = n;
+            if (!step(m, dir)) {
+                continue;
+            }
+            unsigned char reached = spreadLevel(level, m.chunk->getBlockAt(m.x, m.y, m.z), dir, channel == SKY);
+            if (reached > getLight(*m.chunk, m.x, m.y, m.z, channel)) {
+                setLight(*m.chunk, m.x, m.y, m.z, channel, reached);
+                m_changed.insert(m.chunk);
+                m_addQueue.push_back(m);
+            }
+        }
+    }
+    m_addQueue.clear();
+}
+
+void LightEngine::propagateRemovals(Channel channel)
+{
+    // Darkens everything that was lit through the removed blocks, and
+    // queues the brighter blocks around that region to light it back up
+    for (size_t q = 0; q < m_removeQueue.size(); ++q) {
+        Node n = m_removeQueue[q];
+        for (Direction dir : DIRECTIONS) {
+            Node m = n;
+            if (!step(m, dir)) {
+                continue;
+            }
+            unsigned char level = getLight(*m.chunk, m.x, m.y, m.z, channel);
+            if (level == 0) {
+                continue;
+            }
+            bool litFromHere = level < n.level ||
+                    (channel == SKY && dir == YNEG && n.level == 15 && level == 15);
+            if (litFromHere) {
+                setLight(*m.chunk, m.x, m.y, m.z, channel, 0);
+                m_changed.insert(m.chunk);
+                m.level = level;
+                m_removeQueue.push_back(m);
+                unsigned char emission = channel == BLOCK ? lightEmission(m.chunk->getBlockAt(m.x, m.y, m.z)) : 0;
+                if (emission > 0) {
+                    setLight(*m.chunk, m.x, m.y, m.z, channel, emission);
+                    m_addQueue.push_back(m);
+                }
+            } else {
+                m_addQueue.push_back(m);
+            }
+        }
+    }
+    m_removeQueue.clear();
+}
+
+void LightEngine::stitch(Chunk &c)
+{
+    c.setLightReady();
+    const Direction sides[4] = {XPOS, XNEG, ZPOS, ZNEG};
+    for (Channel channel : {SKY, BLOCK}) {
+        for (Direction dir : sides) {
+            Chunk *other = c.neighbor(dir);
+            if (other == nullptr || !other->isLightReady()) {
+                continue;
+            }
+            for (int y = 0; y < 256; ++y) {
+                for (int s = 0; s < 16; ++s) {
+                    // The pair of blocks facing each other across the border
+                    Node a = {&c, s, y, s, 0};
+                    Node b = {other, s, y, s, 0};
+                    switch (dir) {
+                    case XPOS: a.x = 15; b.x = 0; break;
+                    case XNEG: a.x = 0; b.x = 15; break;
+                    case ZPOS: a.z = 15; b.z = 0; break;
+                    default: a.z = 0; b.z = 15; break;
+                    }
+                    unsigned char la = getLight(c, a.x, a.y, a.z, channel);
+                    unsigned char lb = getLight(*other, b.x, b.y, b.z, channel);
+                    if (la > lb + lightCost(other->getBlockAt(b.x, b.y, b.z))) {
+                        m_addQueue.push_back(a);
+                    } else if (lb > la + lightCost(c.getBlockAt(a.x, a.y, a.z))) {
+                        m_addQueue.push_back(b);
+                    }
+                }
+            }
+        }
+        propagateAdds(channel);
+    }
+    unlock();
+}
+
+void LightEngine::blockChanged(Chunk &c, int x, int y, int z)
+{
+    if (!c.isLightReady()) {
+        return;
+    }
+    BlockType t = c.getBlockAt(x, y, z);
+    m_changed.insert(&c);
+    for (Channel channel : {SKY, BLOCK}) {
+        Node n = {&c, x, y, z, getLight(c, x, y, z, channel)};
+        if (n.level > 0) {
+            setLight(c, x, y, z, channel, 0);
+            m_removeQueue.push_back(n);
+            propagateRemovals(channel);
+        }
+        if (channel == BLOCK && lightEmission(t) > 0) {
+            setLight(c, x, y, z, channel, lightEmission(t));
+            m_addQueue.push_back(n);
+        }
+        if (lightCost(t) < OPAQUE_COST) {
+            // Light flows back in from around it
+            for (Direction dir : DIRECTIONS) {
+                Node m = n;
+                if (step(m, dir) && getLight(*m.chunk, m.x, m.y, m.z, channel) > 1) {
+                    m_addQueue.push_back(m);
+                }
+            }
+            if (channel == SKY && y == 255) {
+                setLight(c, x, y, z, channel, 15);
+                m_addQueue.push_back(n);
+            }
+        }
+        propagateAdds(channel);
+    }
+    unlock();
+}
+
+std::vector<Chunk*> LightEngine::takeChanged()
+{
+    std::vector<Chunk*> changed(m_changed.begin(), m_changed.end());
+    m_changed.clear();
+    return changed;
+}
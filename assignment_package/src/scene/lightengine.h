@@ -0,0 +1,63 @@
+#pragma once
+#include "chunk.h"
+#include <unordered_set>
+#include <vector>
+
+// Spreads sky light and block light through the Chunks' blocks, one level
+// lost per block travelled, so caves and overhangs are as dark as the
+// openings leading into them. Sky light falls straight down through air
+// without fading. The levels are baked into the meshes, so nothing about
+// lighting is drawn per frame.
+class LightEngine
+{
+public:
+    // Lights one Chunk from its own blocks alone. Touches nothing else, so
+    // it runs on whichever thread filled the Chunk in.
+    static void lightChunk(Chunk &c);
+
+    // The rest run on the GL thread only.
+    LightEngine();
+
+    // Marks c as lit and spreads light across the borders between it and
+    // its lit neighbors
+    void stitch(Chunk &c);
+    // Relights around block (x, y, z) of c, in Chunk-local coordinates,
+    // after its type changed. Only reaches as far as the light
+    // that changed, at most 15 blocks plus a column of sky.
+    void blockChanged(Chunk &c, int x, int y, int z);
+    // Chunks whose light changed since the last call, which need meshing again
+    std::vector<Chunk*> takeChanged();
+
+private:
+    enum Channel { SKY, BLOCK };
+    struct Node {
+        Chunk *chunk;
+        int x, y, z;
+        unsigned char level; // What the block had before it was removed
+    };
+    std::vector<Node> m_addQueue;
+    std::vector<Node> m_removeQueue;
+    std::unordered_set<Chunk*> m_changed;
+    // Meshing workers read light under a Chunk's block lock, so writes take
+    // it exclusively. The lock is kept while writes stay in one Chunk and
+    // dropped before moving to the next, so only one is ever held.
+    Chunk *m_locked;
+    std::unique_lock<std::shared_mutex> m_lock;
+
+    // Reads need no lock, since only the GL thread writes light
+    static unsigned char getLight(const Chunk &c, int x, int y, int z, Channel channel);
+    void setLight(Chunk &c, int x, int y, int z, Channel channel, unsigned char level);
+    void unlock();
+    // Moves n one block in dir, across into a lit neighbor if need be.
+    // False if that leaves the world or reaches a Chunk without light yet.
+    static bool step(Node &n, Direction dir);
+
+    void propagateAdds(Channel channel);
+    void propagateRemovals(Channel channel);
+};
+
+// Light levels lost entering a block of type t; 16 for blocks light
+// cannot enter at all
+unsigned char lightCost(BlockType t);
+// How brightly a block of type t glows by itself
+unsigned char lightEmission(BlockType t);
@@ -0,0 +1,173 @@
+#include "occlusionculler.h"
+
+// How far outside a Chunk's bounds the camera may be while still being
+// treated as inside them. A box the near plane cuts through can report
+// zero samples even though the Chunk fills the screen.
+const static float NEAR_BOX_MARGIN = 1.f;
+// Boxes are pushed out this far so their faces never tie in depth with the
+// block faces lying on the Chunk's bounds
+const static float BOX_INFLATE = 0.05f;
+
+OcclusionCuller::OcclusionCuller(OpenGLContext *context)
+    : mp_context(context), m_prog(context), m_bufPos(0), m_bufIdx(0),
+      m_created(false), m_enabled(true), m_states(), m_tested(0), m_culled(0)
+{}
+
+void OcclusionCuller::create()
+{
+    m_prog.create(":/glsl/occlusion.vert.glsl", ":/glsl/occlusion.frag.glsl");
+
+    GLfloat positions[8 * 4];
+    for (int i = 0; i < 8; ++i) {
+        positions[4 * i]     = (i & 1) ? 1.f : 0.f;
+        positions[4 * i + 1] = (i & 2) ? 1.f : 0.f;
+        positions[4 * i + 2] = (i & 4) ? 1.f : 0.f;
+        positions[4 * i + 3] = 1.f;
+    }
+    // Two triangles per face; winding does not matter since nothing is culled
+    GLuint idx[36] = {
+        0, 1, 3, 0, 3, 2,   // z = 0
+        4, 5, 7, 4, 7, 6,   // z = 1
+        0, 2, 6, 0, 6, 4,   // x = 0
+        1, 3, 7, 1, 7, 5,   // x = 1
+        0, 1, 5, 0, 5, 4,   // y = 0
+        2, 3, 7, 2, 7, 6    // y = 1
+    };
+
+    mp_context->glGenBuffers(1, &m_bufPos);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+    mp_context->glGenBuffers(1, &m_bufIdx);
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
+    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(idx), idx, GL_STATIC_DRAW);
+
+    m_created = true;
+    mp_context->printGLErrorLog();
+}
+
+void OcclusionCuller::destroy()
+{
+    for (auto &entry : m_states) {
+        mp_context->glDeleteQueries(1, &entry.second.query);
+    }
+    m_states.clear();
+    if (m_created) {
+        mp_context->glDeleteBuffers(1, &m_bufPos);
+        mp_context->glDeleteBuffers(1, &m_bufIdx);
+        m_created = false;
+    }
+}
+
+void OcclusionCuller::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool OcclusionCuller::isEnabled() const
+{
+    return m_enabled;
+}
+
+void OcclusionCuller::beginFrame()
+{
+    m_tested = 0;
+    m_culled = 0;
+}
+
+bool OcclusionCuller::isOccluded(const Chunk *c)
+{
+    if (!m_enabled) {
+        return false;
+    }
+    ++m_tested;
+    auto it = m_states.find(c);
+    if (it == m_states.end()) {
+        return false;
+    }
+    QueryState &state = it->second;
+    if (state.pending) {
+        GLint available = 0;
+        mp_context->glGetQueryObjectiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint samples = 0;
+            mp_context->glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &samples);
+            state.occluded = samples == 0;
+            state.pending = false;
+        }
+    }
+    if (state.occluded) {
+        ++m_culled;
+    }
+    return state.occluded;
+}
+
+void OcclusionCuller::issueQueries(const std::vector<const Chunk*> &chunks, glm::vec3 eye)
+{
+    if (!m_enabled || !m_created || chunks.empty()) {
+        return;
+    }
+
+    // The camera comes from the FrameData block, already uploaded this frame
+    m_prog.useMe();
+    mp_context->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    mp_context->glDepthMask(GL_FALSE);
+
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+    mp_context->enableVertexAttribs({m_prog.attrPos});
+    mp_context->glVertexAttribPointer(m_prog.attrPos, 4, GL_FLOAT, false, 0, (void*)(0));
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
+
+    for (const Chunk *c : chunks) {
+        glm::vec3 lo = c->boundsMin();
+        glm::vec3 hi = c->boundsMax();
+        if (lo.y > hi.y) {
+            continue; // Nothing to draw
+        }
+        auto it = m_states.find(c);
+        if (it == m_states.end()) {
+            QueryState state = {0, false, false};
+            mp_context->glGenQueries(1, &state.query);
+            it = m_states.emplace(c, state).first;
+        }
+        QueryState &state = it->second;
+        if (state.pending) {
+            continue;
+        }
+        if (glm::all(glm::greaterThanEqual(eye, lo - NEAR_BOX_MARGIN)) &&
+                glm::all(glm::lessThanEqual(eye, hi + NEAR_BOX_MARGIN))) {
+            state.occluded = false;
+            continue;
+        }
+
+        lo -= BOX_INFLATE;
+        hi += BOX_INFLATE;
+        glm::mat4 model = glm::translate(glm::mat4(1.f), lo) * glm::scale(glm::mat4(1.f), hi - lo);
+        mp_context->glUniformMatrix4fv(m_prog.unifModel, 1, GL_FALSE, &model[0][0]);
+        mp_context->glBeginQuery(GL_SAMPLES_PASSED, state.query);
+        mp_context->glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        mp_context->glEndQuery(GL_SAMPLES_PASSED);
+        state.pending = true;
+    }
+
+    mp_context->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    mp_context->glDepthMask(GL_TRUE);
+    mp_context->printGLErrorLog();
+}
+
+size_t OcclusionCuller::testedCount() const
+{
+    return m_tested;
+}
+
+size_t OcclusionCuller::culledCount() const
+{
+    return m_culled;
+}
+
+float OcclusionCuller::culledFraction() const
+{
+    if (m_tested == 0) {
+        return 0.f;
+    }
+    return static_cast<float>(m_culled) / m_tested;
+}
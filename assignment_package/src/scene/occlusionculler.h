@@ -0,0 +1,60 @@
+#pragma once
+#include "glm_includes.h"
+#include "openglcontext.h"
+#include "shaderprogram.h"
+#include "chunk.h"
+#include <unordered_map>
+#include <vector>
+
+// Skips Chunks that were completely hidden behind other geometry last
+// frame. After the main pass has filled the depth buffer, the bounding box
+// of every candidate Chunk is drawn inside a GL_SAMPLES_PASSED query with
+// color and depth writes off. Results are only read back once the GPU has
+// them, so a query never stalls the frame; until then a Chunk keeps
+// whatever visibility it had.
+class OcclusionCuller
+{
+private:
+    struct QueryState {
+        GLuint query;
+        bool pending;   // Issued but the result has not been read yet
+        bool occluded;  // No samples passed the last time a result came back
+    };
+
+    OpenGLContext *mp_context;
+    ShaderProgram m_prog;
+    GLuint m_bufPos;    // Unit cube corners
+    GLuint m_bufIdx;    // Its 12 triangles
+    bool m_created;
+    bool m_enabled;
+
+    std::unordered_map<const Chunk*, QueryState> m_states;
+
+    // Counted by isOccluded() since the last beginFrame()
+    size_t m_tested;
+    size_t m_culled;
+
+public:
+    OcclusionCuller(OpenGLContext *context);
+
+    void create();
+    void destroy();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    // Resets the per-frame culling counters
+    void beginFrame();
+    // Whether c's most recent query found it hidden.
+    // Always false while culling is disabled.
+    bool isOccluded(const Chunk *c);
+    // Queries the bounds of every given Chunk against the depth buffer
+    // currently bound. Chunks whose previous query is still in flight
+    // are skipped.
+    void issueQueries(const std::vector<const Chunk*> &chunks, glm::vec3 eye);
+
+    size_t testedCount() const;
+    size_t culledCount() const;
+    // Share of the Chunks tested this frame that were skipped
+    float culledFraction() const;
+};
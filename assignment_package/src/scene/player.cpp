@@ -5,7 +5,7 @@
 Player::Player(glm::vec3 pos, const Terrain &terrain)
     : Entity(pos), m_velocity(0,0,0), m_acceleration(0,0,0),
       m_camera(pos + glm::vec3(0, 1.5f, 0)), mcr_terrain(terrain), m_phi(0.f),
-      accel(0.f), mcr_camera(m_camera), m_flightOn(true), m_spacePressed(false)
+      accel(0.f), mcr_camera(m_camera), mcr_velocity(m_velocity), m_flightOn(true), m_spacePressed(false)
 {}
 
 Player::~Player()
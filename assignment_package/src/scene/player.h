@@ -19,6 +19,8 @@ public:
     // Readonly public reference to our camera
     // for easy access from MyGL
     const Camera& mcr_camera;
+    // Readonly velocity, for predicting where terrain will be needed
+    const glm::vec3& mcr_velocity;
     bool m_flightOn; // Boolean to toggle flight mode
     bool m_spacePressed; // Boolean to track spacebar press
 
@@ -26,7 +28,7 @@ public:
     virtual ~Player() override;
 
     // Used for collision and determining what block to remove
-    bool gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection,
+    static bool gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection,
             const Terrain &terrain, float *out_dist, glm::ivec3 *out_blockHit);
 
     void setCameraWidthHeight(unsigned int w, unsigned int h);
@@ -2,29 +2,19 @@
 #define QUAD_H
 
 #include "drawable.h"
-#    include <glm/glm.hpp>
-// For glm::translate, glm::rotate, and glm::scale.
-#    include <glm/gtc/matrix_transform.hpp>
-// For glm::to_string.
-#    include <glm/gtx/string_cast.hpp>
-// For glm::value_ptr.
-#    include <glm/gtc/type_ptr.hpp>
-
-#include <QOpenGLContext>
-#include <QOpenGLBuffer>
-#include <QOpenGLShaderProgram>
 
+// A single triangle that covers the whole screen, for the sky and the post
+// processing passes. It has no vertex data at all: vertex shaders drawing it
+// build its corners and UVs from gl_VertexID (see passthrough.vert.glsl),
+// so nothing is ever uploaded for it.
 class Quad : public Drawable
 {
-private:
-    std::vector<GLuint> idx;
-    // pos and uv data
-    std::vector<glm::vec4> data;
 public:
     Quad(OpenGLContext* context);
+    // Nothing to create; kept so Quad is a Drawable like any other
     virtual void create();
-    void createCube();
-    void bufferVBOdata();
+    // Issues the draw with whichever program is bound
+    void draw();
 };
 
 #endif // QUAD_H
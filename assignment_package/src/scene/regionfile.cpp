@@ -0,0 +1,235 @@
+#include "regionfile.h"
+#include <QSaveFile>
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Every region file starts with this and a format version,
+// followed by the RegionEntry table
+const static char REGION_MAGIC[4] = {'M', 'M', 'R', 'G'};
+// Version 1 payloads held only blocks. They read back as version 2 ones
+// without fluid levels, so such files are upgraded in place.
+const static quint32 REGION_VERSION = 2;
+const static quint32 BLOCKS_ONLY_VERSION = 1;
+const static qint64 REGION_HEADER_SIZE = sizeof(REGION_MAGIC) + sizeof(quint32) +
+                                         REGION_CHUNK_COUNT * sizeof(RegionEntry);
+// Files are only rewritten to reclaim space once they are at least this
+// large and less than half of their payload bytes are live
+const static qint64 COMPACT_MIN_BYTES = 4 << 20;
+
+RegionFile::RegionFile()
+    : m_file(), m_map(nullptr), m_mapSize(0), m_entries(), m_liveBytes(0), m_unsynced(false)
+{}
+
+RegionFile::~RegionFile()
+{
+    unmap();
+    m_file.close();
+}
+
+bool RegionFile::open(const QString &path, bool create)
+{
+    if (!create && !QFile::exists(path)) {
+        return false;
+    }
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qDebug() << "Could not open region file" << path;
+        return false;
+    }
+
+    m_entries.fill(RegionEntry{0, 0});
+    m_liveBytes = 0;
+    qint64 size = m_file.size();
+    if (size < REGION_HEADER_SIZE) {
+        return reset();
+    }
+
+    char magic[sizeof(REGION_MAGIC)];
+    quint32 version = 0;
+    m_file.seek(0);
+    if (m_file.read(magic, sizeof(magic)) != sizeof(magic) ||
+            m_file.read(reinterpret_cast<char*>(&version), sizeof(version)) != sizeof(version) ||
+            std::memcmp(magic, REGION_MAGIC, sizeof(magic)) != 0 ||
+            (version != REGION_VERSION && version != BLOCKS_ONLY_VERSION)) {
+        qDebug() << "Discarding unreadable region file" << path;
+        return reset();
+    }
+    if (version != REGION_VERSION) {
+        m_file.seek(sizeof(REGION_MAGIC));
+        m_file.write(reinterpret_cast<const char*>(&REGION_VERSION), sizeof(REGION_VERSION));
+        m_unsynced = true;
+    }
+    qint64 tableSize = REGION_CHUNK_COUNT * sizeof(RegionEntry);
+    if (m_file.read(reinterpret_cast<char*>(m_entries.data()), tableSize) != tableSize) {
+        return reset();
+    }
+    // An entry pointing past the end was never finished writing
+    for (RegionEntry &e : m_entries) {
+        if (e.offset != 0 && (e.offset < REGION_HEADER_SIZE || e.offset + static_cast<qint64>(e.length) > size)) {
+            e = RegionEntry{0, 0};
+        }
+        m_liveBytes += e.length;
+    }
+    return true;
+}
+
+bool RegionFile::reset()
+{
+    unmap();
+    m_entries.fill(RegionEntry{0, 0});
+    m_liveBytes = 0;
+    if (!m_file.resize(0) || !m_file.seek(0)) {
+        return false;
+    }
+    m_file.write(REGION_MAGIC, sizeof(REGION_MAGIC));
+    m_file.write(reinterpret_cast<const char*>(&REGION_VERSION), sizeof(REGION_VERSION));
+    m_file.write(reinterpret_cast<const char*>(m_entries.data()), REGION_CHUNK_COUNT * sizeof(RegionEntry));
+    return m_file.flush();
+}
+
+bool RegionFile::map()
+{
+    if (m_map != nullptr) {
+        return true;
+    }
+    m_mapSize = m_file.size();
+    m_map = m_file.map(0, m_mapSize);
+    return m_map != nullptr;
+}
+
+void RegionFile::unmap()
+{
+    if (m_map != nullptr) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+        m_mapSize = 0;
+    }
+}
+
+bool RegionFile::contains(int index) const
+{
+    return m_entries[index].offset != 0;
+}
+
+QByteArray RegionFile::read(int index)
+{
+    const RegionEntry &e = m_entries[index];
+    if (e.offset == 0 || !map()) {
+        return QByteArray();
+    }
+    // qUncompress hands back an empty array for a damaged payload
+    return qUncompress(m_map + e.offset, static_cast<int>(e.length));
+}
+
+bool RegionFile::write(int index, const QByteArray &payload)
+{
+    QByteArray compressed = qCompress(payload);
+    // Appending may grow the file past the mapping, and some platforms
+    // refuse to grow a mapped file at all
+    unmap();
+
+    // Append first; the old copy stays valid until the entry is swapped
+    m_unsynced = true;
+    qint64 end = m_file.size();
+    if (!m_file.seek(end) || m_file.write(compressed) != compressed.size() || !m_file.flush()) {
+        qDebug() << "Could not append to region file" << m_file.fileName();
+        m_file.resize(end);
+        return false;
+    }
+    RegionEntry &e = m_entries[index];
+    m_liveBytes += compressed.size() - static_cast<qint64>(e.length);
+    e = RegionEntry{static_cast<quint32>(end), static_cast<quint32>(compressed.size())};
+    qint64 entryPos = sizeof(REGION_MAGIC) + sizeof(quint32) + index * sizeof(RegionEntry);
+    if (!m_file.seek(entryPos) ||
+            m_file.write(reinterpret_cast<const char*>(&e), sizeof(RegionEntry)) != sizeof(RegionEntry) ||
+            !m_file.flush()) {
+        qDebug() << "Could not update region file header" << m_file.fileName();
+        return false;
+    }
+
+    qint64 payloadBytes = m_file.size() - REGION_HEADER_SIZE;
+    if (payloadBytes >= COMPACT_MIN_BYTES && m_liveBytes * 2 < payloadBytes) {
+        compact();
+    }
+    return true;
+}
+
+bool RegionFile::sync()
+{
+    if (!m_unsynced) {
+        return true;
+    }
+    if (!m_file.isOpen() || !m_file.flush()) {
+        return false;
+    }
+#ifdef _WIN32
+    bool synced = _commit(m_file.handle()) == 0;
+#else
+    bool synced = fsync(m_file.handle()) == 0;
+#endif
+    if (!synced) {
+        qDebug() << "Could not sync region file" << m_file.fileName();
+        return false;
+    }
+    m_unsynced = false;
+    return true;
+}
+
+bool RegionFile::compact()
+{
+    if (!map()) {
+        return false;
+    }
+    // Gather the live payloads first; the file is replaced underneath us
+    std::array<RegionEntry, REGION_CHUNK_COUNT> entries = m_entries;
+    std::vector<char> payloads;
+    payloads.reserve(m_liveBytes);
+    quint32 offset = REGION_HEADER_SIZE;
+    for (int i = 0; i < REGION_CHUNK_COUNT; ++i) {
+        RegionEntry &e = entries[i];
+        if (e.offset == 0) {
+            continue;
+        }
+        payloads.insert(payloads.end(), m_map + e.offset, m_map + e.offset + e.length);
+        e.offset = offset;
+        offset += e.length;
+    }
+    QString path = m_file.fileName();
+    unmap();
+    m_file.close();
+
+    // Written beside the old file and renamed over it, so the old file is
+    // complete until the new one is
+    QSaveFile file(path);
+    bool written = file.open(QIODevice::WriteOnly);
+    if (written) {
+        file.write(REGION_MAGIC, sizeof(REGION_MAGIC));
+        file.write(reinterpret_cast<const char*>(&REGION_VERSION), sizeof(REGION_VERSION));
+        file.write(reinterpret_cast<const char*>(entries.data()), REGION_CHUNK_COUNT * sizeof(RegionEntry));
+        file.write(payloads.data(), static_cast<qint64>(payloads.size()));
+        written = file.commit();
+    }
+    if (!written) {
+        qDebug() << "Could not compact region file" << path;
+    }
+    return open(path, true) && written;
+}
+
+int RegionFile::regionOf(int coord)
+{
+    return static_cast<int>(std::floor(coord / 16.f / REGION_LENGTH_IN_CHUNKS));
+}
+
+int RegionFile::indexOf(int x, int z)
+{
+    int chunkX = static_cast<int>(std::floor(x / 16.f)) - regionOf(x) * REGION_LENGTH_IN_CHUNKS;
+    int chunkZ = static_cast<int>(std::floor(z / 16.f)) - regionOf(z) * REGION_LENGTH_IN_CHUNKS;
+    return chunkX + chunkZ * REGION_LENGTH_IN_CHUNKS;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <array>
+
+// A region groups 32 x 32 Chunks into one file
+#define REGION_LENGTH_IN_CHUNKS 32
+#define REGION_CHUNK_COUNT (REGION_LENGTH_IN_CHUNKS * REGION_LENGTH_IN_CHUNKS)
+
+// Where one Chunk's compressed payload lives in its region file.
+// An offset of 0 means the Chunk was never saved.
+struct RegionEntry {
+    quint32 offset;
+    quint32 length;
+};
+
+// One region file: a header holding a RegionEntry for every Chunk of the
+// region, followed by the Chunks' compressed payloads in no particular
+// order, so finding a Chunk takes a single lookup in the header.
+//
+// Payloads are read straight out of a memory mapping of the file. A Chunk
+// saved again is appended to the end of the file first, and only then is
+// its header entry swapped to point at it, so a crash mid-write leaves the
+// previous copy in place. The space old copies leave behind is reclaimed by
+// rewriting the file once it is mostly garbage.
+//
+// Not thread safe; RegionStore serializes all access.
+class RegionFile
+{
+private:
+    QFile m_file;
+    uchar *m_map;       // The file as of the last read, or null
+    qint64 m_mapSize;
+    std::array<RegionEntry, REGION_CHUNK_COUNT> m_entries;
+    qint64 m_liveBytes; // Payload bytes the header still points at
+    bool m_unsynced;    // Written to since the last sync()
+
+    // Writes an empty header over whatever the file held
+    bool reset();
+    bool map();
+    void unmap();
+    // Rewrites the file with only the live payloads
+    bool compact();
+
+public:
+    RegionFile();
+    ~RegionFile();
+
+    // Opens the region file at path, creating it if create is set.
+    // Returns false if it does not exist or cannot be opened.
+    bool open(const QString &path, bool create);
+
+    bool contains(int index) const;
+    // The decompressed payload of the Chunk at index, or an empty array
+    // if it was never saved or is damaged
+    QByteArray read(int index);
+    // Writes are flushed but not synced, so several can share one sync()
+    bool write(int index, const QByteArray &payload);
+    // Forces every write so far onto the disk
+    bool sync();
+
+    // Index within its region of the Chunk whose lower-left corner is
+    // at (x, z), and the region that Chunk belongs to
+    static int indexOf(int x, int z);
+    static int regionOf(int coord);
+};
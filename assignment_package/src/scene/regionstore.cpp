@@ -0,0 +1,222 @@
+#include "regionstore.h"
+#include "lightengine.h"
+#include <QDir>
+#include <QDebug>
+#include <chrono>
+#include <cstring>
+
+// A flowing fluid block's index into the Chunk's blocks, then its level
+const static int FLUID_RECORD_SIZE = sizeof(quint16) + 1;
+
+static int64_t regionKey(int regionX, int regionZ)
+{
+    return (static_cast<int64_t>(regionX) << 32) | static_cast<uint32_t>(regionZ);
+}
+
+RegionStore::RegionStore(const QString &directory)
+    : m_directory(directory),
+      m_available(false), m_regionMutex(), m_regions(), m_jobMutex(), m_jobAdded(), m_idle(),
+      m_jobs(), m_busy(false), m_stopping(false), m_thread(), m_loadedCount(0), m_loadNs(0)
+{
+    m_available = QDir().mkpath(m_directory);
+    if (!m_available) {
+        qDebug() << "Could not create the world directory" << m_directory << "; nothing will be saved.";
+    }
+    m_thread = std::thread(&RegionStore::run, this);
+}
+
+RegionStore::~RegionStore()
+{
+    m_jobMutex.lock();
+    m_stopping = true;
+    m_jobMutex.unlock();
+    m_jobAdded.notify_one();
+    m_thread.join();
+}
+
+RegionFile* RegionStore::regionFor(int x, int z, bool create)
+{
+    int regionX = RegionFile::regionOf(x);
+    int regionZ = RegionFile::regionOf(z);
+    int64_t key = regionKey(regionX, regionZ);
+    auto it = m_regions.find(key);
+    if (it != m_regions.end()) {
+        return it->second.get();
+    }
+    if (!m_available) {
+        return nullptr;
+    }
+    QString name = QString("r.") + QString::number(regionX) + "." + QString::number(regionZ) + ".mmr";
+    uPtr<RegionFile> region = mkU<RegionFile>();
+    if (!region->open(QDir(m_directory).filePath(name), create)) {
+        return nullptr;
+    }
+    RegionFile *ptr = region.get();
+    m_regions[key] = std::move(region);
+    return ptr;
+}
+
+bool RegionStore::hasChunk(int x, int z)
+{
+    std::lock_guard<std::mutex> lock(m_regionMutex);
+    RegionFile *region = regionFor(x, z, false);
+    return region != nullptr && region->contains(RegionFile::indexOf(x, z));
+}
+
+void RegionStore::loadAsync(std::vector<Chunk*> chunks, BlockData *loaded, GenerateFn generate)
+{
+    Job job = {LOAD_JOB, 0, 0, QByteArray(), chunks, loaded, generate, nullptr};
+    m_jobMutex.lock();
+    m_jobs.push_back(job);
+    m_jobMutex.unlock();
+    m_jobAdded.notify_one();
+}
+
+void RegionStore::saveAsync(const Chunk &c)
+{
+    const std::unordered_map<int, unsigned char> &levels = c.fluidLevels();
+    QByteArray payload(reinterpret_cast<const char*>(c.blocks()), CHUNK_BLOCK_COUNT);
+    payload.reserve(CHUNK_BLOCK_COUNT + FLUID_RECORD_SIZE * static_cast<int>(levels.size()));
+    for (const auto &entry : levels) {
+        quint16 index = static_cast<quint16>(entry.first);
+        payload.append(reinterpret_cast<const char*>(&index), sizeof(index));
+        payload.append(static_cast<char>(entry.second));
+    }
+    Job job = {SAVE_JOB, c.X, c.Z, payload, std::vector<Chunk*>(), nullptr, nullptr, nullptr};
+    m_jobMutex.lock();
+    m_jobs.push_back(job);
+    m_jobMutex.unlock();
+    m_jobAdded.notify_one();
+}
+
+void RegionStore::syncAsync(std::function<void()> synced)
+{
+    Job job = {SYNC_JOB, 0, 0, QByteArray(), std::vector<Chunk*>(), nullptr, nullptr, synced};
+    m_jobMutex.lock();
+    m_jobs.push_back(job);
+    m_jobMutex.unlock();
+    m_jobAdded.notify_one();
+}
+
+void RegionStore::runAsync(std::function<void()> task)
+{
+    Job job = {TASK_JOB, 0, 0, QByteArray(), std::vector<Chunk*>(), nullptr, nullptr, task};
+    m_jobMutex.lock();
+    m_jobs.push_back(job);
+    m_jobMutex.unlock();
+    m_jobAdded.notify_one();
+}
+
+void RegionStore::waitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(m_jobMutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+}
+
+void RegionStore::run()
+{
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_jobMutex);
+        m_jobAdded.wait(lock, [this] { return !m_jobs.empty() || m_stopping; });
+        if (m_jobs.empty()) {
+            break; // Stopping, and every save has been written
+        }
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy = true;
+        bool stopping = m_stopping;
+        lock.unlock();
+
+        if (job.type == SAVE_JOB) {
+            save(job);
+        } else if (job.type == SYNC_JOB) {
+            if (sync()) {
+                job.task();
+            }
+        } else if (job.type == TASK_JOB) {
+            job.task();
+        } else if (!stopping) {
+            // Nobody will draw what we load once we are shutting down
+            load(job);
+        }
+
+        lock.lock();
+        m_busy = false;
+        if (m_jobs.empty()) {
+            m_idle.notify_all();
+        }
+    }
+}
+
+void RegionStore::load(Job &job)
+{
+    std::vector<Chunk*> missing;
+    for (Chunk *c : job.chunks) {
+        auto start = std::chrono::steady_clock::now();
+        QByteArray payload;
+        m_regionMutex.lock();
+        RegionFile *region = regionFor(c->X, c->Z, false);
+        if (region != nullptr) {
+            payload = region->read(RegionFile::indexOf(c->X, c->Z));
+        }
+        m_regionMutex.unlock();
+
+        if (payload.size() < CHUNK_BLOCK_COUNT || (payload.size() - CHUNK_BLOCK_COUNT) % FLUID_RECORD_SIZE != 0) {
+            missing.push_back(c);
+            continue;
+        }
+        {
+            auto lock = c->writeBlocks();
+            c->setBlocks(reinterpret_cast<const BlockType*>(payload.constData()));
+            for (int at = CHUNK_BLOCK_COUNT; at < payload.size(); at += FLUID_RECORD_SIZE) {
+                const char *record = payload.constData() + at;
+                quint16 block;
+                std::memcpy(&block, record, sizeof(block));
+                c->setFluidLevel(block % 16, (block / 16) % 256, block / (16 * 256),
+                                 static_cast<unsigned char>(record[sizeof(block)]));
+            }
+            // Light is not saved; it follows from the blocks
+            LightEngine::lightChunk(*c);
+        }
+        m_loadNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        ++m_loadedCount;
+        job.loaded->addChunk(c);
+    }
+    if (!missing.empty()) {
+        qDebug() << missing.size() << "saved Chunks could not be read back; generating them instead.";
+        job.generate(missing, job.loaded);
+    }
+}
+
+void RegionStore::save(Job &job)
+{
+    std::lock_guard<std::mutex> lock(m_regionMutex);
+    RegionFile *region = regionFor(job.x, job.z, true);
+    if (region != nullptr) {
+        region->write(RegionFile::indexOf(job.x, job.z), job.payload);
+    }
+}
+
+bool RegionStore::sync()
+{
+    std::lock_guard<std::mutex> lock(m_regionMutex);
+    bool synced = true;
+    for (auto &entry : m_regions) {
+        synced = entry.second->sync() && synced;
+    }
+    return synced;
+}
+
+int RegionStore::loadedCount() const
+{
+    return m_loadedCount;
+}
+
+float RegionStore::averageLoadMs() const
+{
+    int count = m_loadedCount;
+    if (count == 0) {
+        return 0.f;
+    }
+    return m_loadNs / 1000000.f / count;
+}
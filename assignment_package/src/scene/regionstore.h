@@ -0,0 +1,93 @@
+#pragma once
+#include "regionfile.h"
+#include "BlockTypeData.h"
+#include "smartpointerhelp.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Saves Chunks' block data to region files in one directory and loads it
+// back. All file access happens on one IO thread of its own, so the GL
+// thread only ever queues work and checks the headers.
+//
+// A Chunk's payload is its CHUNK_BLOCK_COUNT blocks followed by the level
+// of every flowing fluid block, as a 16-bit block index and a level byte.
+// Without the levels, flowing fluid would come back as sources.
+class RegionStore
+{
+public:
+    // Fills in the block data of Chunks that could not be loaded
+    typedef void (*GenerateFn)(std::vector<Chunk*> chunks, BlockData *chunksWithData);
+
+private:
+    enum JobType { LOAD_JOB, SAVE_JOB, SYNC_JOB, TASK_JOB };
+    struct Job {
+        JobType type;
+        // Saving: the Chunk's lower-left corner and its payload
+        int x, z;
+        QByteArray payload;
+        // Loading: Chunks to fill in, and where to hand them once filled
+        std::vector<Chunk*> chunks;
+        BlockData *loaded;
+        GenerateFn generate;
+        std::function<void()> task;
+    };
+
+    QString m_directory;
+    bool m_available;
+
+    // Guards m_regions and every file in it
+    std::mutex m_regionMutex;
+    std::unordered_map<int64_t, uPtr<RegionFile>> m_regions;
+
+    std::mutex m_jobMutex;
+    std::condition_variable m_jobAdded;
+    std::condition_variable m_idle;
+    std::deque<Job> m_jobs;
+    bool m_busy;
+    bool m_stopping;
+    std::thread m_thread;
+
+    std::atomic<int> m_loadedCount;
+    std::atomic<long long> m_loadNs;
+
+    // The region file holding the Chunk at (x, z); m_regionMutex must be held.
+    // Null if there is none and create is false.
+    RegionFile* regionFor(int x, int z, bool create);
+    void run();
+    void load(Job &job);
+    void save(Job &job);
+    // False if any region file could not be synced
+    bool sync();
+
+public:
+    RegionStore(const QString &directory);
+    ~RegionStore();
+
+    // Was the Chunk whose lower-left corner is at (x, z) saved before?
+    bool hasChunk(int x, int z);
+
+    // Fills the given Chunks from their saved block data on the IO thread
+    // and adds each to loaded once done. Any that turn out to be missing or
+    // damaged are handed to generate instead.
+    void loadAsync(std::vector<Chunk*> chunks, BlockData *loaded, GenerateFn generate);
+    // Copies the Chunk's blocks and fluid levels, so the IO thread never
+    // reads a Chunk that may be edited, and queues them to be written
+    void saveAsync(const Chunk &c);
+    // Queues one sync of every region file written since the last, then
+    // runs synced on the IO thread, since every save queued before it is on
+    // disk by then. synced is not run if any file failed to sync.
+    void syncAsync(std::function<void()> synced);
+    // Runs task on the IO thread once everything queued before it is done
+    void runAsync(std::function<void()> task);
+    // Blocks until everything queued so far has been loaded or written
+    void waitUntilIdle();
+
+    int loadedCount() const;
+    // Average time to read, decompress and fill in one Chunk
+    float averageLoadMs() const;
+};
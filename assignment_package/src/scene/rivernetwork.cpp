@@ -0,0 +1,218 @@
+#include "rivernetwork.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+// Cells draining at least this many cells, themselves included, carry a river
+const static int RIVER_MIN_CELLS = 48;
+// Kept below half a cell so neighbouring channels stay apart
+const static float MAX_RIVER_RADIUS = 6.f;
+const static float MAX_RIVER_DEPTH = 5.f;
+
+static int64_t regionKey(int regionX, int regionZ)
+{
+    return (static_cast<int64_t>(regionX) << 32) | static_cast<uint32_t>(regionZ);
+}
+
+RiverNetwork::RiverNetwork(SurfaceFn surface)
+    : m_surface(surface), m_mutex(), m_regions()
+{}
+
+std::shared_ptr<const RiverNetwork::Region> RiverNetwork::regionAt(int regionX, int regionZ)
+{
+    std::promise<std::shared_ptr<const Region>> promise;
+    std::shared_future<std::shared_ptr<const Region>> future;
+    bool compute = false;
+    m_mutex.lock();
+    auto it = m_regions.find(regionKey(regionX, regionZ));
+    if (it == m_regions.end()) {
+        future = promise.get_future().share();
+        m_regions[regionKey(regionX, regionZ)] = future;
+        compute = true;
+    } else {
+        future = it->second;
+    }
+    m_mutex.unlock();
+    if (compute) {
+        promise.set_value(computeRegion(regionX, regionZ));
+    }
+    return future.get();
+}
+
+std::shared_ptr<const RiverNetwork::Region> RiverNetwork::computeRegion(int regionX, int regionZ) const
+{
+    // The grid covers the region and MARGIN_CELLS around it. The margin
+    // drains into the padded edge like the region does, so only flow near
+    // that edge differs from what the neighbour works out, and the region
+    // keeps just the segments starting inside it.
+    const int N = REGION_CELLS + 2 * MARGIN_CELLS;
+    glm::vec2 origin(regionX * REGION_BLOCKS, regionZ * REGION_BLOCKS);
+    glm::vec2 gridOrigin = origin - static_cast<float>(MARGIN_CELLS * CELL_BLOCKS);
+    auto cellCenter = [&gridOrigin, N](int c) {
+        return gridOrigin + glm::vec2(c % N, c / N) * static_cast<float>(CELL_BLOCKS) + CELL_BLOCKS * 0.5f;
+    };
+
+    std::vector<float> height(N * N);
+    for (int c = 0; c < N * N; ++c) {
+        glm::vec2 p = cellCenter(c);
+        BlockType type;
+        height[c] = static_cast<float>(m_surface(static_cast<int>(p.x), static_cast<int>(p.y), type));
+    }
+
+    // Priority-flood from the grid's edge, which drains everything. Each
+    // cell drains into the neighbour it was reached from, and pits are
+    // filled up to their spill height so water always runs out of them.
+    std::vector<float> filled(N * N);
+    std::vector<int> receiver(N * N, -1);
+    std::vector<char> visited(N * N, 0);
+    std::vector<int> order;
+    order.reserve(N * N);
+    typedef std::pair<float, int> Entry;
+    // Ties go to the lower index, so the result never depends on the queue
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    for (int c = 0; c < N * N; ++c) {
+        int i = c % N, j = c / N;
+        if (i == 0 || j == 0 || i == N - 1 || j == N - 1) {
+            filled[c] = height[c];
+            visited[c] = 1;
+            open.push(Entry(filled[c], c));
+        }
+    }
+    while (!open.empty()) {
+        int c = open.top().second;
+        open.pop();
+        order.push_back(c);
+        int i = c % N, j = c / N;
+        for (int dj = -1; dj <= 1; ++dj) {
+            for (int di = -1; di <= 1; ++di) {
+                int ni = i + di, nj = j + dj;
+                if (ni < 0 || nj < 0 || ni >= N || nj >= N) {
+                    continue;
+                }
+                int n = ni + N * nj;
+                if (visited[n]) {
+                    continue;
+                }
+                visited[n] = 1;
+                filled[n] = std::max(height[n], filled[c]);
+                receiver[n] = c;
+                open.push(Entry(filled[n], n));
+            }
+        }
+    }
+
+    // Cells come off the queue downstream of everything draining into them,
+    // so walking that order backwards sums each cell's catchment
+    std::vector<int> accumulation(N * N, 1);
+    for (int k = static_cast<int>(order.size()) - 1; k >= 0; --k) {
+        int c = order[k];
+        if (receiver[c] >= 0) {
+            accumulation[receiver[c]] += accumulation[c];
+        }
+    }
+
+    std::shared_ptr<Region> region = std::make_shared<Region>();
+    region->buckets.resize(BUCKET_GRID * BUCKET_GRID);
+    for (int c = 0; c < N * N; ++c) {
+        int i = c % N - MARGIN_CELLS, j = c / N - MARGIN_CELLS;
+        bool owned = i >= 0 && j >= 0 && i < REGION_CELLS && j < REGION_CELLS;
+        if (!owned || receiver[c] < 0 || accumulation[c] < RIVER_MIN_CELLS) {
+            continue;
+        }
+        // Rivers widen and deepen as more of the land drains into them
+        float strength = std::sqrt(accumulation[c] / static_cast<float>(RIVER_MIN_CELLS));
+        Segment s;
+        s.a = cellCenter(c);
+        s.b = cellCenter(receiver[c]);
+        s.levelA = filled[c] - 1.f;
+        s.levelB = filled[receiver[c]] - 1.f;
+        s.radius = glm::clamp(1.f + strength, 2.f, MAX_RIVER_RADIUS);
+        s.depth = glm::clamp(1.f + strength, 2.f, MAX_RIVER_DEPTH);
+
+        int index = static_cast<int>(region->segments.size());
+        region->segments.push_back(s);
+        // Bucket -1 and REGION_BUCKETS lie in the neighbouring regions
+        glm::vec2 low = (glm::min(s.a, s.b) - s.radius - origin) / static_cast<float>(BUCKET_BLOCKS);
+        glm::vec2 high = (glm::max(s.a, s.b) + s.radius - origin) / static_cast<float>(BUCKET_BLOCKS);
+        int bx0 = std::max(-1, static_cast<int>(std::floor(low.x)));
+        int bz0 = std::max(-1, static_cast<int>(std::floor(low.y)));
+        int bx1 = std::min(REGION_BUCKETS, static_cast<int>(std::floor(high.x)));
+        int bz1 = std::min(REGION_BUCKETS, static_cast<int>(std::floor(high.y)));
+        for (int bz = bz0; bz <= bz1; ++bz) {
+            for (int bx = bx0; bx <= bx1; ++bx) {
+                region->buckets[(bx + 1) + BUCKET_GRID * (bz + 1)].push_back(index);
+            }
+        }
+    }
+    return region;
+}
+
+void RiverNetwork::carve(Chunk *chunk)
+{
+    int regionX = static_cast<int>(std::floor(chunk->X / static_cast<float>(REGION_BLOCKS)));
+    int regionZ = static_cast<int>(std::floor(chunk->Z / static_cast<float>(REGION_BLOCKS)));
+    // A Chunk never straddles two buckets
+    int bx = (chunk->X - regionX * REGION_BLOCKS) / BUCKET_BLOCKS;
+    int bz = (chunk->Z - regionZ * REGION_BLOCKS) / BUCKET_BLOCKS;
+    // A Chunk in an edge bucket may also be crossed by segments the
+    // neighbouring regions own
+    std::vector<std::shared_ptr<const Region>> regions; // Own the segments
+    std::vector<const Segment*> segments;
+    for (int dz = -1; dz <= 1; ++dz) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            int nbx = bx - dx * REGION_BUCKETS, nbz = bz - dz * REGION_BUCKETS;
+            if (nbx < -1 || nbz < -1 || nbx > REGION_BUCKETS || nbz > REGION_BUCKETS) {
+                continue;
+            }
+            std::shared_ptr<const Region> region = regionAt(regionX + dx, regionZ + dz);
+            for (int index : region->buckets[(nbx + 1) + BUCKET_GRID * (nbz + 1)]) {
+                segments.push_back(&region->segments[index]);
+            }
+            regions.push_back(region);
+        }
+    }
+    if (segments.empty()) {
+        return;
+    }
+
+    for (int x = 0; x < 16; ++x) {
+        for (int z = 0; z < 16; ++z) {
+            glm::vec2 p(chunk->X + x + 0.5f, chunk->Z + z + 0.5f);
+            // How far inside the nearest channel the column is, from 0 at
+            // its bank to 1 along its middle
+            float inside = 0.f;
+            float level = 0.f;
+            float depth = 0.f;
+            for (const Segment *segment : segments) {
+                const Segment &s = *segment;
+                glm::vec2 ab = s.b - s.a;
+                float h = glm::clamp(glm::dot(p - s.a, ab) / glm::dot(ab, ab), 0.f, 1.f);
+                float d = glm::length(p - s.a - ab * h);
+                float t = 1.f - (d * d) / (s.radius * s.radius);
+                if (t > inside) {
+                    inside = t;
+                    level = glm::mix(s.levelA, s.levelB, h);
+                    depth = s.depth;
+                }
+            }
+            if (inside <= 0.f) {
+                continue;
+            }
+
+            int ground = 255;
+            while (ground > 0 && chunk->getBlockAt(x, ground, z) == EMPTY) {
+                --ground;
+            }
+            int waterTop = static_cast<int>(std::floor(level));
+            int bed = std::max(0, waterTop - static_cast<int>(std::ceil(depth * inside)));
+            // Where the coarse grid filled in a dip the river runs over it
+            if (bed >= ground) {
+                continue;
+            }
+            for (int y = bed + 1; y <= ground; ++y) {
+                chunk->setBlockAt(static_cast<unsigned int>(x), static_cast<unsigned int>(y),
+                                  static_cast<unsigned int>(z), y <= waterTop ? WATER : EMPTY);
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "chunk.h"
+#include "glm_includes.h"
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Rivers for the whole world, worked out from the terrain's heights alone.
+// The world is split into large square regions. Each region's rivers come
+// from flow routing on a coarse grid of its heights, padded with a margin
+// of its neighbours' so water drains across the border instead of ending
+// at it, and land upstream in a neighbour still feeds the region's rivers.
+// Each segment belongs to the one region its upstream end lies in, so a
+// channel crossing a border is worked out once, not once per side. A Chunk
+// carves only the river segments that cross it, whichever region owns them,
+// so every Chunk can be generated on its own, in any order, and still join
+// up with the rivers of its neighbours.
+class RiverNetwork
+{
+public:
+    // The height of the top block of the column at (x, z); type is unused
+    typedef int (*SurfaceFn)(int x, int z, BlockType &type);
+
+    // Coarse cells along one side of a region, and blocks along one side of a cell
+    static const int REGION_CELLS = 64;
+    static const int CELL_BLOCKS = 16;
+    static const int REGION_BLOCKS = REGION_CELLS * CELL_BLOCKS;
+    // Coarse cells of the neighbouring regions routed along with each side
+    static const int MARGIN_CELLS = REGION_CELLS / 2;
+
+private:
+    // One step of a river, from the centre of a coarse cell to the centre
+    // of the cell it drains into
+    struct Segment {
+        glm::vec2 a, b;
+        // Water surface height at each end
+        float levelA, levelB;
+        float radius;
+        float depth;
+    };
+    // Segments are looked up by 64 x 64 block bucket. A region's buckets
+    // reach one past its edge, since segments leaving it end in the next.
+    static const int BUCKET_BLOCKS = 64;
+    static const int REGION_BUCKETS = REGION_BLOCKS / BUCKET_BLOCKS;
+    static const int BUCKET_GRID = REGION_BUCKETS + 2;
+    struct Region {
+        std::vector<Segment> segments;
+        std::vector<std::vector<int>> buckets;
+    };
+
+    SurfaceFn m_surface;
+    std::mutex m_mutex;
+    // Whichever thread asks for a region first computes it; the rest wait
+    std::unordered_map<int64_t, std::shared_future<std::shared_ptr<const Region>>> m_regions;
+
+    std::shared_ptr<const Region> regionAt(int regionX, int regionZ);
+    std::shared_ptr<const Region> computeRegion(int regionX, int regionZ) const;
+
+public:
+    RiverNetwork(SurfaceFn surface);
+
+    // Carves the rivers crossing the Chunk into its freshly filled blocks
+    void carve(Chunk *chunk);
+};
@@ -1,19 +1,81 @@
 #include "terrain.h"
 #include "cube.h"
+#include "rivernetwork.h"
 #include <stdexcept>
 #include <iostream>
 #include <glm/glm.hpp>
+#include <QDir>
+#include <QStandardPaths>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 
 const static bool DEBUGMODE = true;
+// Upper bound on mesh data moved per buffer each time the terrain expands
+const static size_t DEFRAG_BUDGET_BYTES = 1 << 20;
+// How often changed Chunks are written out unless told otherwise
+const static int DEFAULT_AUTOSAVE_MS = 10000;
+
+// Generation timing, for comparing against loading from the region files
+static std::atomic<int> s_generatedCount(0);
+static std::atomic<long long> s_generateNs(0);
+
+// Shared by every thread filling in Chunks
+static RiverNetwork s_rivers(&Terrain::surfaceAt);
+
+// Where the region files and the journal live
+static QString worldDirectory()
+{
+    QString dir = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("world");
+    QDir().mkpath(dir);
+    return dir;
+}
 
 Terrain::Terrain(OpenGLContext *context)
-    : m_chunks(), m_generatedTerrain(), mp_context(context), test(false)
-{}
+    : m_chunks(), m_generatedTerrain(), mp_context(context),
+      m_quadIndices(context),
+      m_opaqueMeshes(context, m_quadIndices, CHUNK_VERTEX_STRIDE),
+      m_transparentMeshes(context, m_quadIndices, CHUNK_VERTEX_STRIDE),
+      m_farTerrain(context, m_quadIndices),
+      m_opaqueCommands(), m_transparentCommands(), m_occlusion(context), m_queryChunks(),
+      m_pvsValid(false), m_pvsOrigin(0), m_pvsWidth(0), m_pvsDepth(0),
+      m_pvsGrid(), m_pvsEntries(), m_pvsChunks(), m_pvsVisibleCount(0),
+      m_journal(worldDirectory()), m_regions(worldDirectory()), m_unsavedChunks(), m_fillingChunks(),
+      m_saveTimer(), m_autosaveMs(DEFAULT_AUTOSAVE_MS),
+      m_lightEngine(), m_meshing(), m_needsRemesh(), m_fluids(),
+      m_prefetchedZones(), m_fillingZones(), m_streamHits(0), m_streamMisses(0), m_stallMs(0.f),
+      m_stallTimer(),
+      test(false)
+{
+    m_saveTimer.start();
+    m_stallTimer.start();
+}
 
 Terrain::~Terrain() {
     //m_geomCube.destroy();
 }
 
+void Terrain::createBuffers()
+{
+    // Roughly enough for the chunks around the player at start up;
+    // MeshBuffer doubles its storage if the world outgrows this.
+    m_opaqueMeshes.create(1 << 18);
+    m_transparentMeshes.create(1 << 15);
+    // Enough quads for a dense Chunk; grows if a larger mesh is uploaded
+    m_quadIndices.create(1 << 15);
+    m_farTerrain.create();
+    m_occlusion.create();
+}
+
+void Terrain::destroyBuffers()
+{
+    m_opaqueMeshes.destroy();
+    m_transparentMeshes.destroy();
+    m_farTerrain.destroy();
+    m_occlusion.destroy();
+    m_quadIndices.destroy();
+}
+
 // Combine two 32-bit ints into one 64-bit int
 // where the upper 32 bits are X and the lower 32 bits are Z
 int64_t toKey(int x, int z) {
@@ -58,6 +120,7 @@ BlockType Terrain::getBlockAt(int x, int y, int z) const
         }
         const uPtr<Chunk> &c = getChunkAt(x, z);
         glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
+        auto lock = c->readBlocks();
         return c->getBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
                              static_cast<unsigned int>(y),
                              static_cast<unsigned int>(z - chunkOrigin.y));
@@ -73,6 +136,45 @@ BlockType Terrain::getBlockAt(glm::vec3 p) const {
     return getBlockAt(p.x, p.y, p.z);
 }
 
+void Terrain::getBlocksAt(const glm::ivec3 *positions, size_t count, BlockType *out, BlockType missing) const
+{
+    // Chunks are never removed while there is a simulation, so once found
+    // a Chunk stays valid without the map lock. Its blocks are read under
+    // its own lock, held across each run of queries landing in it.
+    // Neighboring queries mostly land in the Chunk of the one before, so
+    // only a change of Chunk goes to the cache.
+    std::unordered_map<int64_t, const Chunk*> found;
+    int64_t lastKey = 0;
+    const Chunk *last = nullptr;
+    bool haveLast = false;
+    std::shared_lock<std::shared_mutex> blocksLock;
+    for (size_t i = 0; i < count; ++i) {
+        const glm::ivec3 &p = positions[i];
+        if (p.y < 0 || p.y >= 256) {
+            out[i] = missing;
+            continue;
+        }
+        // Rounds down to a multiple of 16, negative coordinates included
+        int x = p.x & ~15;
+        int z = p.z & ~15;
+        int64_t key = toKey(x, z);
+        if (!haveLast || key != lastKey) {
+            auto it = found.find(key);
+            if (it == found.end()) {
+                std::lock_guard<std::mutex> lock(m_chunksMutex);
+                auto chunk = m_chunks.find(key);
+                it = found.emplace(key, chunk == m_chunks.end() ? nullptr : chunk->second.get()).first;
+            }
+            last = it->second;
+            lastKey = key;
+            haveLast = true;
+            // Never holds two at once, so writers are kept waiting briefly
+            blocksLock = last == nullptr ? std::shared_lock<std::shared_mutex>() : last->readBlocks();
+        }
+        out[i] = last == nullptr ? missing : last->getBlockAt(p.x - x, p.y, p.z - z);
+    }
+}
+
 bool Terrain::hasChunkAt(int x, int z) const {
     // Map x and z to their nearest Chunk corner
     // By flooring x and z, then multiplying by 16,
@@ -83,6 +185,7 @@ bool Terrain::hasChunkAt(int x, int z) const {
     // opposed to (int)(-1 / 16.f) giving us 0 (incorrect!).
     int xFloor = static_cast<int>(glm::floor(x / 16.f));
     int zFloor = static_cast<int>(glm::floor(z / 16.f));
+    std::lock_guard<std::mutex> lock(m_chunksMutex);
     return m_chunks.find(toKey(16 * xFloor, 16 * zFloor)) != m_chunks.end();
 }
 
@@ -90,6 +193,7 @@ bool Terrain::hasChunkAt(int x, int z) const {
 uPtr<Chunk>& Terrain::getChunkAt(int x, int z) {
     int xFloor = static_cast<int>(glm::floor(x / 16.f));
     int zFloor = static_cast<int>(glm::floor(z / 16.f));
+    std::lock_guard<std::mutex> lock(m_chunksMutex);
     return m_chunks[toKey(16 * xFloor, 16 * zFloor)];
 }
 
@@ -97,6 +201,7 @@ uPtr<Chunk>& Terrain::getChunkAt(int x, int z) {
 const uPtr<Chunk>& Terrain::getChunkAt(int x, int z) const {
     int xFloor = static_cast<int>(glm::floor(x / 16.f));
     int zFloor = static_cast<int>(glm::floor(z / 16.f));
+    std::lock_guard<std::mutex> lock(m_chunksMutex);
     return m_chunks.at(toKey(16 * xFloor, 16 * zFloor));
 }
 
@@ -105,10 +210,17 @@ void Terrain::setBlockAt(int x, int y, int z, BlockType t)
     if(hasChunkAt(x, z)) {
         uPtr<Chunk> &c = getChunkAt(x, z);
         glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        c->setBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
-                      static_cast<unsigned int>(y),
-                      static_cast<unsigned int>(z - chunkOrigin.y),
-                      t);
+        unsigned int localX = static_cast<unsigned int>(x - chunkOrigin.x);
+        unsigned int localZ = static_cast<unsigned int>(z - chunkOrigin.y);
+        {
+            auto lock = c->writeBlocks();
+            m_journal.append(BlockEdit{x, y, z, c->getBlockAt(localX, static_cast<unsigned int>(y), localZ), t});
+            c->setBlockAt(localX, static_cast<unsigned int>(y), localZ, t);
+        }
+        m_unsavedChunks.insert(c.get());
+        m_lightEngine.blockChanged(*c, localX, y, localZ);
+        m_fluids.blockChanged(*c, localX, y, localZ);
+        queueRemeshAround(c.get(), static_cast<int>(localX), static_cast<int>(localZ));
     }
     else {
         throw std::out_of_range("Coordinates " + std::to_string(x) +
@@ -117,10 +229,29 @@ void Terrain::setBlockAt(int x, int y, int z, BlockType t)
     }
 }
 
+void Terrain::queueRemeshAround(Chunk *c, int x, int z) {
+    // Neighbors show or hide their faces against this block too,
+    m_needsRemesh.insert(c);
+    Direction borders[2] = {x == 0 ? XNEG : XPOS, z == 0 ? ZNEG : ZPOS};
+    bool onBorder[2] = {x == 0 || x == 15, z == 0 || z == 15};
+    for (int i = 0; i < 2; ++i) {
+        if (onBorder[i] && c->neighbor(borders[i]) != nullptr) {
+            m_needsRemesh.insert(c->neighbor(borders[i]));
+        }
+    }
+    // and the diagonal one shades its corner by it
+    if (onBorder[0] && onBorder[1] && c->neighbor(borders[0]) != nullptr &&
+            c->neighbor(borders[0])->neighbor(borders[1]) != nullptr) {
+        m_needsRemesh.insert(c->neighbor(borders[0])->neighbor(borders[1]));
+    }
+}
+
 Chunk* Terrain::createChunkAt(int x, int z) {
     uPtr<Chunk> chunk = mkU<Chunk>(mp_context, x, z);
     Chunk *cPtr = chunk.get();
+    m_chunksMutex.lock();
     m_chunks[toKey(x, z)] = move(chunk);
+    m_chunksMutex.unlock();
     // Set the neighbor pointers of itself and its neighbors
     if(hasChunkAt(x, z + 16)) {
         auto &chunkNorth = m_chunks[toKey(x, z + 16)];
@@ -141,30 +272,259 @@ Chunk* Terrain::createChunkAt(int x, int z) {
     return cPtr;
 }
 
-// TODO: When you make Chunk inherit from Drawable, change this code so
-// it draws each Chunk with the given ShaderProgram, remembering to set the
-// model matrix to the proper X and Z translation!
-void Terrain::draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram) {
+void Terrain::removeChunk(Chunk *c) {
+    c->unlinkNeighbors();
+    std::lock_guard<std::mutex> lock(m_chunksMutex);
+    m_chunks.erase(toKey(c->X, c->Z));
+}
+
+// Gathers every Chunk in the bounding box into one draw command list per
+// buffer, then renders all of them with a single multi-draw each.
+// Chunk vertices are already in world space, so no model matrix is needed.
+void Terrain::draw(int minX, int maxX, int minZ, int maxZ, glm::vec3 eye, ShaderProgram *shaderProgram,
+                   bool occlusionCull) {
+    m_opaqueCommands.clear();
+    m_transparentCommands.clear();
+    if (occlusionCull) {
+        m_queryChunks.clear();
+        m_occlusion.beginFrame();
+    }
     for(int z = minZ; z <= maxZ; z += BLOCK_LENGTH_IN_CHUNK) {
         for(int x = minX; x <= maxX; x += BLOCK_LENGTH_IN_CHUNK) {
-            if (hasChunkAt(x, z)) {
-                const uPtr<Chunk> &chunk = getChunkAt(x, z);
-                shaderProgram->setModelMatrix(glm::translate(glm::mat4(), glm::vec3(0, 0, 0)));
-                shaderProgram->drawOpaque(*chunk);
+            int xFloor = static_cast<int>(glm::floor(x / 16.f));
+            int zFloor = static_cast<int>(glm::floor(z / 16.f));
+            auto it = m_chunks.find(toKey(16 * xFloor, 16 * zFloor));
+            if (it == m_chunks.end()) {
+                continue;
+            }
+            Chunk *c = it->second.get();
+            if (!isPotentiallyVisible(c)) {
+                continue;
+            }
+            glm::vec2 center(c->X + BLOCK_LENGTH_IN_CHUNK / 2, c->Z + BLOCK_LENGTH_IN_CHUNK / 2);
+            int level = lodForDistance(glm::distance(center, glm::vec2(eye.x, eye.z)));
+            if (level != c->wantedLod()) {
+                c->setWantedLod(level);
+                m_lodRequests.push_back(c);
+            }
+            if (occlusionCull) {
+                // Hidden Chunks are still queried so they reappear once uncovered
+                m_queryChunks.push_back(c);
+                if (m_occlusion.isOccluded(c)) {
+                    continue;
+                }
+            }
+            // Until the right LOD is ready, draw whichever one the Chunk has
+            if (level > 0 && c->lodLevel() > 0) {
+                m_opaqueCommands.add(c->lodRange());
+                m_transparentCommands.add(c->lodTransparentRange());
             } else {
-//                START_PRINT "No chunk at " << x << ", " << z END_PRINT;
+                m_opaqueCommands.add(c->opaqueRange());
+                m_transparentCommands.add(c->transparentRange());
             }
         }
     }
-    for(int z = minZ; z <= maxZ; z += BLOCK_LENGTH_IN_CHUNK) {
-        for(int x = minX; x <= maxX; x += BLOCK_LENGTH_IN_CHUNK) {
-            if (hasChunkAt(x, z)) {
-                const uPtr<Chunk> &chunk = getChunkAt(x, z);
-                shaderProgram->setModelMatrix(glm::translate(glm::mat4(), glm::vec3(0, 0, 0)));
-                shaderProgram->drawOpaque(*chunk);
+    shaderProgram->setModelMatrix(glm::mat4(1.f));
+    shaderProgram->drawMulti(m_opaqueMeshes, m_opaqueCommands);
+    m_farTerrain.draw(shaderProgram);
+    shaderProgram->drawMulti(m_transparentMeshes, m_transparentCommands);
+}
+
+// Step to the neighboring section across each face, indexed by Direction
+const static glm::ivec3 sectionSteps[6] = {
+    glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0),
+    glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0),
+    glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)
+};
+
+void Terrain::updateVisibleSections(int minX, int maxX, int minZ, int maxZ, glm::vec3 eye)
+{
+    m_pvsOrigin = glm::ivec2(minX, minZ);
+    m_pvsWidth = (maxX - minX) / BLOCK_LENGTH_IN_CHUNK + 1;
+    m_pvsDepth = (maxZ - minZ) / BLOCK_LENGTH_IN_CHUNK + 1;
+    m_pvsVisibleCount = 0;
+
+    glm::ivec3 camera(static_cast<int>(glm::floor((eye.x - minX) / BLOCK_LENGTH_IN_CHUNK)),
+                      static_cast<int>(glm::floor(eye.y / CHUNK_SECTION_HEIGHT)),
+                      static_cast<int>(glm::floor((eye.z - minZ) / BLOCK_LENGTH_IN_CHUNK)));
+    // Nothing to walk out from; draw everything
+    m_pvsValid = camera.x >= 0 && camera.x < m_pvsWidth && camera.z >= 0 && camera.z < m_pvsDepth;
+    if (!m_pvsValid) {
+        return;
+    }
+
+    m_pvsGrid.assign(m_pvsWidth * m_pvsDepth, nullptr);
+    for (int z = 0; z < m_pvsDepth; ++z) {
+        for (int x = 0; x < m_pvsWidth; ++x) {
+            auto it = m_chunks.find(toKey(minX + x * BLOCK_LENGTH_IN_CHUNK, minZ + z * BLOCK_LENGTH_IN_CHUNK));
+            if (it != m_chunks.end()) {
+                m_pvsGrid[x + m_pvsWidth * z] = it->second.get();
             }
         }
     }
+    m_pvsEntries.assign(m_pvsGrid.size() * CHUNK_SECTION_COUNT, 0);
+    m_pvsChunks.assign(m_pvsGrid.size(), false);
+
+    auto sectionIndex = [this](const glm::ivec3 &s) {
+        return (s.x + m_pvsWidth * s.z) * CHUNK_SECTION_COUNT + s.y;
+    };
+    // A section is searched once per face it is entered through, since
+    // different faces can lead on to different neighbors
+    struct Visit {
+        glm::ivec3 section;
+        int entry; // A Direction, or -1 for the camera's own section
+    };
+    std::vector<Visit> queue;
+    auto enter = [&](const glm::ivec3 &s, int entry) {
+        FaceMask bit = entry < 0 ? FaceMask(1 << 6) : FaceMask(1 << entry);
+        FaceMask &entries = m_pvsEntries[sectionIndex(s)];
+        if (entries & bit) {
+            return;
+        }
+        entries |= bit;
+        if (!m_pvsChunks[s.x + m_pvsWidth * s.z]) {
+            m_pvsChunks[s.x + m_pvsWidth * s.z] = true;
+            ++m_pvsVisibleCount;
+        }
+        queue.push_back({s, entry});
+    };
+
+    if (camera.y >= CHUNK_SECTION_COUNT) {
+        // Above the world, everything is seen from the top down
+        camera.y = CHUNK_SECTION_COUNT;
+        for (int z = 0; z < m_pvsDepth; ++z) {
+            for (int x = 0; x < m_pvsWidth; ++x) {
+                enter(glm::ivec3(x, CHUNK_SECTION_COUNT - 1, z), YPOS);
+            }
+        }
+    } else if (camera.y < 0) {
+        camera.y = -1;
+        for (int z = 0; z < m_pvsDepth; ++z) {
+            for (int x = 0; x < m_pvsWidth; ++x) {
+                enter(glm::ivec3(x, 0, z), YNEG);
+            }
+        }
+    } else {
+        enter(camera, -1);
+    }
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        Visit v = queue[head];
+        Chunk *c = m_pvsGrid[v.section.x + m_pvsWidth * v.section.z];
+        // Columns with no Chunk yet are open air
+        FaceMask exits = ALL_FACES;
+        if (v.entry >= 0 && c != nullptr) {
+            exits = c->sectionLinks(v.section.y, static_cast<Direction>(v.entry));
+        }
+        glm::ivec3 fromCamera = v.section - camera;
+        for (int face = 0; face < 6; ++face) {
+            if (!(exits & (1 << face))) {
+                continue;
+            }
+            // A line of sight never doubles back, so only walk away from
+            // the camera along each axis
+            glm::ivec3 step = sectionSteps[face];
+            if (glm::any(glm::lessThan(step * fromCamera, glm::ivec3(0)))) {
+                continue;
+            }
+            glm::ivec3 next = v.section + step;
+            if (next.x < 0 || next.x >= m_pvsWidth || next.z < 0 || next.z >= m_pvsDepth ||
+                    next.y < 0 || next.y >= CHUNK_SECTION_COUNT) {
+                continue;
+            }
+            enter(next, oppositeDirection.at(static_cast<Direction>(face)));
+        }
+    }
+}
+
+bool Terrain::isPotentiallyVisible(const Chunk *c) const
+{
+    if (!m_pvsValid) {
+        return true;
+    }
+    glm::ivec2 cell = (glm::ivec2(c->X, c->Z) - m_pvsOrigin) / BLOCK_LENGTH_IN_CHUNK;
+    if (c->X < m_pvsOrigin.x || c->Z < m_pvsOrigin.y || cell.x >= m_pvsWidth || cell.y >= m_pvsDepth) {
+        return true;
+    }
+    return m_pvsChunks[cell.x + m_pvsWidth * cell.y];
+}
+
+size_t Terrain::potentiallyVisibleCount() const
+{
+    return m_pvsValid ? m_pvsVisibleCount : m_pvsWidth * m_pvsDepth;
+}
+
+void Terrain::issueOcclusionQueries(glm::vec3 eye)
+{
+    m_occlusion.issueQueries(m_queryChunks, eye);
+}
+
+OcclusionCuller& Terrain::occlusionCuller()
+{
+    return m_occlusion;
+}
+
+int Terrain::lodForDistance(float distance)
+{
+    int level = 0;
+    for (float d = LOD_BASE_DISTANCE; distance >= d && level < MAX_LOD_LEVEL; d *= 2.f) {
+        ++level;
+    }
+    return level;
+}
+
+void Terrain::updateLods()
+{
+#ifdef MAC
+    std::vector<std::thread> threads;
+#endif
+    std::vector<Chunk*> deferred;
+    int jobs = 0;
+    for (Chunk *c : m_lodRequests) {
+        int wanted = c->wantedLod();
+        // Pending Chunks are re-checked once their current build lands
+        if ((wanted == c->lodLevel() && !c->isLodStale()) || c->isLodPending()) {
+            continue;
+        }
+        if (wanted == 0) {
+            c->releaseLod(m_opaqueMeshes, m_transparentMeshes);
+            continue;
+        }
+        // Like a full remesh, never built while the blocks are still
+        // arriving, nor alongside a full remesh of the same Chunk
+        if (jobs >= MAX_LOD_JOBS_PER_TICK || m_meshing.count(c) > 0 || m_fillingChunks.count(c) > 0) {
+            deferred.push_back(c);
+            continue;
+        }
+        c->setLodPending();
+        ++jobs;
+        std::thread t(fillLodVBO, std::ref(*c), wanted, std::ref(this->chunksWithLod));
+#ifdef MAC
+        threads.push_back(std::move(t));
+#endif
+#ifndef MAC
+        t.detach();
+#endif
+    }
+    m_lodRequests.swap(deferred);
+
+#ifdef MAC
+    for (auto &t : threads) {
+        t.join();
+    }
+#endif
+
+    chunksWithLod.mu.lock();
+    for (Chunk* c : chunksWithLod.getVectorData()) {
+        c->bufferLodVBOs(m_opaqueMeshes, m_transparentMeshes);
+        // The camera may have moved on, or the blocks changed, while this
+        // was being built
+        if (c->wantedLod() != c->lodLevel() || c->isLodStale()) {
+            m_lodRequests.push_back(c);
+        }
+    }
+    chunksWithLod.clearChunkData();
+    chunksWithLod.mu.unlock();
 }
 
 void Terrain::CreateTestScene()
@@ -290,7 +650,7 @@ void Terrain::fillColumn(int x, int y, int z, BlockType t) {
     }
 }
 
-void Terrain::expandTerrainBasedOnPlayer(glm::vec3 pos)
+void Terrain::expandTerrainBasedOnPlayer(glm::vec3 pos, glm::vec3 velocity, glm::vec3 look)
 {
     glm::ivec2 centerTerrain = this->getTerrainAt(pos.x, pos.z);
     int leftBound = centerTerrain[0] - BLOCK_LENGTH_IN_TERRAIN * TERRAIN_RADIUS;
@@ -300,15 +660,66 @@ void Terrain::expandTerrainBasedOnPlayer(glm::vec3 pos)
 
     for (int x = leftBound; x <= rightBound; x+= BLOCK_LENGTH_IN_TERRAIN) {
         for (int z = botBound; z <= topBound; z += BLOCK_LENGTH_IN_TERRAIN) {
+            int64_t key = toKey(x, z);
+            if (m_prefetchedZones.erase(key) > 0) {
+                ++m_streamHits;
+            } else if (m_generatedTerrain.count(key) == 0) {
+                ++m_streamMisses;
+            }
             this->generateTerrainZone(x, z);
         }
     }
+    prefetchAlongPath(pos, velocity, look);
+
+    // Stalled while any zone touching the Player's is still being filled in
+    float sinceLastTick = m_stallTimer.restart();
+    bool stalled = false;
+    for (int dx = -1; dx <= 1 && !stalled; ++dx) {
+        for (int dz = -1; dz <= 1 && !stalled; ++dz) {
+            stalled = m_fillingZones.count(toKey(centerTerrain[0] + dx * BLOCK_LENGTH_IN_TERRAIN,
+                                                 centerTerrain[1] + dz * BLOCK_LENGTH_IN_TERRAIN)) > 0;
+        }
+    }
+    if (stalled) {
+        m_stallMs += sinceLastTick;
+    }
 #ifdef MAC
     std::vector<std::thread> threads;
 #endif
     // generate VBOs for each chunk with data
     chunksWithData.mu.lock();
-    for (Chunk* c : chunksWithData.getVectorData()) {
+    std::vector<Chunk*> arrived = chunksWithData.getVectorData();
+    for (Chunk* c : arrived) {
+        m_fillingChunks.erase(c);
+        glm::ivec2 zone = getTerrainAt(c->X, c->Z);
+        auto filling = m_fillingZones.find(toKey(zone.x, zone.y));
+        if (filling != m_fillingZones.end() && --filling->second == 0) {
+            m_fillingZones.erase(filling);
+        }
+        // Its own light was worked out along with its blocks
+        m_lightEngine.stitch(*c);
+        // Edits a crash kept from reaching the region files
+        std::vector<BlockEdit> edits = m_journal.takeEdits(c->X, c->Z);
+        for (const BlockEdit &e : edits) {
+            {
+                auto lock = c->writeBlocks();
+                c->setBlockAt(static_cast<unsigned int>(e.x - c->X), static_cast<unsigned int>(e.y),
+                              static_cast<unsigned int>(e.z - c->Z), e.newType);
+            }
+            m_lightEngine.blockChanged(*c, e.x - c->X, e.y, e.z - c->Z);
+        }
+        if (!edits.empty()) {
+            m_unsavedChunks.insert(c);
+        }
+    }
+    for (Chunk *c : m_lightEngine.takeChanged()) {
+        m_needsRemesh.insert(c);
+    }
+    // Only once every new Chunk is lit, so none is meshed with light
+    // that a later one changes. The new ones need no second meshing.
+    for (Chunk* c : arrived) {
+        m_needsRemesh.erase(c);
+        m_meshing.insert(c);
         std::thread t(fillVBO, std::ref(*c), std::ref(this->chunksWithVBO));
 #ifdef MAC
         threads.push_back(std::move(t));
@@ -330,17 +741,138 @@ void Terrain::expandTerrainBasedOnPlayer(glm::vec3 pos)
 
     chunksWithVBO.mu.lock();
     for (Chunk* c : chunksWithVBO.getVectorData()) {
-        c->bufferToDrawableVBOs();
-        c->bufferTransparentDrawableVBOs();
+        c->bufferToDrawableVBOs(m_opaqueMeshes);
+        c->bufferTransparentDrawableVBOs(m_transparentMeshes);
+        m_meshing.erase(c);
     }
     chunksWithVBO.clearChunkData();
     chunksWithVBO.mu.unlock();
+    updateFluids(sinceLastTick);
+    remeshChanged();
+
+    updateLods();
+
+    // Everything past the generated ring is covered by the heightfield
+    m_farTerrain.update(pos, glm::ivec2(leftBound, botBound),
+                        glm::ivec2(rightBound + BLOCK_LENGTH_IN_TERRAIN, topBound + BLOCK_LENGTH_IN_TERRAIN));
+
+    // Close up the holes left behind by Chunks whose meshes moved,
+    // a little at a time so no single frame pays for all of it
+    m_opaqueMeshes.defragment(DEFRAG_BUDGET_BYTES);
+    m_transparentMeshes.defragment(DEFRAG_BUDGET_BYTES);
+
+    if (m_saveTimer.elapsed() >= m_autosaveMs) {
+        saveChunksAsync();
+    }
 }
 
-void Terrain::makeRivers(glm::ivec2 zonePosition)
+void Terrain::remeshChanged()
 {
-    Lsystem lsystem = Lsystem(*this, zonePosition);
-    lsystem.makeRivers();
+    for (Chunk *c : m_lightEngine.takeChanged()) {
+        m_needsRemesh.insert(c);
+    }
+    for (auto it = m_needsRemesh.begin(); it != m_needsRemesh.end();) {
+        Chunk *c = *it;
+        if (m_meshing.count(c) > 0 || m_fillingChunks.count(c) > 0 || c->isLodPending()) {
+            ++it;
+            continue;
+        }
+        // Whatever changed the full-detail mesh changes the far one too
+        if (c->lodLevel() > 0 || c->wantedLod() > 0) {
+            c->markLodStale();
+            m_lodRequests.push_back(c);
+        }
+        m_meshing.insert(c);
+        std::thread t(fillVBO, std::ref(*c), std::ref(this->chunksWithVBO));
+#ifdef MAC
+        t.join();
+#endif
+#ifndef MAC
+        t.detach();
+#endif
+        it = m_needsRemesh.erase(it);
+    }
+}
+
+void Terrain::updateFluids(float ms)
+{
+    std::vector<FluidSimulator::Cell> changed = m_fluids.advance(ms);
+    // Each Chunk and border neighbor is queued once however much of it flowed
+    for (const FluidSimulator::Cell &cell : changed) {
+        m_lightEngine.blockChanged(*cell.chunk, cell.x, cell.y, cell.z);
+        m_unsavedChunks.insert(cell.chunk);
+        queueRemeshAround(cell.chunk, cell.x, cell.z);
+    }
+}
+
+void Terrain::prefetchAlongPath(glm::vec3 pos, glm::vec3 velocity, glm::vec3 look)
+{
+    int inFlight = 0;
+    for (int64_t key : m_prefetchedZones) {
+        inFlight += m_fillingZones.count(key);
+    }
+    // Only ground speed matters; zones are columns
+    glm::vec2 vel(velocity.x, velocity.z);
+    float speed = glm::length(vel);
+    if (inFlight >= MAX_PREFETCH_ZONES || speed < 1.f) {
+        return;
+    }
+    // Where the Player will be if it keeps going, and where it is looking
+    // in case it is about to turn that way
+    glm::vec2 lookDir(look.x, look.z);
+    lookDir = glm::length(lookDir) > 0.001f ? glm::normalize(lookDir) : vel / speed;
+    glm::vec2 paths[2] = {vel, lookDir * speed};
+    // About two samples per zone crossed
+    float step = BLOCK_LENGTH_IN_TERRAIN * 0.5f / speed;
+    for (float t = step; t <= STREAM_LOOKAHEAD_SECONDS; t += step) {
+        for (const glm::vec2 &path : paths) {
+            glm::vec2 ahead = glm::vec2(pos.x, pos.z) + path * t;
+            glm::ivec2 center = getTerrainAt(ahead.x, ahead.y);
+            for (int dx = -TERRAIN_RADIUS; dx <= TERRAIN_RADIUS; ++dx) {
+                for (int dz = -TERRAIN_RADIUS; dz <= TERRAIN_RADIUS; ++dz) {
+                    int x = center.x + dx * BLOCK_LENGTH_IN_TERRAIN;
+                    int z = center.y + dz * BLOCK_LENGTH_IN_TERRAIN;
+                    if (m_generatedTerrain.count(toKey(x, z)) > 0) {
+                        continue;
+                    }
+                    generateTerrainZone(x, z);
+                    m_prefetchedZones.insert(toKey(x, z));
+                    if (++inFlight >= MAX_PREFETCH_ZONES) {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+StreamingStats Terrain::streamingStats() const
+{
+    int inFlight = 0;
+    for (int64_t key : m_prefetchedZones) {
+        inFlight += m_fillingZones.count(key);
+    }
+    return StreamingStats{m_streamHits, m_streamMisses, m_stallMs, inFlight};
+}
+
+MeshBufferStats Terrain::opaqueVertexStats() const
+{
+    return m_opaqueMeshes.vertexStats();
+}
+
+MeshBufferStats Terrain::transparentVertexStats() const
+{
+    return m_transparentMeshes.vertexStats();
+}
+
+size_t Terrain::quadIndexBytes() const
+{
+    return m_quadIndices.sizeBytes();
+}
+
+MeshBufferStats Terrain::farTerrainStats() const
+{
+    return m_farTerrain.vertexStats();
 }
 
 glm::ivec2 Terrain::getTerrainAt(int x, int z) {
@@ -352,19 +884,26 @@ glm::ivec2 Terrain::getTerrainAt(int x, int z) {
 void Terrain::generateTerrainZone(int x, int z) {
     int64_t coord = toKey(x, z);
     if (this->m_generatedTerrain.find(coord) == this->m_generatedTerrain.end()) {
+        // Zones saved by an earlier run already have their rivers carved
+        if (loadTerrainZoneAsync(x, z)) {
+            this->m_generatedTerrain.insert(coord);
+            return;
+        }
         // generate chunk data in terrain zone
         std::vector<Chunk*> chunks = std::vector<Chunk*>();
         for (int i = 0; i <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; i += BLOCK_LENGTH_IN_CHUNK) {
             for (int j = 0; j <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; j += BLOCK_LENGTH_IN_CHUNK) {
                 Chunk* cPtr = createChunkAt(x + i, z + j);
                 chunks.push_back(cPtr);
+                m_fillingChunks.insert(cPtr);
+                m_unsavedChunks.insert(cPtr);
             }
         }
+        m_fillingZones[coord] += static_cast<int>(chunks.size());
         std::thread t(fillBlockData, chunks, &this->chunksWithData);
 #ifndef MAC
         t.detach();
 #endif
-        makeRivers(glm::ivec2(x, z));
         this->m_generatedTerrain.insert(coord);
 #ifdef MAC
         t.join();
@@ -372,52 +911,207 @@ void Terrain::generateTerrainZone(int x, int z) {
     }
 }
 
-void Terrain::fillBlockData(std::vector<Chunk*> chunks, BlockData *chunksWithData) {
-    // Fill chunk with procedural height and blocktype data
-    for (Chunk* chunk : chunks) {
-        int xPos = chunk->X;
-        int zPos = chunk->Z;
-        for(int x = xPos; x < xPos + BLOCK_LENGTH_IN_CHUNK; ++x) {
-            for(int z = zPos; z < zPos + BLOCK_LENGTH_IN_CHUNK; ++z) {
-                std::vector<float> heights = std::vector<float>();
-                heights.push_back(heightGrassland(x, z));
-                heights.push_back(heightHills(x, z));
-                heights.push_back(heightMountain(x, z));
-                heights.push_back(heightSpire(x, z));
-                float perlin = (Noise::perlinNoise(glm::vec2(x, z) / 1024.f) + 1) / 2.f;
-                perlin = glm::smoothstep(.05f, .9f, perlin);
-                int y = 0;
-                for (int i = 0; i < 4; i++) {
-                    if ((i - 1.f) / 3.f <= perlin && perlin <= (i + 1.f) / 3.f) {
-                        y += (-abs(3.f * perlin - i) + 1.f) * heights[i];
-                    }
-                }
-                BlockType t;
-                float edgeNoise = Noise::perlinNoise(glm::vec2(x, y) * 15.f) * .5f;
-                if (perlin < 0.25f + edgeNoise) { // grassland
-                    t = GRASS;
-                } else  if (perlin > 0.25f + edgeNoise && perlin < 0.5f + edgeNoise) { // hills
-                    t = DIRT;
-                    if (y < 137) {
-                        t = GRASS;
-                    }
-                } else if (perlin > 0.5f+ edgeNoise && perlin < 0.75f + edgeNoise) { // mountain
-                    t = STONE;
-                } else { // spire
-                    if (y < 155) {
-                        fillColumnRangeStatic(x, 155, y, z, WATER, chunk);
-                    }
-                    t = SPIRE_TOP;
+bool Terrain::isZoneSaved(int x, int z) {
+    for (int i = 0; i <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; i += BLOCK_LENGTH_IN_CHUNK) {
+        for (int j = 0; j <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; j += BLOCK_LENGTH_IN_CHUNK) {
+            if (!m_regions.hasChunk(x + i, z + j)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Terrain::loadTerrainZoneAsync(int x, int z) {
+    if (!isZoneSaved(x, z)) {
+        return false;
+    }
+    std::vector<Chunk*> chunks;
+    for (int i = 0; i <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; i += BLOCK_LENGTH_IN_CHUNK) {
+        for (int j = 0; j <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; j += BLOCK_LENGTH_IN_CHUNK) {
+            Chunk* cPtr = createChunkAt(x + i, z + j);
+            chunks.push_back(cPtr);
+            m_fillingChunks.insert(cPtr);
+        }
+    }
+    m_fillingZones[toKey(x, z)] += static_cast<int>(chunks.size());
+    m_regions.loadAsync(chunks, &this->chunksWithData, fillBlockData);
+    return true;
+}
+
+void Terrain::pregenerateZones(const std::vector<glm::ivec2> &zones, int threadCount,
+                               const std::function<void(int done, int total)> &progress) {
+    std::vector<glm::ivec2> todo;
+    for (const glm::ivec2 &zone : zones) {
+        if (m_generatedTerrain.count(toKey(zone.x, zone.y)) == 0 && !isZoneSaved(zone.x, zone.y)) {
+            todo.push_back(zone);
+        }
+    }
+    threadCount = std::max(1, threadCount);
+    // Small enough that an interrupted run keeps most of its work, large
+    // enough to keep every worker busy
+    size_t batchSize = 4 * threadCount;
+    BlockData filled;
+    for (size_t first = 0; first < todo.size(); first += batchSize) {
+        size_t last = std::min(todo.size(), first + batchSize);
+        std::vector<std::vector<Chunk*>> batch;
+        for (size_t k = first; k < last; ++k) {
+            std::vector<Chunk*> chunks;
+            for (int i = 0; i <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; i += BLOCK_LENGTH_IN_CHUNK) {
+                for (int j = 0; j <= BLOCK_LENGTH_IN_TERRAIN - BLOCK_LENGTH_IN_CHUNK; j += BLOCK_LENGTH_IN_CHUNK) {
+                    Chunk* cPtr = createChunkAt(todo[k].x + i, todo[k].y + j);
+                    chunks.push_back(cPtr);
+                    m_unsavedChunks.insert(cPtr);
                 }
-                setBlockAtStatic(x, y, z, t, chunk);
-                if (t == GRASS) {
-                    t = DIRT;
-                } else if (t == SPIRE_TOP) {
-                    t = SPIRE;
+            }
+            m_generatedTerrain.insert(toKey(todo[k].x, todo[k].y));
+            batch.push_back(chunks);
+        }
+
+        // Workers take zones off the batch until none are left
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threadCount; ++t) {
+            workers.push_back(std::thread([&batch, &next, &filled] {
+                for (size_t i = next++; i < batch.size(); i = next++) {
+                    fillBlockData(batch[i], &filled);
                 }
-                fillColumnStatic(x, y - 1, z, t, chunk);
+            }));
+        }
+        for (auto &t : workers) {
+            t.join();
+        }
+        filled.clearChunkData();
+
+        // The last batch's saves ran while this one generated; waiting for
+        // them keeps at most one batch queued
+        m_regions.waitUntilIdle();
+        // Copies the blocks, so the Chunks are not needed after this
+        saveChunksAsync();
+        for (const std::vector<Chunk*> &chunks : batch) {
+            for (Chunk *c : chunks) {
+                removeChunk(c);
             }
         }
+        progress(static_cast<int>(last), static_cast<int>(todo.size()));
+    }
+    saveAll();
+}
+
+void Terrain::saveChunksAsync() {
+    m_saveTimer.restart();
+    // Chunks still being filled wait for the next save, so the journal
+    // keeps their edits
+    std::vector<glm::ivec2> skipped;
+    for (Chunk *c : m_unsavedChunks) {
+        if (m_fillingChunks.count(c) > 0) {
+            skipped.push_back(glm::ivec2(c->X, c->Z));
+        }
+    }
+    // Every other edit so far is in the blocks copied below
+    int sealed = m_journal.rotate(skipped);
+    for (auto it = m_unsavedChunks.begin(); it != m_unsavedChunks.end();) {
+        Chunk *c = *it;
+        if (m_fillingChunks.count(c) > 0) {
+            ++it;
+            continue;
+        }
+        m_regions.saveAsync(*c);
+        it = m_unsavedChunks.erase(it);
+    }
+    // The sealed segments may only go once the saves are synced
+    BlockJournal *journal = &m_journal;
+    m_regions.syncAsync([journal, sealed] { journal->discardThrough(sealed); });
+}
+
+void Terrain::setAutosaveInterval(int ms) {
+    m_autosaveMs = ms;
+}
+
+void Terrain::saveAll() {
+    saveChunksAsync();
+    m_regions.waitUntilIdle();
+}
+
+const RegionStore& Terrain::regions() const {
+    return m_regions;
+}
+
+const FluidSimulator& Terrain::fluids() const
+{
+    return m_fluids;
+}
+
+float Terrain::averageGenerateMs() {
+    int count = s_generatedCount;
+    if (count == 0) {
+        return 0.f;
+    }
+    return s_generateNs / 1000000.f / count;
+}
+
+int Terrain::surfaceAt(int x, int z, BlockType &type) {
+    float heights[4] = {
+        static_cast<float>(heightGrassland(x, z)),
+        static_cast<float>(heightHills(x, z)),
+        static_cast<float>(heightMountain(x, z)),
+        static_cast<float>(heightSpire(x, z))
+    };
+    float perlin = (Noise::perlinNoise(glm::vec2(x, z) / 1024.f) + 1) / 2.f;
+    perlin = glm::smoothstep(.05f, .9f, perlin);
+    int y = 0;
+    for (int i = 0; i < 4; i++) {
+        if ((i - 1.f) / 3.f <= perlin && perlin <= (i + 1.f) / 3.f) {
+            y += (-abs(3.f * perlin - i) + 1.f) * heights[i];
+        }
+    }
+    float edgeNoise = Noise::perlinNoise(glm::vec2(x, y) * 15.f) * .5f;
+    if (perlin < 0.25f + edgeNoise) { // grassland
+        type = GRASS;
+    } else  if (perlin > 0.25f + edgeNoise && perlin < 0.5f + edgeNoise) { // hills
+        type = DIRT;
+        if (y < 137) {
+            type = GRASS;
+        }
+    } else if (perlin > 0.5f+ edgeNoise && perlin < 0.75f + edgeNoise) { // mountain
+        type = STONE;
+    } else { // spire
+        type = SPIRE_TOP;
+    }
+    return y;
+}
+
+void Terrain::fillChunkBlocks(Chunk *chunk) {
+    auto start = std::chrono::steady_clock::now();
+    // The Chunk is in the map already, so the simulation may be reading it
+    auto lock = chunk->writeBlocks();
+    int xPos = chunk->X;
+    int zPos = chunk->Z;
+    for(int x = xPos; x < xPos + BLOCK_LENGTH_IN_CHUNK; ++x) {
+        for(int z = zPos; z < zPos + BLOCK_LENGTH_IN_CHUNK; ++z) {
+            BlockType t;
+            int y = surfaceAt(x, z, t);
+            if (t == SPIRE_TOP && y < SPIRE_WATER_LEVEL) {
+                fillColumnRangeStatic(x, SPIRE_WATER_LEVEL, y, z, WATER, chunk);
+            }
+            setBlockAtStatic(x, y, z, t, chunk);
+            if (t == GRASS) {
+                t = DIRT;
+            } else if (t == SPIRE_TOP) {
+                t = SPIRE;
+            }
+            fillColumnStatic(x, y - 1, z, t, chunk);
+        }
+    }
+    s_rivers.carve(chunk);
+    LightEngine::lightChunk(*chunk);
+    s_generateNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    ++s_generatedCount;
+}
+
+void Terrain::fillBlockData(std::vector<Chunk*> chunks, BlockData *chunksWithData) {
+    for (Chunk* chunk : chunks) {
+        fillChunkBlocks(chunk);
         chunksWithData->addChunk(chunk);
     }
 }
@@ -458,3 +1152,8 @@ void Terrain::fillVBO(Chunk &c, VBOCollection &chunksWithVBO) {
     c.create();
     chunksWithVBO.addChunk(&c);
 }
+
+void Terrain::fillLodVBO(Chunk &c, int level, VBOCollection &chunksWithLod) {
+    c.createLod(level);
+    chunksWithLod.addChunk(&c);
+}
@@ -3,19 +3,41 @@
 #include "glm_includes.h"
 #include "chunk.h"
 #include <array>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include "shaderprogram.h"
 #include "cube.h"
 #include "noise.h"
-#include "lsystem.h"
 #include "BlockTypeData.h"
 #include "VBOWorkerData.h"
 #include "postprocessingshader.h"
+#include "farterrain.h"
+#include "occlusionculler.h"
+#include "regionstore.h"
+#include "blockjournal.h"
+#include "lightengine.h"
+#include "fluidsimulator.h"
+#include <QElapsedTimer>
+#include <functional>
 #define TERRAIN_RADIUS 2
 #define CHUNK_LENGTH_IN_TERRAIN 4
 #define BLOCK_LENGTH_IN_CHUNK 16
 #define BLOCK_LENGTH_IN_TERRAIN (CHUNK_LENGTH_IN_TERRAIN * BLOCK_LENGTH_IN_CHUNK)
+// Where the Player starts; pregeneration works outward from here
+const static glm::vec3 PLAYER_SPAWN(48.f, 170.f, 48.f);
+// Spire biome valleys are flooded with water up to this height
+#define SPIRE_WATER_LEVEL 155
+// Chunks closer than this are drawn at full detail; each doubling of the
+// distance beyond it halves the LOD mesh's resolution, down to 8 x 8 x 8 cells
+#define LOD_BASE_DISTANCE 64.f
+#define MAX_LOD_LEVEL 3
+// Caps how many LOD meshes are rebuilt per tick
+#define MAX_LOD_JOBS_PER_TICK 16
+// How far ahead along its path, in seconds, terrain is requested for the Player
+#define STREAM_LOOKAHEAD_SECONDS 3.f
+// Caps the zones being generated or loaded ahead of the Player at once
+#define MAX_PREFETCH_ZONES 8
 
 //using namespace std;
 
@@ -23,8 +45,13 @@
 int64_t toKey(int x, int z);
 glm::ivec2 toCoords(int64_t k);
 
-//Forward class declaration
-class Lsystem;
+// How well terrain streaming keeps ahead of the Player since startup
+struct StreamingStats {
+    int hits;            // Zones the Player reached that were requested ahead of time
+    int misses;          // Zones only requested once the Player needed them
+    float stallMs;       // Time spent with unfinished zones right around the Player
+    int prefetchesInFlight;
+};
 
 // The container class for all of the Chunks in the game.
 // Ultimately, while Terrain will always store all Chunks,
@@ -38,6 +65,11 @@ private:
     // so that we can use them as a key for the map, as objects like std::pairs or
     // glm::ivec2s are not hashable by default, so they cannot be used as keys.
     std::unordered_map<int64_t, uPtr<Chunk>> m_chunks;
+    // Guards m_chunks against the simulation thread's lookups while the GL
+    // thread inserts. Only the GL thread ever inserts, so its own lookups
+    // do not need it. Chunks are only removed by pregenerateZones(), which
+    // runs without a simulation, so a found Chunk stays valid.
+    mutable std::mutex m_chunksMutex;
 
     // We will designate every 64 x 64 area of the world's x-z plane
     // as one "terrain generation zone". Every time the player moves
@@ -65,22 +97,114 @@ private:
 
     OpenGLContext* mp_context;
 
+    // The one index buffer every Chunk mesh is drawn with. Declared before
+    // the MeshBuffers, which hold a reference to it.
+    QuadIndexBuffer m_quadIndices;
+    // Every Chunk's geometry is packed into these two buffers so a whole
+    // render pass can be issued with one multi-draw per buffer
+    MeshBuffer m_opaqueMeshes;
+    MeshBuffer m_transparentMeshes;
+    // Low-poly heightfield drawn beyond the Chunks
+    FarTerrain m_farTerrain;
+    // Reused every frame to collect the sub-draws of visible Chunks
+    MultiDrawCommands m_opaqueCommands;
+    MultiDrawCommands m_transparentCommands;
+    // Skips Chunks hidden behind others in the camera pass
+    OcclusionCuller m_occlusion;
+    // Chunks within range in the last occlusion culled draw(), visible or not
+    std::vector<const Chunk*> m_queryChunks;
+
+    // Potentially visible set found by the last updateVisibleSections(),
+    // over the grid of Chunks whose lower-left corner is m_pvsOrigin
+    bool m_pvsValid;
+    glm::ivec2 m_pvsOrigin;
+    int m_pvsWidth;  // In Chunks along X
+    int m_pvsDepth;  // In Chunks along Z
+    std::vector<Chunk*> m_pvsGrid;
+    // Faces each section was reached through by the search
+    std::vector<FaceMask> m_pvsEntries;
+    std::vector<bool> m_pvsChunks;
+    size_t m_pvsVisibleCount;
+
+    // Chunks whose wanted LOD changed while drawing and that may need
+    // a new LOD mesh built. Serviced by updateLods().
+    std::vector<Chunk*> m_lodRequests;
+
+    // Edits not yet saved to m_regions, kept in case we crash first.
+    // Declared first so the region IO thread can still reach it while
+    // m_regions shuts down.
+    BlockJournal m_journal;
+    // Block data of every Chunk generated or edited, kept across runs
+    RegionStore m_regions;
+    // Chunks whose blocks changed since they were last saved, or were
+    // generated and never saved
+    std::unordered_set<Chunk*> m_unsavedChunks;
+    // Chunks whose block data is still being generated or loaded, which
+    // must not be saved yet
+    std::unordered_set<const Chunk*> m_fillingChunks;
+    QElapsedTimer m_saveTimer;
+    int m_autosaveMs;
+
+    LightEngine m_lightEngine;
+    // Chunks with a worker building their mesh, and Chunks whose blocks or
+    // light changed since. The latter are meshed again once the former
+    // lets go of them.
+    std::unordered_set<Chunk*> m_meshing;
+    std::unordered_set<Chunk*> m_needsRemesh;
+    // Queues c for remeshing after its block (x, z), in Chunk-local
+    // coordinates, changed, along with every neighbor whose faces or
+    // corner shading depend on that block
+    void queueRemeshAround(Chunk *c, int x, int z);
+    void remeshChanged();
+    FluidSimulator m_fluids;
+    // Ticks m_fluids and relights, saves and remeshes what it changed
+    void updateFluids(float ms);
+
+    // Zones started ahead of the Player that it has not needed yet
+    std::unordered_set<int64_t> m_prefetchedZones;
+    // Chunks of each zone whose block data is still on its way
+    std::unordered_map<int64_t, int> m_fillingZones;
+    int m_streamHits;
+    int m_streamMisses;
+    float m_stallMs;
+    QElapsedTimer m_stallTimer;
+    // Starts zones along where the Player is predicted to be over the next
+    // STREAM_LOOKAHEAD_SECONDS, nearest in time first
+    void prefetchAlongPath(glm::vec3 pos, glm::vec3 velocity, glm::vec3 look);
+
     bool test;
 
     void fillColumn(int x, int y, int z, BlockType t);
+    // Is every Chunk of the terrain zone at (x, z) in the region files?
+    bool isZoneSaved(int x, int z);
 
 public:
     // collection of chunks
     BlockData chunksWithData;
     VBOCollection chunksWithVBO;
+    VBOCollection chunksWithLod;
 
     Terrain(OpenGLContext *context);
     ~Terrain();
 
+    // Allocates the shared Chunk vertex buffers and quad index buffer.
+    // Must be called once the OpenGL context is valid.
+    void createBuffers();
+    void destroyBuffers();
+    // Occupancy and fragmentation of the shared Chunk buffers
+    MeshBufferStats opaqueVertexStats() const;
+    MeshBufferStats transparentVertexStats() const;
+    // Size of the shared quad index buffer
+    size_t quadIndexBytes() const;
+    MeshBufferStats farTerrainStats() const;
+
     // Instantiates a new Chunk and stores it in
     // our chunk map at the given coordinates.
     // Returns a pointer to the created Chunk.
     Chunk* createChunkAt(int x, int z);
+    // Unlinks the Chunk from its neighbors and deletes it. Nothing else may
+    // still refer to it.
+    void removeChunk(Chunk *c);
 
     // Do these world-space coordinates lie within
     // a Chunk that exists?
@@ -95,21 +219,74 @@ public:
     // values) return the block stored at that point in space.
     BlockType getBlockAt(int x, int y, int z) const;
     BlockType getBlockAt(glm::vec3 p) const;
+    // Looks up count blocks at once into out, for callers off the GL thread
+    // that need many blocks near each other. The Chunk map is locked once
+    // per distinct Chunk rather than twice per block, and each Chunk's
+    // blocks once per run of positions inside it. Blocks of Chunks that
+    // do not exist, or outside 0 to 255 in y, come back as missing.
+    void getBlocksAt(const glm::ivec3 *positions, size_t count, BlockType *out, BlockType missing) const;
     // Given a world-space coordinate (which may have negative
     // values) set the block at that point in space to the
     // given type.
     void setBlockAt(int x, int y, int z, BlockType t);
 
+    // Queues the terrain zone whose lower-left corner is at (x, z) to be
+    // read back from the region files, if every one of its Chunks was saved.
+    // Its Chunks are meshed like generated ones once loaded.
+    bool loadTerrainZoneAsync(int x, int z);
+    // Generates the terrain zones with the given lower-left corners and
+    // saves them, without drawing anything: block data on threadCount
+    // worker threads, then rivers, a batch of zones at a time. Zones that
+    // exist or were saved already are skipped. Each batch's Chunks are
+    // dropped once saved, so memory stays bounded however many zones there
+    // are. progress is told how many of the total zones left to generate
+    // are done after every batch. Used by --pregenerate.
+    void pregenerateZones(const std::vector<glm::ivec2> &zones, int threadCount,
+                          const std::function<void(int done, int total)> &progress);
+    // Queues every Chunk changed since it was last saved to be written, and
+    // drops the journaled edits those saves cover once they are on disk
+    void saveChunksAsync();
+    // How often saveChunksAsync() runs on its own
+    void setAutosaveInterval(int ms);
+    // Saves every changed Chunk and waits until all of it is on disk
+    void saveAll();
+    const RegionStore& regions() const;
+    const FluidSimulator& fluids() const;
+    // Average time fillBlockData took to generate one Chunk
+    static float averageGenerateMs();
+
     // Draws every Chunk that falls within the bounding box
     // described by the min and max coords, using the provided
-    // ShaderProgram
-    void draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram);
+    // ShaderProgram. Chunks far from eye use their LOD mesh.
+    // With occlusionCull set, Chunks whose last occlusion query came back
+    // empty are skipped; only the camera pass should ask for this.
+    void draw(int minX, int maxX, int minZ, int maxZ, glm::vec3 eye, ShaderProgram *shaderProgram,
+              bool occlusionCull = false);
+    // Finds the sections within the given bounds that could be seen from
+    // eye by walking outward from the camera's section through faces that
+    // the sections' connectivity links together. draw() then skips every
+    // Chunk none of whose sections were reached, in all passes.
+    void updateVisibleSections(int minX, int maxX, int minZ, int maxZ, glm::vec3 eye);
+    bool isPotentiallyVisible(const Chunk *c) const;
+    // Chunks found visible by the last updateVisibleSections()
+    size_t potentiallyVisibleCount() const;
+    // Tests the Chunks gathered by the last occlusion culled draw() against
+    // the depth buffer currently bound. Call right after that draw().
+    void issueOcclusionQueries(glm::vec3 eye);
+    OcclusionCuller& occlusionCuller();
+
+    // LOD level a Chunk whose center is this far from the camera should use
+    static int lodForDistance(float distance);
+    // Builds the LOD meshes requested by draw() and uploads finished ones
+    void updateLods();
 
     // Initializes the Chunks that store the 64 x 256 x 64 block scene you
     // see when the base code is run.
     void CreateTestScene();
-    // Expands the terrain
-    void expandTerrainBasedOnPlayer(glm::vec3 pos);
+    // Expands the terrain around the Player, and ahead of it along its
+    // velocity and look direction
+    void expandTerrainBasedOnPlayer(glm::vec3 pos, glm::vec3 velocity, glm::vec3 look);
+    StreamingStats streamingStats() const;
     void loadTerrain(int xPos, int yPos);
 
     glm::ivec2 getTerrainAt(int x, int z);
@@ -122,13 +299,19 @@ public:
     static int heightMountain(int x, int z);
     static int heightSpire(int x, int z);
     static int heightHills(int x ,int z);
+    // Blends the biome height functions into the height of the top block
+    // of the column at (x, z) and sets type to what that block is made of.
+    // Ignores rivers and the water filling spire valleys.
+    static int surfaceAt(int x, int z, BlockType &type);
 
+    // Fills one Chunk with procedural height and block type data, rivers
+    // included. Depends on nothing but the Chunk's position.
+    static void fillChunkBlocks(Chunk *chunk);
     static void fillBlockData(std::vector<Chunk*> chunks, BlockData *chunksWithData);
 
     static void setBlockAtStatic(int x, int y, int z, BlockType t, Chunk* c);
     static void fillColumnStatic(int x, int y, int z, BlockType t, Chunk* c);
     static void fillColumnRangeStatic(int x, int y, int yLow, int z, BlockType t, Chunk* c);
     static void fillVBO(Chunk &c, VBOCollection &chunksWithVBO);
-
-    void makeRivers(glm::ivec2 zonePosition);
+    static void fillLodVBO(Chunk &c, int level, VBOCollection &chunksWithLod);
 };
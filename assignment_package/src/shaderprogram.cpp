@@ -1,64 +1,80 @@
 #include "shaderprogram.h"
+#include "programbinarycache.h"
+#include "frameuniforms.h"
 #include <QFile>
 #include <QStringBuilder>
 #include <QTextStream>
 #include <QDebug>
 #include <stdexcept>
 #include <iostream>
+#include <vector>
+#include <cstring>
 
 ShaderProgram::ShaderProgram(OpenGLContext *context)
     : vertShader(), fragShader(), prog(),
       attrPos(-1), attrNor(-1), attrCol(-1),
-      unifModel(-1), unifModelInvTr(-1), unifViewProj(-1), unifColor(-1),
-      unifSampler2D(-1), unifTime(-1), unifDepthMatrixID(-1), unifLightProj(-1),
+      unifModel(-1), unifModelInvTr(-1), unifColor(-1),
+      unifSampler2D(-1), unifTime(-1),
+      unifFogNear(-1), unifFogFar(-1), unifInstances(-1),
+      m_uniformValues(),
       context(context)
 {}
 
 void ShaderProgram::create(const char *vertfile, const char *fragfile)
 {
-    // Allocate space on our GPU for a vertex shader and a fragment shader and a shader program to manage the two
-    vertShader = context->glCreateShader(GL_VERTEX_SHADER);
-    fragShader = context->glCreateShader(GL_FRAGMENT_SHADER);
     prog = context->glCreateProgram();
+    m_uniformValues.clear();
     // Get the body of text stored in our two .glsl files
-    QString qVertSource = qTextFileRead(vertfile);
-    QString qFragSource = qTextFileRead(fragfile);
-
-    char* vertSource = new char[qVertSource.size()+1];
-    strcpy(vertSource, qVertSource.toStdString().c_str());
-    char* fragSource = new char[qFragSource.size()+1];
-    strcpy(fragSource, qFragSource.toStdString().c_str());
-
-
-    // Send the shader text to OpenGL and store it in the shaders specified by the handles vertShader and fragShader
-    context->glShaderSource(vertShader, 1, &vertSource, 0);
-    context->glShaderSource(fragShader, 1, &fragSource, 0);
-    // Tell OpenGL to compile the shader text stored above
-    context->glCompileShader(vertShader);
-    context->glCompileShader(fragShader);
-    // Check if everything compiled OK
-    GLint compiled;
-    context->glGetShaderiv(vertShader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        printShaderInfoLog(vertShader);
-    }
-    context->glGetShaderiv(fragShader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        printShaderInfoLog(fragShader);
-    }
-
-    // Tell prog that it manages these particular vertex and fragment shaders
-    context->glAttachShader(prog, vertShader);
-    context->glAttachShader(prog, fragShader);
-    context->glLinkProgram(prog);
+    QByteArray vertSource = qTextFileRead(vertfile).toUtf8();
+    QByteArray fragSource = qTextFileRead(fragfile).toUtf8();
+
+    // Skip compiling altogether if an earlier launch left a binary of this program
+    if (ProgramBinaryCache::load(context, prog, vertSource, fragSource)) {
+        vertShader = 0;
+        fragShader = 0;
+    } else {
+        // Allocate space on our GPU for a vertex shader and a fragment shader
+        vertShader = context->glCreateShader(GL_VERTEX_SHADER);
+        fragShader = context->glCreateShader(GL_FRAGMENT_SHADER);
+        const char *vertText = vertSource.constData();
+        const char *fragText = fragSource.constData();
+
+        // Send the shader text to OpenGL and store it in the shaders specified by the handles vertShader and fragShader
+        context->glShaderSource(vertShader, 1, &vertText, 0);
+        context->glShaderSource(fragShader, 1, &fragText, 0);
+        // Tell OpenGL to compile the shader text stored above
+        context->glCompileShader(vertShader);
+        context->glCompileShader(fragShader);
+        // Check if everything compiled OK
+        GLint compiled;
+        context->glGetShaderiv(vertShader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            printShaderInfoLog(vertShader);
+        }
+        context->glGetShaderiv(fragShader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            printShaderInfoLog(fragShader);
+        }
 
-    // Check for linking success
-    GLint linked;
-    context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
-    if (!linked) {
-        printLinkInfoLog(prog);
+        // Tell prog that it manages these particular vertex and fragment shaders
+        context->glAttachShader(prog, vertShader);
+        context->glAttachShader(prog, fragShader);
+        ProgramBinaryCache::prepare(context, prog);
+        context->glLinkProgram(prog);
+
+        // Check for linking success
+        GLint linked;
+        context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            printLinkInfoLog(prog);
+        } else {
+            ProgramBinaryCache::store(context, prog, vertSource, fragSource);
+        }
     }
 
+    // Per-frame state comes from the shared uniform buffer
+    FrameUniforms::bindProgram(context, prog);
+
     // Get the handles to the variables stored in our shaders
     // See shaderprogram.h for more information about these variables
 
@@ -68,23 +84,21 @@ void ShaderProgram::create(const char *vertfile, const char *fragfile)
 
     unifModel      = context->glGetUniformLocation(prog, "u_Model");
     unifModelInvTr = context->glGetUniformLocation(prog, "u_ModelInvTr");
-    unifViewProj   = context->glGetUniformLocation(prog, "u_ViewProj");
     unifColor      = context->glGetUniformLocation(prog, "u_Color");
 
     unifSampler2D  = context->glGetUniformLocation(prog, "u_Texture");
     unifTime       = context->glGetUniformLocation(prog, "u_Time");
 
-    // Shadow Map
-    unifDepthMatrixID = context->glGetUniformLocation(prog, "u_depthMVP");
-    unifSampler2DShadow  = context->glGetUniformLocation(prog, "u_ShadowMap");
-
     // Sky
     unifDimensions = context->glGetUniformLocation(prog, "u_Dimensions");
     unifEye = context->glGetUniformLocation(prog, "u_Eye");
 
     unifView = context->glGetUniformLocation(prog, "u_View");
 
-    unifLightProj = context->glGetUniformLocation(prog, "u_LightProj");
+    unifFogNear = context->glGetUniformLocation(prog, "u_FogNear");
+    unifFogFar = context->glGetUniformLocation(prog, "u_FogFar");
+
+    unifInstances = context->glGetUniformLocation(prog, "u_Instances");
 }
 
 void ShaderProgram::useMe()
@@ -92,11 +106,31 @@ void ShaderProgram::useMe()
     context->glUseProgram(prog);
 }
 
+bool ShaderProgram::uniformChanged(int location, const void *value, size_t size)
+{
+    if (location == -1) {
+        return false;
+    }
+    const unsigned char *bytes = static_cast<const unsigned char*>(value);
+    std::vector<unsigned char> &last = m_uniformValues[location];
+    if (last.size() == size && std::memcmp(last.data(), bytes, size) == 0) {
+        return false;
+    }
+    last.assign(bytes, bytes + size);
+    return true;
+}
+
 void ShaderProgram::setModelMatrix(const glm::mat4 &model)
 {
+    // Both come from the same matrix, so check each without short-circuiting
+    bool modelChanged = uniformChanged(unifModel, &model, sizeof(model));
+    bool invTrChanged = uniformChanged(unifModelInvTr, &model, sizeof(model));
+    if (!modelChanged && !invTrChanged) {
+        return;
+    }
     useMe();
 
-    if (unifModel != -1) {
+    if (modelChanged) {
         // Pass a 4x4 matrix into a uniform variable in our shader
         // Handle to the matrix variable on the GPU
         context->glUniformMatrix4fv(unifModel,
@@ -108,7 +142,7 @@ void ShaderProgram::setModelMatrix(const glm::mat4 &model)
                                     &model[0][0]);
     }
 
-    if (unifModelInvTr != -1) {
+    if (invTrChanged) {
         glm::mat4 modelinvtr = glm::inverse(glm::transpose(model));
         // Pass a 4x4 matrix into a uniform variable in our shader
         // Handle to the matrix variable on the GPU
@@ -122,149 +156,71 @@ void ShaderProgram::setModelMatrix(const glm::mat4 &model)
     }
 }
 
-void ShaderProgram::setViewProjMatrix(const glm::mat4 &vp)
+void ShaderProgram::setViewMatrix(const glm::mat4 &v)
 {
-    // Tell OpenGL to use this shader program for subsequent function calls
-    useMe();
-
-    if(unifViewProj != -1) {
+    if (uniformChanged(unifView, &v, sizeof(v))) {
+        // Tell OpenGL to use this shader program for subsequent function calls
+        useMe();
         // Pass a 4x4 matrix into a uniform variable in our shader
         // Handle to the matrix variable on the GPU
-        context->glUniformMatrix4fv(unifViewProj,
+        context->glUniformMatrix4fv(unifView,
                                     // How many matrices to pass
                                     1,
                                     // Transpose the matrix? OpenGL uses column-major, so no.
                                     GL_FALSE,
                                     // Pointer to the first element of the matrix
-                                    &vp[0][0]);
-    }
-}
-
-void ShaderProgram::setViewMatrix(const glm::mat4 &v)
-{
-    // Tell OpenGL to use this shader program for subsequent function calls
-    useMe();
-
-    if(unifView != -1) {
-    // Pass a 4x4 matrix into a uniform variable in our shader
-                    // Handle to the matrix variable on the GPU
-    context->glUniformMatrix4fv(unifView,
-                    // How many matrices to pass
-                       1,
-                    // Transpose the matrix? OpenGL uses column-major, so no.
-                       GL_FALSE,
-                    // Pointer to the first element of the matrix
-                       &v[0][0]);
+                                    &v[0][0]);
     }
 }
 
 void ShaderProgram::setGeometryColor(glm::vec4 color)
 {
-    useMe();
-
-    if(unifColor != -1)
+    if (uniformChanged(unifColor, &color, sizeof(color)))
     {
+        useMe();
         context->glUniform4fv(unifColor, 1, &color[0]);
     }
 }
 
-void ShaderProgram::setTextureSampler2DShadow(int textureSlot) {
-    useMe();
-    if (unifSampler2D != -1) {
-        context->glUniform1i(unifSampler2DShadow, textureSlot);
-    }
-}
-
-
 void ShaderProgram::setTextureSampler2D(int textureSlot) {
-    useMe();
-    if (unifSampler2D != -1) {
+    if (uniformChanged(unifSampler2D, &textureSlot, sizeof(textureSlot))) {
+        useMe();
         context->glUniform1i(unifSampler2D, textureSlot);
     }
 }
 
 void ShaderProgram::setTime(int t) {
-    useMe();
-
-    if (unifTime != -1) {
+    if (uniformChanged(unifTime, &t, sizeof(t))) {
+        useMe();
         context->glUniform1i(unifTime, t);
     }
 }
 
-void ShaderProgram::setDepthMVP(const glm::vec3 light)
-{
-    useMe();
-
-    if (unifDepthMatrixID != -1) {
-        glm::mat4 depthProjectionMatrix = glm::ortho<float>(-1.f, 1.f, -1.f, 1.f, 0.1f, 1000.f);
-        glm::mat4 depthViewMatrix = glm::lookAt(light, glm::vec3(0,0,0), glm::vec3(0,1,0));
-        glm::mat4 depthModelMatrix = glm::mat4(1.0);
-        glm::mat4 depthMVP = depthProjectionMatrix * depthViewMatrix * depthModelMatrix;
-        context->glUniformMatrix4fv(unifDepthMatrixID, 1, GL_FALSE, &depthMVP[0][0]);
-    }
-}
-
-void ShaderProgram::setLightProj(const glm::mat4 &v)
-{
-    useMe();
-    if(unifLightProj != -1) {
-        // Pass a 4x4 matrix into a uniform variable in our shader
-        // Handle to the matrix variable on the GPU
-        context->glUniformMatrix4fv(unifLightProj,
-                                    // How many matrices to pass
-                                    1,
-                                    // Transpose the matrix? OpenGL uses column-major, so no.
-                                    GL_FALSE,
-                                    // Pointer to the first element of the matrix
-                                    &v[0][0]);
-    }
-}
-
 void ShaderProgram::setDimensions(glm::ivec2 dims)
 {
-    useMe();
-
-    if(unifDimensions != -1)
+    if (uniformChanged(unifDimensions, &dims, sizeof(dims)))
     {
+        useMe();
         context->glUniform2i(unifDimensions, dims.x, dims.y);
     }
 }
 
-void ShaderProgram::setDepthMVP(const glm::mat4 mat)
+void ShaderProgram::setFog(float nearDepth, float farDepth)
 {
-    useMe();
-
-    if (unifDepthMatrixID != -1) {
-        glm::mat4 depthMVP = mat;
-        context->glUniformMatrix4fv(unifDepthMatrixID, 1, GL_FALSE, &depthMVP[0][0]);
+    if (uniformChanged(unifFogNear, &nearDepth, sizeof(nearDepth))) {
+        useMe();
+        context->glUniform1f(unifFogNear, nearDepth);
+    }
+    if (uniformChanged(unifFogFar, &farDepth, sizeof(farDepth))) {
+        useMe();
+        context->glUniform1f(unifFogFar, farDepth);
     }
 }
 
-void ShaderProgram::drawQuad(Drawable &d)
+void ShaderProgram::drawQuad(Quad &q)
 {
     useMe();
-
-    if(d.elemCountOpaque() < 0) {
-        throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCountOpaque()) + "!");
-    }
-
-    // Do not set our "u_sampler1" sampler to user Texture Unit 1
-
-    // bind
-    if (d.bindAllOpaque()) {
-        int stride = 2 * 4 * sizeof(float);
-        // Pos
-        context->glEnableVertexAttribArray(attrPos);
-        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
-        // NO UV
-    }
-
-    // Bind the index buffer and then draw shapes from it.
-    // This invokes the shader program, which accesses the vertex buffers.
-    d.bindIdx();
-    context->glDrawElements(d.drawMode(), d.elemCountOpaque(), GL_UNSIGNED_INT, 0);
-
-    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
+    q.draw();
     context->printGLErrorLog();
 }
 
@@ -279,18 +235,12 @@ void ShaderProgram::drawOpaque(Drawable &d)
 
     if (d.bindAllOpaque()) {
         int stride = 12 * sizeof (float);
+        context->enableVertexAttribs({attrPos, attrNor, attrCol});
         // Position
-        context->glEnableVertexAttribArray(attrPos);
-        context->printGLErrorLog();
         context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
-        context->printGLErrorLog();
         // Normal
-        context->glEnableVertexAttribArray(attrNor);
-        context->printGLErrorLog();
         context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, stride, (void*)(4 * sizeof(float)));
         // Color
-        context->glEnableVertexAttribArray(attrCol);
-        context->printGLErrorLog();
         context->glVertexAttribPointer(attrCol, 4, GL_FLOAT, false, stride, (void*)(8 * sizeof(float)));
     }
 
@@ -299,19 +249,6 @@ void ShaderProgram::drawOpaque(Drawable &d)
     d.bindIdx();
     context->glDrawElements(d.drawMode(), d.elemCountOpaque(), GL_UNSIGNED_INT, 0);
 
-    if (attrPos != -1) {
-        context->glDisableVertexAttribArray(attrPos);
-        context->printGLErrorLog();
-    }
-    if (attrNor != -1) {
-        context->glDisableVertexAttribArray(attrNor);
-        context->printGLErrorLog();
-    }
-    if (attrCol != -1) {
-        context->glDisableVertexAttribArray(attrCol);
-        context->printGLErrorLog();
-    }
-
 //    std::cout << "ShaderProgram Opaque" << std::endl;
     context->printGLErrorLog();
 }
@@ -326,14 +263,12 @@ void ShaderProgram::drawTransparent(Drawable &d)
 
     if (d.bindAllTransparent()) {
         int stride = 12 * sizeof (float);
+        context->enableVertexAttribs({attrPos, attrNor, attrCol});
         // Position
-        context->glEnableVertexAttribArray(attrPos);
         context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
         // Normal
-        context->glEnableVertexAttribArray(attrNor);
         context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, stride, (void*)(4 * sizeof(float)));
         // Color
-        context->glEnableVertexAttribArray(attrCol);
         context->glVertexAttribPointer(attrCol, 4, GL_FLOAT, false, stride, (void*)(8 * sizeof(float)));
     }
 
@@ -342,14 +277,66 @@ void ShaderProgram::drawTransparent(Drawable &d)
     d.bindIdxTransparent();
     context->glDrawElements(d.drawMode(), d.elemCountTransparent(), GL_UNSIGNED_INT, 0);
 
-    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
-    if (attrNor != -1) context->glDisableVertexAttribArray(attrNor);
-    if (attrCol != -1) context->glDisableVertexAttribArray(attrCol);
-
 //    std::cout << "ShaderProgram Transparent" << std::endl;
     context->printGLErrorLog();
 }
 
+void ShaderProgram::drawMulti(MeshBuffer &buffer, const MultiDrawCommands &commands)
+{
+    if (commands.size() == 0) {
+        return;
+    }
+
+    useMe();
+
+    if (buffer.bindVertices()) {
+        int stride = buffer.vertexStride();
+        context->enableVertexAttribs({attrPos, attrNor, attrCol});
+        // Position
+        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
+        // Normal
+        context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, stride, (void*)(4 * sizeof(float)));
+        // Color
+        context->glVertexAttribPointer(attrCol, 4, GL_FLOAT, false, stride, (void*)(8 * sizeof(float)));
+    }
+
+    // One call covers every mesh; each sub-draw reads the shared quad
+    // indices from the start, shifted onto its own mesh by its base vertex.
+    buffer.bindIndices();
+    context->glMultiDrawElementsBaseVertex(GL_TRIANGLES, commands.counts.data(), GL_UNSIGNED_INT,
+                                           commands.offsets.data(), commands.size(),
+                                           commands.baseVertices.data());
+
+    context->printGLErrorLog();
+}
+
+void ShaderProgram::drawInstanced(InstancedCubes &cubes, int textureSlot)
+{
+    if (cubes.instanceCount() == 0) {
+        return;
+    }
+
+    useMe();
+    if (uniformChanged(unifInstances, &textureSlot, sizeof(textureSlot))) {
+        context->glUniform1i(unifInstances, textureSlot);
+    }
+    cubes.bindInstances(textureSlot);
+
+    if (cubes.bindAllOpaque()) {
+        int stride = 12 * sizeof (float);
+        context->enableVertexAttribs({attrPos, attrNor});
+        // Position
+        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
+        // Normal
+        context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, stride, (void*)(4 * sizeof(float)));
+    }
+
+    cubes.bindIdx();
+    context->glDrawElementsInstanced(cubes.drawMode(), cubes.elemCountOpaque(), GL_UNSIGNED_INT, 0,
+                                     cubes.instanceCount());
+
+    context->printGLErrorLog();
+}
 
 char* ShaderProgram::textFileRead(const char* fileName) {
     char* text;
@@ -426,69 +413,3 @@ void ShaderProgram::printLinkInfoLog(int prog)
         delete [] infoLog;
     }
 }
-
-
-
-DepthThroughShader::DepthThroughShader(OpenGLContext* context)
-    : ShaderProgram(context)
-{}
-
-DepthThroughShader::~DepthThroughShader() {}
-
-//This function, as its name implies, uses the passed in GL widget
-void DepthThroughShader::drawOpaque(Drawable &d)
-{
-    useMe();
-
-    if(d.elemCountOpaque() < 0) {
-        throw std::out_of_range("Attempting to draw a drawable with m_count_t of " + std::to_string(d.elemCountOpaque()) + "!");
-    }
-
-    if (d.bindAllOpaque()) {
-        int stride = 12 * sizeof (float);
-        // Position
-        context->glEnableVertexAttribArray(attrPos);
-        context->printGLErrorLog();
-        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
-        context->printGLErrorLog();
-    }
-
-    // Bind the index buffer and then draw shapes from it.
-    // This invokes the shader program, which accesses the vertex buffers.
-    d.bindIdx();
-    context->glDrawElements(d.drawMode(), d.elemCountOpaque(), GL_UNSIGNED_INT, 0);
-
-    if (attrPos != -1) {
-        context->glDisableVertexAttribArray(attrPos);
-        context->printGLErrorLog();
-    }
-
-//    std::cout << "ShaderProgram Opaque" << std::endl;
-    context->printGLErrorLog();
-}
-
-void DepthThroughShader::drawTransparent(Drawable &d)
-{
-    useMe();
-
-    if(d.elemCountTransparent() < 0) {
-        throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCountTransparent()) + "!");
-    }
-
-    if (d.bindAllTransparent()) {
-        int stride = 12 * sizeof (float);
-        // Position
-        context->glEnableVertexAttribArray(attrPos);
-        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, stride, (void*)(0));
-    }
-
-    // Bind the index buffer and then draw shapes from it.
-    // This invokes the shader program, which accesses the vertex buffers.
-    d.bindIdxTransparent();
-    context->glDrawElements(d.drawMode(), d.elemCountTransparent(), GL_UNSIGNED_INT, 0);
-
-    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
-
-//    std::cout << "ShaderProgram Transparent" << std::endl;
-    context->printGLErrorLog();
-}
@@ -6,6 +6,11 @@
 #include <glm/glm.hpp>
 
 #include "drawable.h"
+#include "meshbuffer.h"
+#include "scene/quad.h"
+#include "scene/instancedcubes.h"
+#include <unordered_map>
+#include <vector>
 
 
 class ShaderProgram
@@ -21,21 +26,21 @@ public:
 
     int unifModel; // A handle for the "uniform" mat4 representing model matrix in the vertex shader
     int unifModelInvTr; // A handle for the "uniform" mat4 representing inverse transpose of the model matrix in the vertex shader
-    int unifViewProj; // A handle for the "uniform" mat4 representing combined projection and view matrices in the vertex shader
     int unifColor; // A handle for the "uniform" vec4 representing color of geometry in the vertex shader
 
     int unifSampler2D; // A handle to the "uniform" sampler2D that will be used to read the texture containing the scene render
-    int unifSampler2DShadow;
 
     int unifTime; // A handle for the "uniform" float representing time in the shader
     int unifView; // A handle for the "uniform" mat4 to bring from
 
-    int unifDepthMatrixID; // A handle to the "unifrom" mat that projects us from world to light pov
     // Sky
     int unifDimensions;
     int unifEye;
 
-    int unifLightProj;
+    int unifFogNear; // A handle for the "uniform" float at which fog starts, in view-space depth
+    int unifFogFar;  // A handle for the "uniform" float at which fog is opaque
+
+    int unifInstances; // A handle for the "uniform" samplerBuffer holding per-instance data
 
 public:
     ShaderProgram(OpenGLContext* context);
@@ -47,18 +52,23 @@ public:
     void setModelMatrix(const glm::mat4 &model);
     // Pass the given Projection * View matrix to this shader on the GPU
     void setViewMatrix(const glm::mat4 &v);
-    void setViewProjMatrix(const glm::mat4 &vp);
     // Pass the given color to this shader on the GPU
     void setGeometryColor(glm::vec4 color);
     // Pass a texture to this shader on the GPU
     void setTextureSampler2D(int textureSlot);
-    void setTextureSampler2DShadow(int textureSlot);
     // Pass a time variable to this shader on the GPU
     void setTime(int t);
     // Draw the given object to our screen using this ShaderProgram's shaders
-    void drawQuad(Drawable &d);
+    // Draw the fullscreen triangle using this ShaderProgram's shaders
+    void drawQuad(Quad &q);
     virtual void drawOpaque(Drawable &d);
     virtual void drawTransparent(Drawable &d);
+    // Draw every mesh listed in commands out of the given MeshBuffer
+    // with a single glMultiDrawElementsBaseVertex call
+    virtual void drawMulti(MeshBuffer &buffer, const MultiDrawCommands &commands);
+    // Draw every instance of cubes with a single glDrawElementsInstanced call,
+    // reading their data through the buffer texture bound to textureSlot
+    void drawInstanced(InstancedCubes &cubes, int textureSlot);
     // Utility function used in create()
     char* textFileRead(const char*);
     // Utility function that prints any shader compilation errors to the console
@@ -66,29 +76,28 @@ public:
     // Utility function that prints any shader linking errors to the console
     void printLinkInfoLog(int prog);
 
-    void setDepthMVP(const glm::vec3 light);
-    void setDepthMVP(const glm::mat4 mat);
-
-    void setLightProj(const glm::mat4 &v);
-
     void setDimensions(glm::ivec2 dims);
 
+    // Pass the depths between which geometry fades into the fog
+    void setFog(float nearDepth, float farDepth);
+
     QString qTextFileRead(const char*);
 
+private:
+    // Bytes last uploaded to each uniform location of this program. Uniforms
+    // keep their values in the program object, so setters skip any upload
+    // that would not change them.
+    std::unordered_map<int, std::vector<unsigned char>> m_uniformValues;
+
 protected:
+    // Whether the given value differs from the one last uploaded to the
+    // uniform at location; if so it is remembered as uploaded. Always false
+    // for the location -1 of a uniform the program does not use.
+    bool uniformChanged(int location, const void *value, size_t size);
+
     OpenGLContext* context;   // Since Qt's OpenGL support is done through classes like QOpenGLFunctions_3_2_Core,
                             // we need to pass our OpenGL context to the Drawable in order to call GL functions
                             // from within this class.
 };
 
-class DepthThroughShader : public ShaderProgram
-{
-public:
-    DepthThroughShader(OpenGLContext* context);
-    ~DepthThroughShader();
-
-    void drawOpaque(Drawable &d) override;
-    void drawTransparent(Drawable &d) override;
-};
-
 #endif // SHADERPROGRAM_H
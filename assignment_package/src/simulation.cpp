@@ -0,0 +1,216 @@
+#include "simulation.h"
+#include <chrono>
+
+// Time between simulation ticks; matches the GL thread's 16 ms frame timer
+const static std::chrono::milliseconds TICK_INTERVAL(16);
+// How far from the requested center spawnMobs scatters mobs
+const static float MOB_SPAWN_RADIUS = 48.f;
+
+static FrameSnapshot emptySnapshot()
+{
+    FrameSnapshot s;
+    s.tick = 0;
+    s.viewProj = glm::mat4(1.f);
+    s.view = glm::mat4(1.f);
+    s.eye = glm::vec3(0.f);
+    s.look = glm::vec3(0.f, 0.f, -1.f);
+    s.playerPos = glm::vec3(0.f);
+    s.playerVel = glm::vec3(0.f);
+    s.entityCount = 0;
+    s.itemsCollected = 0;
+    s.simMs = 0.f;
+    s.entityMs = 0.f;
+    return s;
+}
+
+Simulation::Simulation(glm::vec3 spawn, const Terrain &terrain)
+    : mcr_terrain(terrain), m_player(spawn, terrain), m_entities(), m_inputMutex(), m_inputs(),
+      m_toggleFlight(false), m_spacePressed(false), m_viewport(0, 0), m_viewportChanged(false),
+      m_spawnRequests(), m_snapshots(emptySnapshot()), m_thread(), m_running(false), m_tick(0),
+      m_entityMs(0.f)
+{
+    // The GL thread may draw before the first tick is published
+    fillSnapshot(m_snapshots.back(), 0.f);
+    m_snapshots.publish();
+    m_snapshots.fetch();
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start()
+{
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void Simulation::run()
+{
+    // Treat the first tick as one interval long rather than nearly zero
+    auto last = std::chrono::steady_clock::now() - TICK_INTERVAL;
+    auto next = std::chrono::steady_clock::now();
+    while (m_running) {
+        auto begin = std::chrono::steady_clock::now();
+        float dT = std::chrono::duration<float>(begin - last).count();
+        last = begin;
+
+        step(dT);
+
+        FrameSnapshot &snapshot = m_snapshots.back();
+        fillSnapshot(snapshot, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        m_snapshots.publish();
+
+        // Keep a steady rate, but never try to catch up on missed ticks;
+        // dT already covers however long we fell behind
+        next += TICK_INTERVAL;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void Simulation::step(float dT)
+{
+    InputBundle inputs;
+    m_inputMutex.lock();
+    inputs = m_inputs;
+    m_inputs.mouseX = 0.f;
+    m_inputs.mouseY = 0.f;
+    if (m_toggleFlight) {
+        m_player.m_flightOn = !m_player.m_flightOn;
+        m_toggleFlight = false;
+    }
+    m_player.m_spacePressed = m_spacePressed;
+    if (m_viewportChanged) {
+        m_player.setCameraWidthHeight(m_viewport.x, m_viewport.y);
+        m_viewportChanged = false;
+    }
+    std::vector<SpawnRequest> spawns;
+    spawns.swap(m_spawnRequests);
+    m_inputMutex.unlock();
+
+    m_player.tick(dT, inputs);
+
+    auto entitiesBegin = std::chrono::steady_clock::now();
+    for (const SpawnRequest &request : spawns) {
+        spawn(request);
+    }
+    m_entities.tick(dT, mcr_terrain, m_player.mcr_position);
+    m_entityMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - entitiesBegin).count();
+    ++m_tick;
+}
+
+void Simulation::spawn(const SpawnRequest &request)
+{
+    if (request.kind == ITEM) {
+        // Pops up and off to a side, like it was knocked loose
+        float angle = m_tick * 2.3999632f;
+        m_entities.spawnItem(request.pos, request.itemType,
+                             glm::vec3(glm::cos(angle) * 1.5f, 5.f, glm::sin(angle) * 1.5f));
+        return;
+    }
+    for (int i = 0; i < request.count; ++i) {
+        // Spread evenly over a disc by a golden angle spiral
+        float r = MOB_SPAWN_RADIUS * glm::sqrt((i + 0.5f) / request.count);
+        float angle = i * 2.3999632f + m_tick;
+        int x = static_cast<int>(glm::floor(request.pos.x + r * glm::cos(angle)));
+        int z = static_cast<int>(glm::floor(request.pos.z + r * glm::sin(angle)));
+        BlockType surface;
+        int y = Terrain::surfaceAt(x, z, surface);
+        m_entities.spawnMob(glm::vec3(x + 0.5f, y + 2.f, z + 0.5f));
+    }
+}
+
+void Simulation::fillSnapshot(FrameSnapshot &snapshot, float simMs) const
+{
+    const Camera &camera = m_player.mcr_camera;
+    snapshot.tick = m_tick;
+    snapshot.viewProj = camera.getViewProj();
+    snapshot.view = camera.getView();
+    snapshot.eye = camera.mcr_position;
+    snapshot.look = camera.getLookVec();
+    snapshot.playerPos = m_player.mcr_position;
+    snapshot.playerVel = m_player.mcr_velocity;
+    snapshot.posText = m_player.posAsQString();
+    snapshot.velText = m_player.velAsQString();
+    snapshot.accText = m_player.accAsQString();
+    snapshot.lookText = m_player.lookAsQString();
+    m_entities.fillInstances(camera.mcr_position, snapshot.entityInstances);
+    snapshot.entityCount = static_cast<int>(m_entities.count());
+    snapshot.itemsCollected = m_entities.itemsCollected();
+    snapshot.simMs = simMs;
+    snapshot.entityMs = m_entityMs;
+}
+
+void Simulation::setInputs(const InputBundle &inputs)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    float mouseX = m_inputs.mouseX;
+    float mouseY = m_inputs.mouseY;
+    m_inputs = inputs;
+    m_inputs.mouseX = mouseX;
+    m_inputs.mouseY = mouseY;
+}
+
+void Simulation::addMouseMovement(float dx, float dy)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_inputs.mouseX += dx;
+    m_inputs.mouseY += dy;
+}
+
+void Simulation::toggleFlight()
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_toggleFlight = !m_toggleFlight;
+}
+
+void Simulation::setSpacePressed(bool pressed)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_spacePressed = pressed;
+}
+
+void Simulation::setViewport(unsigned int w, unsigned int h)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_viewport = glm::uvec2(w, h);
+    m_viewportChanged = true;
+}
+
+void Simulation::dropItem(glm::vec3 pos, BlockType type)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_spawnRequests.push_back({pos, ITEM, type, 1});
+}
+
+void Simulation::spawnMobs(glm::vec3 center, int count)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_spawnRequests.push_back({center, MOB, EMPTY, count});
+}
+
+bool Simulation::fetchSnapshot()
+{
+    return m_snapshots.fetch();
+}
+
+const FrameSnapshot& Simulation::snapshot() const
+{
+    return m_snapshots.front();
+}
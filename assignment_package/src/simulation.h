@@ -0,0 +1,154 @@
+#pragma once
+#include "glm_includes.h"
+#include "scene/entityworld.h"
+#include "scene/player.h"
+#include "scene/terrain.h"
+#include <QString>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Everything the GL thread needs from one simulation tick. Filled in whole
+// by the simulation thread and never changed once published, so the GL
+// thread can read it without locking while the next one is being built.
+struct FrameSnapshot {
+    int tick;              // Ticks simulated since start; also the shader time
+    glm::mat4 viewProj;
+    glm::mat4 view;
+    glm::vec3 eye;         // Camera position
+    glm::vec3 look;        // Camera forward vector
+    glm::vec3 playerPos;   // Drives terrain streaming
+    glm::vec3 playerVel;   // Lets streaming look ahead of the Player
+
+    // Preformatted for the player info window
+    QString posText, velText, accText, lookText;
+
+    // Two texels per entity near the camera; see EntityWorld::fillInstances
+    std::vector<glm::vec4> entityInstances;
+    int entityCount;
+    int itemsCollected;
+
+    float simMs;           // How long the tick that produced this took
+    float entityMs;        // How much of simMs went to the EntityWorld
+};
+
+// Hands values from one producer thread to one consumer thread. The producer
+// writes into back() and publishes it; the consumer fetches the newest
+// published value into front(). With three slots neither side ever waits
+// for the other to finish with a slot, only for the index swap.
+template <typename T>
+class TripleBuffer
+{
+private:
+    T m_items[3];
+    int m_back;   // Being written by the producer
+    int m_ready;  // Newest published value
+    int m_front;  // Being read by the consumer
+    bool m_fresh; // m_ready was published since the last fetch
+    std::mutex m_mutex;
+
+public:
+    TripleBuffer(const T &initial)
+        : m_items{initial, initial, initial}, m_back(0), m_ready(1), m_front(2), m_fresh(false)
+    {}
+
+    T& back() {
+        return m_items[m_back];
+    }
+    void publish() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(m_back, m_ready);
+        m_fresh = true;
+    }
+
+    // Returns false, leaving front() as it was, if nothing new was published
+    bool fetch() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_fresh) {
+            return false;
+        }
+        std::swap(m_front, m_ready);
+        m_fresh = false;
+        return true;
+    }
+    const T& front() const {
+        return m_items[m_front];
+    }
+};
+
+// Runs the Player's input handling and physics, and the mobs and dropped
+// items of the EntityWorld, on a thread of its own at a fixed rate,
+// publishing a FrameSnapshot after every tick. MyGL renders, streams
+// terrain and uploads meshes from the newest snapshot on the GL thread, so
+// a slow frame or a burst of Chunk uploads no longer delays movement, and
+// a slow tick no longer delays drawing.
+//
+// Ownership: the Player and the EntityWorld belong to the simulation thread
+// once started and are only seen by everyone else through snapshots. The
+// simulation thread only ever reads Terrain, through getBlockAt and
+// getBlocksAt. Those lock the Chunk map to find a Chunk, then the Chunk's
+// blocks while reading them, since the GL thread, fluid workers and fill
+// workers all write blocks while the simulation runs. Chunks are never
+// removed, and their GPU handles, mesh ranges and every other GL object
+// stay with the GL thread.
+class Simulation
+{
+private:
+    const Terrain &mcr_terrain;
+    Player m_player;
+    EntityWorld m_entities;
+
+    // Asked for by the GUI thread, spawned at the start of the next tick
+    struct SpawnRequest {
+        glm::vec3 pos;
+        EntityKind kind;
+        BlockType itemType;
+        int count;
+    };
+
+    // Written by the GUI thread, consumed by the simulation thread
+    std::mutex m_inputMutex;
+    InputBundle m_inputs;      // Mouse movement accumulates until consumed
+    bool m_toggleFlight;
+    bool m_spacePressed;
+    glm::uvec2 m_viewport;
+    bool m_viewportChanged;
+    std::vector<SpawnRequest> m_spawnRequests;
+
+    TripleBuffer<FrameSnapshot> m_snapshots;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    int m_tick;
+    float m_entityMs;
+
+    void run();
+    void step(float dT);
+    void spawn(const SpawnRequest &request);
+    void fillSnapshot(FrameSnapshot &snapshot, float simMs) const;
+
+public:
+    Simulation(glm::vec3 spawn, const Terrain &terrain);
+    ~Simulation();
+
+    // Starts ticking on a new thread, and stops and joins it
+    void start();
+    void stop();
+
+    // Called from the GUI thread; applied at the start of the next tick
+    void setInputs(const InputBundle &inputs); // Keys only; mouse movement is added below
+    void addMouseMovement(float dx, float dy);
+    void toggleFlight();
+    void setSpacePressed(bool pressed);
+    void setViewport(unsigned int w, unsigned int h);
+    // Drops a block of the given type as an item at pos
+    void dropItem(glm::vec3 pos, BlockType type);
+    // Spawns count mobs on the ground scattered around center
+    void spawnMobs(glm::vec3 center, int count);
+
+    // Makes the newest published tick current. Returns false if the
+    // simulation has not finished one since the last call.
+    bool fetchSnapshot();
+    // The current snapshot; stays valid and unchanged until fetchSnapshot()
+    const FrameSnapshot& snapshot() const;
+};
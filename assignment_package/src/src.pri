@@ -2,23 +2,37 @@ INCLUDEPATH += $$PWD
 DEPENDPATH += $$PWD
 
 SOURCES += \
-    $$PWD/depthframebuffer.cpp \
     $$PWD/framebuffer.cpp \
+    $$PWD/frameuniforms.cpp \
     $$PWD/main.cpp \
     $$PWD/mainwindow.cpp \
     $$PWD/mygl.cpp \
     $$PWD/postprocessingshader.cpp \
+    $$PWD/pregenerate.cpp \
+    $$PWD/programbinarycache.cpp \
     $$PWD/scene/BlockTypeData.cpp \
+    $$PWD/scene/blockjournal.cpp \
     $$PWD/scene/VBOWorkerData.cpp \
-    $$PWD/scene/lsystem.cpp \
+    $$PWD/scene/entityworld.cpp \
+    $$PWD/scene/fluidsimulator.cpp \
+    $$PWD/scene/instancedcubes.cpp \
+    $$PWD/scene/lightengine.cpp \
     $$PWD/scene/noise.cpp \
     $$PWD/scene/quad.cpp \
+    $$PWD/scene/regionfile.cpp \
+    $$PWD/scene/regionstore.cpp \
+    $$PWD/scene/rivernetwork.cpp \
     $$PWD/shaderprogram.cpp \
+    $$PWD/simulation.cpp \
     $$PWD/drawable.cpp \
+    $$PWD/meshbuffer.cpp \
+    $$PWD/rangeallocator.cpp \
     $$PWD/cameracontrolshelp.cpp \
     $$PWD/scene/cube.cpp \
     $$PWD/openglcontext.cpp \
     $$PWD/scene/terrain.cpp \
+    $$PWD/scene/farterrain.cpp \
+    $$PWD/scene/occlusionculler.cpp \
     $$PWD/scene/worldaxes.cpp \
     $$PWD/scene/entity.cpp \
     $$PWD/scene/player.cpp \
@@ -26,25 +40,38 @@ SOURCES += \
     $$PWD/playerinfo.cpp \
     $$PWD/scene/chunk.cpp \
     $$PWD/texture.cpp \
-    $$PWD/turtle.cpp \
 
 HEADERS += \
-    $$PWD/depthframebuffer.h \
     $$PWD/framebuffer.h \
+    $$PWD/frameuniforms.h \
     $$PWD/mainwindow.h \
     $$PWD/mygl.h \
     $$PWD/postprocessingshader.h \
+    $$PWD/pregenerate.h \
+    $$PWD/programbinarycache.h \
     $$PWD/scene/BlockTypeData.h \
+    $$PWD/scene/blockjournal.h \
     $$PWD/scene/VBOWorkerData.h \
-    $$PWD/scene/lsystem.h \
+    $$PWD/scene/entityworld.h \
+    $$PWD/scene/fluidsimulator.h \
+    $$PWD/scene/instancedcubes.h \
+    $$PWD/scene/lightengine.h \
     $$PWD/scene/noise.h \
     $$PWD/scene/quad.h \
+    $$PWD/scene/regionfile.h \
+    $$PWD/scene/regionstore.h \
+    $$PWD/scene/rivernetwork.h \
     $$PWD/shaderprogram.h \
+    $$PWD/simulation.h \
     $$PWD/drawable.h \
+    $$PWD/meshbuffer.h \
+    $$PWD/rangeallocator.h \
     $$PWD/cameracontrolshelp.h \
     $$PWD/scene/cube.h \
     $$PWD/openglcontext.h \
     $$PWD/scene/terrain.h \
+    $$PWD/scene/farterrain.h \
+    $$PWD/scene/occlusionculler.h \
     $$PWD/scene/worldaxes.h \
     $$PWD/smartpointerhelp.h \
     $$PWD/glm_includes.h \
@@ -54,4 +81,3 @@ HEADERS += \
     $$PWD/playerinfo.h \
     $$PWD/scene/chunk.h \
     $$PWD/texture.h \
-    $$PWD/turtle.h \
@@ -1,6 +1,18 @@
 #include "texture.h"
 #include <QImage>
 #include <glm_includes.h>
+#include <QOpenGLContext>
+#include <algorithm>
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
+// Anisotropic filtering is capped here even if the driver allows more
+const static float MAX_ANISOTROPY = 8.f;
 
 Texture::Texture(OpenGLContext *context)
     : context(context), m_textureHandle(-1), m_textureImage(nullptr)
@@ -15,7 +27,7 @@ void Texture::create()
     QString texturePath = ":/textures.png";
 
     QImage img(texturePath);
-    img.convertToFormat(QImage::Format_ARGB32);
+    img = img.convertToFormat(QImage::Format_ARGB32);
     img = img.mirrored();
     m_textureImage = std::make_shared<QImage>(img);
     context->glGenTextures(1, &m_textureHandle);
@@ -28,19 +40,46 @@ void Texture::load(int texSlot = 0)
     context->printGLErrorLog();
 
     context->glActiveTexture(GL_TEXTURE0 + texSlot);
-    context->glBindTexture(GL_TEXTURE_2D, m_textureHandle);
-
-    // These parameters need to be set for EVERY texture you create
-    // They don't always have to be set to the values given here, but they do need
-    // to be set
-    context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    context->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-                          m_textureImage->width(), m_textureImage->height(),
-                          0, GL_BGRA, GL_UNSIGNED_BYTE, m_textureImage->bits());
+    context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureHandle);
+
+    // Magnified tiles keep their crisp pixels; minified ones blend between
+    // mip levels instead of shimmering at a distance
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    // Every tile is its own layer, so repeating only ever wraps within a tile
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    if (context->context()->hasExtension("GL_EXT_texture_filter_anisotropic")) {
+        GLfloat maxAnisotropy = 1.f;
+        context->glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        context->glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+                                 std::min(maxAnisotropy, MAX_ANISOTROPY));
+    }
+
+    int tileWidth = m_textureImage->width() / ATLAS_TILES_PER_SIDE;
+    int tileHeight = m_textureImage->height() / ATLAS_TILES_PER_SIDE;
+    context->glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, tileWidth, tileHeight,
+                          ATLAS_TILES_PER_SIDE * ATLAS_TILES_PER_SIDE,
+                          0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+
+    // Copy each tile straight out of the atlas image into its layer. The
+    // image was mirrored on load, so its first row is the atlas' bottom.
+    context->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    context->glPixelStorei(GL_UNPACK_ROW_LENGTH, m_textureImage->width());
+    for (int row = 0; row < ATLAS_TILES_PER_SIDE; ++row) {
+        for (int column = 0; column < ATLAS_TILES_PER_SIDE; ++column) {
+            context->glPixelStorei(GL_UNPACK_SKIP_PIXELS, column * tileWidth);
+            context->glPixelStorei(GL_UNPACK_SKIP_ROWS, row * tileHeight);
+            context->glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, row * ATLAS_TILES_PER_SIDE + column,
+                                     tileWidth, tileHeight, 1,
+                                     GL_BGRA, GL_UNSIGNED_BYTE, m_textureImage->constBits());
+        }
+    }
+    context->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    context->glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    context->glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+    context->glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
     context->printGLErrorLog();
 }
 
@@ -48,5 +87,5 @@ void Texture::load(int texSlot = 0)
 void Texture::bind(int texSlot = 0)
 {
     context->glActiveTexture(GL_TEXTURE0 + texSlot);
-    context->glBindTexture(GL_TEXTURE_2D, m_textureHandle);
+    context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureHandle);
 }
@@ -4,6 +4,13 @@
 #include <glm_includes.h>
 #include <memory>
 
+// textures.png is a grid of this many tiles along each side
+#define ATLAS_TILES_PER_SIDE 16
+
+// The block texture atlas. Each tile of textures.png becomes its own layer
+// of a GL_TEXTURE_2D_ARRAY, so tiles can be mipmapped and filtered without
+// sampling their neighbours. The layer of the tile in column c and row r,
+// counting from the atlas' lower-left corner, is r * ATLAS_TILES_PER_SIDE + c.
 class Texture
 {
 public: